@@ -0,0 +1,64 @@
+#pragma once
+
+#include "config.hpp"
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace sidecar {
+
+// Transparent hash so schema lookups accept string_view keys straight from
+// the decoder without building a temporary std::string.
+struct string_hash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view s) const noexcept {
+        return std::hash<std::string_view>{}(s);
+    }
+};
+
+// Position of an attribute in decoded_event and its declared type.
+struct attribute_slot {
+    std::size_t index;
+    attribute_type type;
+};
+
+// Precomputed lookup: attribute name -> schema definition.
+// Each distinct name gets a dense slot index in declaration order; a repeated
+// name keeps its first slot and takes the last declared type.
+struct attribute_schema {
+    std::vector<attribute_def> defs;
+    std::unordered_map<std::string, attribute_slot, string_hash, std::equal_to<>> slots;
+
+    explicit attribute_schema(const std::vector<attribute_def>& attributes) {
+        for (const auto& d : attributes) {
+            auto it = slots.find(d.name);
+            if (it != slots.end()) {
+                it->second.type = d.type;
+                defs[it->second.index].type = d.type;
+                continue;
+            }
+            slots.emplace(d.name, attribute_slot{defs.size(), d.type});
+            defs.push_back(d);
+        }
+    }
+
+    std::size_t size() const { return defs.size(); }
+
+    std::optional<attribute_slot> find(std::string_view name) const {
+        auto it = slots.find(name);
+        if (it != slots.end()) return it->second;
+        return std::nullopt;
+    }
+
+    std::optional<attribute_type> lookup(const std::string& name) const {
+        auto it = slots.find(name);
+        if (it != slots.end()) return it->second.type;
+        return std::nullopt;
+    }
+};
+
+} // namespace sidecar
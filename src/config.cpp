@@ -1,6 +1,8 @@
 #include "config.hpp"
 #include <yaml-cpp/yaml.h>
+#include <charconv>
 #include <stdexcept>
+#include <string_view>
 
 namespace sidecar {
 
@@ -12,6 +14,40 @@ std::optional<binary_format> parse_format(const std::string& s) {
     return std::nullopt;
 }
 
+std::optional<wait_strategy> parse_wait_strategy(const std::string& s) {
+    if (s == "park")     return wait_strategy::park;
+    if (s == "spin")     return wait_strategy::spin;
+    if (s == "yield")    return wait_strategy::yield;
+    if (s == "adaptive") return wait_strategy::adaptive;
+    return std::nullopt;
+}
+
+std::optional<std::vector<int>> parse_cpu_list(std::string_view s) {
+    std::vector<int> cpus;
+    while (!s.empty()) {
+        const auto comma = s.find(',');
+        const auto item = s.substr(0, comma);
+        s = comma == std::string_view::npos ? std::string_view{} : s.substr(comma + 1);
+
+        const auto dash = item.find('-');
+        const auto first_text = item.substr(0, dash);
+        const auto last_text = dash == std::string_view::npos ? first_text : item.substr(dash + 1);
+        int first = 0, last = 0;
+        auto [first_end, first_ec] = std::from_chars(first_text.data(),
+                                                     first_text.data() + first_text.size(), first);
+        auto [last_end, last_ec] = std::from_chars(last_text.data(),
+                                                   last_text.data() + last_text.size(), last);
+        if (first_text.empty() || last_text.empty() ||
+            first_ec != std::errc() || first_end != first_text.data() + first_text.size() ||
+            last_ec != std::errc() || last_end != last_text.data() + last_text.size() ||
+            first < 0 || last < first || last >= k_max_cpus) {
+            return std::nullopt;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
 std::optional<attribute_type> parse_attribute_type(const std::string& s) {
     if (s == "boolean" || s == "bool")     return attribute_type::boolean;
     if (s == "integer" || s == "int")      return attribute_type::integer;
@@ -22,9 +58,43 @@ std::optional<attribute_type> parse_attribute_type(const std::string& s) {
     return std::nullopt;
 }
 
-config load_config(const std::string& path) {
-    YAML::Node root = YAML::LoadFile(path);
-    config cfg;
+const char* attribute_type_name(attribute_type type) {
+    switch (type) {
+        case attribute_type::boolean:      return "boolean";
+        case attribute_type::integer:      return "integer";
+        case attribute_type::float_val:    return "float";
+        case attribute_type::string:       return "string";
+        case attribute_type::string_list:  return "string_list";
+        case attribute_type::integer_list: return "integer_list";
+    }
+    return "string";
+}
+
+std::optional<std::size_t> partition_key_subject_token(const std::string& key) {
+    constexpr std::string_view prefix = "subject:";
+    if (key.size() <= prefix.size() || key.compare(0, prefix.size(), prefix) != 0) {
+        return std::nullopt;
+    }
+    std::size_t token = 0;
+    const char* last = key.data() + key.size();
+    auto [end, ec] = std::from_chars(key.data() + prefix.size(), last, token);
+    if (ec != std::errc() || end != last) return std::nullopt;
+    return token;
+}
+
+namespace {
+
+std::vector<int> cpu_list_setting(const YAML::Node& n, const char* key) {
+    auto cpus = parse_cpu_list(n.as<std::string>());
+    if (!cpus) {
+        throw std::runtime_error(std::string("config: invalid '") + key + "': " + n.as<std::string>());
+    }
+    return *cpus;
+}
+
+// Apply every setting present in `root` on top of `cfg`.
+void apply_settings(const YAML::Node& root, config& cfg) {
+    if (auto n = root["name"]) cfg.name = n.as<std::string>();
 
     // NATS connection
     if (auto n = root["nats_address"]) cfg.nats_address = n.as<std::string>();
@@ -34,11 +104,7 @@ config load_config(const std::string& path) {
     if (auto n = root["tls_ca"])       cfg.tls_ca   = n.as<std::string>();
 
     // Input
-    if (auto n = root["input_subject"]) {
-        cfg.input_subject = n.as<std::string>();
-    } else {
-        throw std::runtime_error("config: 'input_subject' is required");
-    }
+    if (auto n = root["input_subject"]) cfg.input_subject = n.as<std::string>();
 
     if (auto n = root["format"]) {
         auto fmt = parse_format(n.as<std::string>());
@@ -49,24 +115,22 @@ config load_config(const std::string& path) {
     if (auto n = root["input_queue_group"]) cfg.input_queue_group = n.as<std::string>();
 
     // Output
-    if (auto n = root["output_prefix"]) {
-        cfg.output_prefix = n.as<std::string>();
-    } else {
-        cfg.output_prefix = cfg.input_subject;
-    }
+    if (auto n = root["output_prefix"]) cfg.output_prefix = n.as<std::string>();
 
     // Subscription subjects
     if (auto n = root["subscribe_subject"])   cfg.subscribe_subject   = n.as<std::string>();
     if (auto n = root["unsubscribe_subject"]) cfg.unsubscribe_subject = n.as<std::string>();
+    if (auto n = root["admin_subject"])       cfg.admin_subject       = n.as<std::string>();
 
     // Leases
     if (auto n = root["lease_bucket"])                 cfg.lease_bucket = n.as<std::string>();
     if (auto n = root["lease_ttl_seconds"])             cfg.lease_ttl_seconds = n.as<uint32_t>();
     if (auto n = root["lease_check_interval_seconds"])  cfg.lease_check_interval_seconds = n.as<uint32_t>();
 
-    // Attributes (required)
+    // Attributes
     if (auto attrs = root["attributes"]) {
         if (!attrs.IsSequence()) throw std::runtime_error("config: 'attributes' must be a list");
+        cfg.attributes.clear();
         for (const auto& item : attrs) {
             attribute_def def;
             def.name = item["name"].as<std::string>();
@@ -75,25 +139,86 @@ config load_config(const std::string& path) {
             def.type = *type;
             cfg.attributes.push_back(std::move(def));
         }
-    } else {
-        throw std::runtime_error("config: 'attributes' is required");
-    }
-
-    if (cfg.attributes.empty()) {
-        throw std::runtime_error("config: 'attributes' must not be empty");
     }
 
     // Operational
     if (auto n = root["stats_interval_seconds"]) cfg.stats_interval_seconds = n.as<int>();
     if (auto n = root["log_level"])              cfg.log_level = n.as<std::string>();
     if (auto n = root["worker_threads"])         cfg.worker_threads = n.as<unsigned int>();
+    if (auto n = root["worker_batch_size"])      cfg.worker_batch_size = n.as<std::size_t>();
+    if (auto n = root["worker_wait_strategy"]) {
+        auto strategy = parse_wait_strategy(n.as<std::string>());
+        if (!strategy) {
+            throw std::runtime_error("config: invalid 'worker_wait_strategy': " + n.as<std::string>());
+        }
+        cfg.worker_wait_strategy = *strategy;
+    }
+    if (auto n = root["latency_mode"])           cfg.latency_mode = n.as<bool>();
+    if (auto n = root["worker_cpus"])            cfg.worker_cpus = cpu_list_setting(n, "worker_cpus");
+    if (auto n = root["io_cpus"])                cfg.io_cpus = cpu_list_setting(n, "io_cpus");
+    if (auto n = root["numa_aware"])             cfg.numa_aware = n.as<bool>();
+    if (auto n = root["ingest_shards"])          cfg.ingest_shards = n.as<unsigned int>();
+    if (auto n = root["output_shards"])          cfg.output_shards = n.as<unsigned int>();
+    if (auto n = root["partition_attribute"])    cfg.partition_attribute = n.as<std::string>();
+    if (auto n = root["partition_key"])          cfg.partition_key = n.as<std::string>();
+    if (auto n = root["linear_match_threshold"]) cfg.linear_match_threshold = n.as<std::size_t>();
+    if (auto n = root["match_cache_entries"])    cfg.match_cache_entries = n.as<std::size_t>();
+    if (auto n = root["match_cache_max_bytes"])  cfg.match_cache_max_bytes = n.as<std::size_t>();
+    if (auto n = root["snapshot_path"])          cfg.snapshot_path = n.as<std::string>();
+    if (auto n = root["snapshot_interval_seconds"]) cfg.snapshot_interval_seconds = n.as<uint32_t>();
+    if (auto n = root["snapshot_bucket"])        cfg.snapshot_bucket = n.as<std::string>();
+    if (auto n = root["snapshot_publisher"])     cfg.snapshot_publisher = n.as<bool>();
+    if (auto n = root["shard_id"])               cfg.shard_id = n.as<std::string>();
+    if (auto n = root["shard_heartbeat_seconds"]) cfg.shard_heartbeat_seconds = n.as<uint32_t>();
     if (auto n = root["input_queue_max_messages"]) cfg.input_queue_max_messages = n.as<std::size_t>();
     if (auto n = root["input_queue_max_bytes"])    cfg.input_queue_max_bytes = n.as<std::size_t>();
+    if (auto n = root["ordered_output"])           cfg.ordered_output = n.as<bool>();
+    if (auto n = root["reorder_timeout_ms"])       cfg.reorder_timeout_ms = n.as<uint32_t>();
+    if (auto n = root["reorder_max_pending"])      cfg.reorder_max_pending = n.as<std::size_t>();
     if (auto n = root["publish_max_inflight"])     cfg.publish_max_inflight = n.as<std::size_t>();
     if (auto n = root["publish_backpressure_timeout_ms"]) {
         cfg.publish_backpressure_timeout_ms = n.as<uint32_t>();
     }
+}
 
+// Enforce the settings every pipeline needs and fill in derived defaults.
+void finish_pipeline(config& cfg, const std::string& where) {
+    if (cfg.input_subject.empty()) {
+        throw std::runtime_error("config: 'input_subject' is required" + where);
+    }
+    if (cfg.attributes.empty()) {
+        throw std::runtime_error("config: 'attributes' is required and must not be empty" + where);
+    }
+    if (cfg.output_prefix.empty()) cfg.output_prefix = cfg.input_subject;
+}
+
+} // anonymous namespace
+
+config load_config(const std::string& path) {
+    YAML::Node root = YAML::LoadFile(path);
+    config cfg;
+    apply_settings(root, cfg);
+
+    auto pipelines = root["pipelines"];
+    if (!pipelines) {
+        finish_pipeline(cfg, "");
+        return cfg;
+    }
+
+    // Each pipeline starts from the top-level settings, except the input and
+    // output subjects, which must not be shared.
+    if (!pipelines.IsSequence() || pipelines.size() == 0) {
+        throw std::runtime_error("config: 'pipelines' must be a non-empty list");
+    }
+    for (const auto& item : pipelines) {
+        config p = cfg;
+        p.input_subject.clear();
+        p.output_prefix.clear();
+        apply_settings(item, p);
+        if (p.name.empty()) p.name = p.input_subject;
+        finish_pipeline(p, " in pipeline '" + p.name + "'");
+        cfg.pipelines.push_back(std::move(p));
+    }
     return cfg;
 }
 
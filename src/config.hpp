@@ -2,8 +2,10 @@
 
 #include <string>
 #include <vector>
+#include <cstddef>
 #include <cstdint>
 #include <optional>
+#include <string_view>
 
 namespace sidecar {
 
@@ -30,7 +32,22 @@ enum class binary_format {
     zera
 };
 
+// How an idle worker waits for input
+enum class wait_strategy {
+    park,      // block on the worker's semaphore
+    spin,      // busy-poll with a CPU pause hint; never sleeps
+    yield,     // poll, yielding the CPU between attempts
+    adaptive   // spin for an adaptive budget, then block
+};
+
+// Default residual expression count below which a linear_matcher replaces
+// the a-tree search.
+constexpr std::size_t k_default_linear_match_threshold = 50;
+
 struct config {
+    // Pipeline name, used in logs (defaults to input_subject in `pipelines`).
+    std::string name;
+
     // NATS connection
     std::string nats_address = "127.0.0.1";
     uint16_t nats_port = 4222;
@@ -50,6 +67,9 @@ struct config {
     std::string subscribe_subject = "sidecar.subscribe";
     std::string unsubscribe_subject = "sidecar.unsubscribe";
 
+    // Schema administration (add/deprecate attributes at runtime); empty = off
+    std::string admin_subject;
+
     // Soft-state leases via NATS KV
     std::string lease_bucket = "sidecar-leases";
     uint32_t lease_ttl_seconds = 3600;
@@ -65,13 +85,101 @@ struct config {
     // Worker threads for parallel message processing (0 = hardware_concurrency)
     unsigned int worker_threads = 0;
 
-    // Bounded input queue. Newest messages are dropped when either limit is hit.
+    // Maximum messages a worker dequeues and matches per snapshot load.
+    std::size_t worker_batch_size = 32;
+
+    // How idle workers wait for input. latency_mode is a profile for
+    // dedicated cores: it selects the spin strategy regardless of
+    // worker_wait_strategy.
+    wait_strategy worker_wait_strategy = wait_strategy::park;
+    bool latency_mode = false;
+
+    // CPU affinity (empty = not pinned). Worker i runs on worker_cpus[i %
+    // size]; the main I/O thread and every ingest/output shard thread run
+    // on io_cpus. Written as CPU lists, e.g. "0-7,16-23".
+    std::vector<int> worker_cpus;
+    std::vector<int> io_cpus;
+
+    // NUMA-aware placement: each worker stays on one node (the node of its
+    // worker_cpus entry, or node i % nodes) and matches against that node's
+    // own snapshot replica, built by a thread running on the node.
+    bool numa_aware = false;
+
+    // Extra NATS connections, each on its own I/O thread, that read the input
+    // subject (0 = read input on the main connection).
+    unsigned int ingest_shards = 0;
+
+    // Extra NATS connections, each on its own I/O thread, that write matched
+    // publications; worker i uses shard i % output_shards (0 = main connection).
+    unsigned int output_shards = 0;
+
+    // Optional attribute (string or integer) to partition the a-tree by.
+    // Expressions requiring `attr = value` go into one tree per value; events
+    // search only the tree for their own value plus the residual tree.
+    std::string partition_attribute;
+
+    // Keyed dispatch (empty = off): input messages with the same key are
+    // always queued for the same worker, keeping its caches warm for that
+    // key. Either a string, integer or boolean attribute name, read from the
+    // payload on the input thread, or `subject:N` for the N-th (0-based)
+    // token of the message subject.
+    std::string partition_key;
+
+    // Residual expression count below which they are evaluated by a compiled
+    // linear matcher instead of an a-tree search (0 = always use the a-tree).
+    std::size_t linear_match_threshold = k_default_linear_match_threshold;
+
+    // Per-worker LRU cache of match results keyed by the extracted attribute
+    // tuple (0 entries = disabled). Cleared on every subscription change.
+    std::size_t match_cache_entries = 0;
+    std::size_t match_cache_max_bytes = 16ULL * 1024 * 1024;
+
+    // Local file holding subscriptions and lease holders, loaded at startup so
+    // matching resumes before the lease bucket is scanned (empty = disabled).
+    std::string snapshot_path;
+    uint32_t snapshot_interval_seconds = 30;
+
+    // KV bucket through which instances share subscription state. New
+    // instances bootstrap from it when they have no local snapshot; only the
+    // instance with snapshot_publisher set writes to it (every
+    // snapshot_interval_seconds).
+    std::string snapshot_bucket;
+    bool snapshot_publisher = false;
+
+    // Subscription sharding (empty = off). Each instance registers under this
+    // member ID in the lease bucket and only matches the subscriptions it owns
+    // by rendezvous hashing of the canonical expression over the live
+    // members. Subscription IDs stay per instance. Every instance must receive
+    // the full input stream, so input_queue_group must be unset. Membership
+    // records expire with lease_ttl_seconds, which must be at least twice the
+    // heartbeat.
+    std::string shard_id;
+    uint32_t shard_heartbeat_seconds = 10;
+
+    // Bounded input queue. Newest messages are dropped when either limit is
+    // hit; bytes count the allocated size of the queued payload buffers.
     std::size_t input_queue_max_messages = 10000;
     std::size_t input_queue_max_bytes = 64ULL * 1024 * 1024;
 
+    // Ordered output (off by default): input is numbered on admission and
+    // each result waits in a reorder buffer until every earlier one has been
+    // published, so outputs keep input order despite parallel matching. A
+    // missing result is given up after reorder_timeout_ms, or when more than
+    // reorder_max_pending results are held behind it.
+    bool ordered_output = false;
+    uint32_t reorder_timeout_ms = 100;
+    std::size_t reorder_max_pending = 16384;
+
     // Bounded detached publication work and NATS write backpressure timeout.
     std::size_t publish_max_inflight = 1024;
     uint32_t publish_backpressure_timeout_ms = 5000;
+
+    // Pipelines hosted by one process, sharing its NATS connection and worker
+    // pool. Each entry inherits the top-level settings and overrides its own
+    // input subject, format, attributes, output prefix, control subjects and
+    // lease bucket. Connection, worker and publication settings always come
+    // from the top level. Empty = the top level is the only pipeline.
+    std::vector<config> pipelines;
 };
 
 // Parse config from YAML file. Throws on error.
@@ -80,7 +188,24 @@ config load_config(const std::string& path);
 // Parse binary_format from string. Returns nullopt if invalid.
 std::optional<binary_format> parse_format(const std::string& s);
 
+// Parse wait_strategy from string. Returns nullopt if invalid.
+std::optional<wait_strategy> parse_wait_strategy(const std::string& s);
+
 // Parse attribute_type from string. Returns nullopt if invalid.
 std::optional<attribute_type> parse_attribute_type(const std::string& s);
 
+// CPU numbers must be below this (the size of a Linux cpu_set_t).
+constexpr int k_max_cpus = 1024;
+
+// Parse a CPU list such as "0-3,8,10-11". Returns nullopt if invalid or a
+// CPU number is k_max_cpus or more.
+std::optional<std::vector<int>> parse_cpu_list(std::string_view s);
+
+// Canonical config spelling of an attribute_type (e.g. "float").
+const char* attribute_type_name(attribute_type type);
+
+// Subject token index of a `subject:N` partition_key. Returns nullopt for
+// anything else, including attribute names.
+std::optional<std::size_t> partition_key_subject_token(const std::string& key);
+
 } // namespace sidecar
@@ -0,0 +1,67 @@
+#include "cpu_affinity.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef __linux__
+static_assert(sidecar::k_max_cpus <= CPU_SETSIZE, "parsed CPU lists must fit a cpu_set_t");
+#endif
+
+namespace sidecar {
+
+bool pin_current_thread(std::span<const int> cpus) {
+    if (cpus.empty()) return false;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+std::vector<std::vector<int>> numa_node_cpus() {
+    namespace fs = std::filesystem;
+    std::map<int, std::vector<int>> nodes;
+    std::error_code ec;
+    for (fs::directory_iterator it("/sys/devices/system/node", ec), end; !ec && it != end;
+         it.increment(ec)) {
+        const auto name = it->path().filename().string();
+        if (name.size() <= 4 || name.compare(0, 4, "node") != 0) continue;
+        int node = 0;
+        auto [ptr, parse_ec] = std::from_chars(name.data() + 4, name.data() + name.size(), node);
+        if (parse_ec != std::errc() || ptr != name.data() + name.size()) continue;
+
+        std::ifstream in(it->path() / "cpulist");
+        std::string list;
+        if (!std::getline(in, list)) continue;
+        auto cpus = parse_cpu_list(list);
+        if (cpus && !cpus->empty()) nodes.emplace(node, std::move(*cpus));
+    }
+
+    std::vector<std::vector<int>> result;
+    for (auto& [node, cpus] : nodes) result.push_back(std::move(cpus));
+    return result;
+}
+
+std::optional<std::size_t> numa_node_of(const std::vector<std::vector<int>>& nodes, int cpu) {
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        if (std::find(nodes[i].begin(), nodes[i].end(), cpu) != nodes[i].end()) return i;
+    }
+    return std::nullopt;
+}
+
+} // namespace sidecar
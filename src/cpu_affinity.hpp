@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace sidecar {
+
+// Pin the calling thread to `cpus` (threads it creates inherit the mask).
+// Returns false, leaving the thread as it was, when `cpus` is empty, names a
+// CPU that does not exist, or the platform has no thread affinity.
+bool pin_current_thread(std::span<const int> cpus);
+
+// CPUs of every NUMA node, in node order, from /sys/devices/system/node.
+// Empty when the system does not expose a NUMA topology.
+std::vector<std::vector<int>> numa_node_cpus();
+
+// Index into `nodes` of the node holding `cpu`, or nullopt.
+std::optional<std::size_t> numa_node_of(const std::vector<std::vector<int>>& nodes, int cpu);
+
+} // namespace sidecar
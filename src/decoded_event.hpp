@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace sidecar {
+
+// Schema attribute values extracted from one message, indexed by
+// attribute_slot::index. Each worker owns one instance and reuses it for every
+// message: reset() only rewinds the string and list arenas, so once they have
+// grown to the working-set size decoding no longer allocates.
+class decoded_event {
+public:
+    enum class state : uint8_t {
+        absent,     // key not present in the message
+        undefined,  // present but null or of the wrong type
+        value
+    };
+
+    void reset(std::size_t slot_count) {
+        m_slots.assign(slot_count, slot{});
+        m_chars.clear();
+        m_list_strings.clear();
+        m_integers.clear();
+    }
+
+    std::size_t size() const { return m_slots.size(); }
+
+    state status(std::size_t i) const { return m_slots[i].status; }
+    bool has_value(std::size_t i) const { return m_slots[i].status == state::value; }
+
+    bool boolean(std::size_t i) const { return m_slots[i].boolean; }
+    int64_t integer(std::size_t i) const { return m_slots[i].integer; }
+    double real(std::size_t i) const { return m_slots[i].real; }
+
+    std::string_view string(std::size_t i) const {
+        return chars(m_slots[i].offset, m_slots[i].length);
+    }
+
+    std::size_t string_list_size(std::size_t i) const { return m_slots[i].length; }
+
+    std::string_view string_list_at(std::size_t i, std::size_t k) const {
+        const auto& item = m_list_strings[m_slots[i].offset + k];
+        return chars(item.offset, item.length);
+    }
+
+    std::span<const int64_t> integer_list(std::size_t i) const {
+        return std::span<const int64_t>(m_integers).subspan(
+            m_slots[i].offset, m_slots[i].length);
+    }
+
+    void set_undefined(std::size_t i) { m_slots[i] = slot{state::undefined}; }
+
+    void set_boolean(std::size_t i, bool v) {
+        m_slots[i] = slot{state::value};
+        m_slots[i].boolean = v;
+    }
+
+    void set_integer(std::size_t i, int64_t v) {
+        m_slots[i] = slot{state::value};
+        m_slots[i].integer = v;
+    }
+
+    void set_float(std::size_t i, double v) {
+        m_slots[i] = slot{state::value};
+        m_slots[i].real = v;
+    }
+
+    void set_string(std::size_t i, std::string_view v) {
+        m_slots[i] = slot{state::value};
+        m_slots[i].offset = append_chars(v);
+        m_slots[i].length = static_cast<uint32_t>(v.size());
+    }
+
+    // Lists are appended element by element between begin_* and the next
+    // begin_* / set_* call on another slot.
+    void begin_string_list(std::size_t i) {
+        m_slots[i] = slot{state::value};
+        m_slots[i].offset = static_cast<uint32_t>(m_list_strings.size());
+    }
+
+    void push_string(std::size_t i, std::string_view v) {
+        m_list_strings.push_back({append_chars(v), static_cast<uint32_t>(v.size())});
+        ++m_slots[i].length;
+    }
+
+    void begin_integer_list(std::size_t i) {
+        m_slots[i] = slot{state::value};
+        m_slots[i].offset = static_cast<uint32_t>(m_integers.size());
+    }
+
+    void push_integer(std::size_t i, int64_t v) {
+        m_integers.push_back(v);
+        ++m_slots[i].length;
+    }
+
+private:
+    struct slot {
+        state status = state::absent;
+        bool boolean = false;
+        int64_t integer = 0;
+        double real = 0.0;
+        // String bytes in m_chars, or a list range in m_list_strings/m_integers.
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    struct string_ref {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    uint32_t append_chars(std::string_view v) {
+        auto offset = static_cast<uint32_t>(m_chars.size());
+        m_chars.insert(m_chars.end(), v.begin(), v.end());
+        return offset;
+    }
+
+    std::string_view chars(uint32_t offset, uint32_t length) const {
+        return std::string_view(m_chars.data() + offset, length);
+    }
+
+    std::vector<slot> m_slots;
+    std::vector<char> m_chars;
+    std::vector<string_ref> m_list_strings;
+    std::vector<int64_t> m_integers;
+};
+
+} // namespace sidecar
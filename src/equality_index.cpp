@@ -0,0 +1,183 @@
+#include "equality_index.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace sidecar {
+
+namespace {
+
+enum class key_tag : char { boolean = 'b', integer = 'i', real = 'f', string = 's', list = 'l' };
+
+template <typename T>
+void append_raw(std::string& out, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+void append_string(std::string& out, std::string_view value) {
+    append_raw(out, static_cast<uint32_t>(value.size()));
+    out.append(value.data(), value.size());
+}
+
+std::optional<equality_term> equality_term_of(const expression_node& node,
+                                              const attribute_schema& schema) {
+    if (node.type != expression_node::kind::predicate) return std::nullopt;
+
+    auto slot = schema.find(node.attribute);
+    if (!slot) return std::nullopt;
+
+    if (node.op == predicate_op::truthy) {
+        if (slot->type != attribute_type::boolean) return std::nullopt;
+        return equality_term{*slot, true};
+    }
+    if (node.op != predicate_op::eq || node.values.size() != 1) return std::nullopt;
+
+    const auto& value = node.values.front();
+    const bool type_ok =
+        (slot->type == attribute_type::string && std::holds_alternative<std::string>(value)) ||
+        (slot->type == attribute_type::integer && std::holds_alternative<int64_t>(value));
+    if (!type_ok) return std::nullopt;
+    return equality_term{*slot, value};
+}
+
+} // anonymous namespace
+
+std::optional<std::vector<equality_term>> equality_terms(
+    const expression_node& node, const attribute_schema& schema) {
+    std::vector<equality_term> terms;
+    if (node.type == expression_node::kind::conjunction) {
+        for (const auto& child : node.children) {
+            auto term = equality_term_of(child, schema);
+            if (!term) return std::nullopt;
+            terms.push_back(std::move(*term));
+        }
+    } else {
+        auto term = equality_term_of(node, schema);
+        if (!term) return std::nullopt;
+        terms.push_back(std::move(*term));
+    }
+
+    std::sort(terms.begin(), terms.end(), [](const auto& a, const auto& b) {
+        return a.slot.index < b.slot.index;
+    });
+    for (std::size_t k = 1; k < terms.size(); ++k) {
+        // `a = 1 AND a = 2` and friends stay with the a-tree.
+        if (terms[k].slot.index == terms[k - 1].slot.index) return std::nullopt;
+    }
+    return terms;
+}
+
+std::optional<std::string> pinned_value_key(
+    const expression_node& node, const attribute_schema& schema, attribute_slot slot) {
+    auto pins = [&](const expression_node& n) {
+        auto term = equality_term_of(n, schema);
+        return term && term->slot.index == slot.index;
+    };
+
+    const expression_node* pin = nullptr;
+    if (node.type == expression_node::kind::conjunction) {
+        for (const auto& child : node.children) {
+            if (pins(child)) {
+                pin = &child;
+                break;
+            }
+        }
+    } else if (pins(node)) {
+        pin = &node;
+    }
+    if (!pin) return std::nullopt;
+
+    std::string key;
+    append_literal_key(key, pin->op == predicate_op::truthy ? expression_literal{true}
+                                                            : pin->values.front());
+    return key;
+}
+
+void equality_index::add(uint64_t subscription_id, const std::vector<equality_term>& terms) {
+    std::vector<std::size_t> slots;
+    slots.reserve(terms.size());
+    for (const auto& term : terms) slots.push_back(term.slot.index);
+
+    auto [it, inserted] = m_group_by_slots.try_emplace(slots, m_groups.size());
+    if (inserted) m_groups.push_back(group{std::move(slots), {}});
+
+    std::string key;
+    for (const auto& term : terms) append_literal_key(key, term.value);
+    m_groups[it->second].entries[std::move(key)].push_back(subscription_id);
+    ++m_size;
+}
+
+void equality_index::probe(const decoded_event& event, const attribute_schema& schema,
+                           std::string& key_scratch, std::vector<uint64_t>& out) const {
+    for (const auto& g : m_groups) {
+        key_scratch.clear();
+        bool complete = true;
+        for (auto slot : g.slots) {
+            if (!event.has_value(slot)) {
+                complete = false;
+                break;
+            }
+            append_value_key(key_scratch, event, slot, schema.defs[slot].type);
+        }
+        if (!complete) continue;
+
+        auto it = g.entries.find(key_scratch);
+        if (it != g.entries.end()) {
+            out.insert(out.end(), it->second.begin(), it->second.end());
+        }
+    }
+}
+
+void append_literal_key(std::string& out, const expression_literal& value) {
+    if (auto b = std::get_if<bool>(&value)) {
+        out += static_cast<char>(key_tag::boolean);
+        out += *b ? '\1' : '\0';
+    } else if (auto i = std::get_if<int64_t>(&value)) {
+        out += static_cast<char>(key_tag::integer);
+        append_raw(out, *i);
+    } else if (auto s = std::get_if<std::string>(&value)) {
+        out += static_cast<char>(key_tag::string);
+        append_string(out, *s);
+    }
+}
+
+void append_value_key(std::string& out, const decoded_event& event,
+                      std::size_t slot, attribute_type type) {
+    switch (type) {
+        case attribute_type::boolean:
+            out += static_cast<char>(key_tag::boolean);
+            out += event.boolean(slot) ? '\1' : '\0';
+            break;
+        case attribute_type::integer:
+            out += static_cast<char>(key_tag::integer);
+            append_raw(out, event.integer(slot));
+            break;
+        case attribute_type::float_val:
+            out += static_cast<char>(key_tag::real);
+            append_raw(out, event.real(slot));
+            break;
+        case attribute_type::string:
+            out += static_cast<char>(key_tag::string);
+            append_string(out, event.string(slot));
+            break;
+        case attribute_type::string_list: {
+            out += static_cast<char>(key_tag::list);
+            const auto n = event.string_list_size(slot);
+            append_raw(out, static_cast<uint32_t>(n));
+            for (std::size_t k = 0; k < n; ++k) {
+                append_string(out, event.string_list_at(slot, k));
+            }
+            break;
+        }
+        case attribute_type::integer_list: {
+            out += static_cast<char>(key_tag::list);
+            auto values = event.integer_list(slot);
+            append_raw(out, static_cast<uint32_t>(values.size()));
+            for (auto v : values) append_raw(out, v);
+            break;
+        }
+    }
+}
+
+} // namespace sidecar
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "attribute_schema.hpp"
+#include "decoded_event.hpp"
+#include "expression.hpp"
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sidecar {
+
+// One `attribute = value` term of a pure equality conjunction.
+struct equality_term {
+    attribute_slot slot;
+    expression_literal value;
+};
+
+// Returns the terms of `node` if it is a conjunction of equality tests on
+// distinct attributes: `string = "..."`, `integer = N` or a bare boolean
+// attribute, e.g. `location = "w7" AND severity = 5 AND active`. Returns
+// nullopt for anything else, including float equality, which is left to the
+// a-tree.
+std::optional<std::vector<equality_term>> equality_terms(
+    const expression_node& node, const attribute_schema& schema);
+
+// If `node` requires `attribute = literal` for the given slot as one of its
+// top-level conjuncts, return the key of that literal as produced by
+// append_literal_key(). Used to route expressions to partition trees.
+std::optional<std::string> pinned_value_key(
+    const expression_node& node, const attribute_schema& schema, attribute_slot slot);
+
+// Hash index for pure equality conjunctions, kept outside the a-tree.
+// Subscriptions are grouped by the set of attributes they test; each group
+// maps the encoded tuple of required values to the matching subscription
+// IDs, so an event costs one hash probe per group.
+class equality_index {
+public:
+    void add(uint64_t subscription_id, const std::vector<equality_term>& terms);
+
+    // Append IDs of all indexed subscriptions matched by `event`.
+    void probe(const decoded_event& event, const attribute_schema& schema,
+               std::string& key_scratch, std::vector<uint64_t>& out) const;
+
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+private:
+    struct group {
+        std::vector<std::size_t> slots;  // ascending
+        std::unordered_map<std::string, std::vector<uint64_t>> entries;
+    };
+
+    std::vector<group> m_groups;
+    std::map<std::vector<std::size_t>, std::size_t> m_group_by_slots;
+    std::size_t m_size = 0;
+};
+
+// Append a type-tagged binary encoding of a slot's value to `out`. Equal
+// values of the same attribute type always produce equal bytes.
+void append_value_key(std::string& out, const decoded_event& event,
+                      std::size_t slot, attribute_type type);
+
+// Append the encoding of a boolean, integer or string literal; matches
+// append_value_key() for an equal event value. Floats are not encoded.
+void append_literal_key(std::string& out, const expression_literal& value);
+
+} // namespace sidecar
@@ -1,13 +1,174 @@
 #include "event_bridge.hpp"
+#include <algorithm>
+#include <functional>
 
 namespace sidecar {
 
-std::optional<std::vector<uint64_t>> deserialize_and_match(
+void populate_event(
+    atree::EventBuilder& builder,
+    const attribute_schema& schema,
+    const decoded_event& event,
+    match_scratch& scratch)
+{
+    for (std::size_t i = 0; i < event.size(); ++i) {
+        const auto& def = schema.defs[i];
+        switch (event.status(i)) {
+            case decoded_event::state::absent:
+                continue;
+            case decoded_event::state::undefined:
+                builder.with_undefined(def.name);
+                continue;
+            case decoded_event::state::value:
+                break;
+        }
+
+        switch (def.type) {
+            case attribute_type::boolean:
+                builder.with_boolean(def.name, event.boolean(i));
+                break;
+
+            case attribute_type::integer:
+                builder.with_integer(def.name, event.integer(i));
+                break;
+
+            case attribute_type::float_val:
+                builder.with_float(def.name, event.real(i));
+                break;
+
+            case attribute_type::string:
+                scratch.string_value.assign(event.string(i));
+                builder.with_string(def.name, scratch.string_value);
+                break;
+
+            case attribute_type::string_list: {
+                // resize() keeps the surviving elements' buffers, so repeated
+                // lists of similar length reuse their storage.
+                const auto n = event.string_list_size(i);
+                scratch.string_list.resize(n);
+                for (std::size_t k = 0; k < n; ++k) {
+                    scratch.string_list[k].assign(event.string_list_at(i, k));
+                }
+                builder.with_string_list(def.name, scratch.string_list);
+                break;
+            }
+
+            case attribute_type::integer_list: {
+                auto values = event.integer_list(i);
+                scratch.integer_list.assign(values.begin(), values.end());
+                builder.with_integer_list(def.name, scratch.integer_list);
+                break;
+            }
+        }
+    }
+}
+
+namespace {
+
+void search_tree(
     const atree::Tree& tree,
+    const attribute_schema& schema,
+    const decoded_event& event,
+    match_scratch& scratch,
+    std::vector<uint64_t>& out)
+{
+    auto builder = tree.make_event();
+    populate_event(builder, schema, event, scratch);
+    auto found = tree.search(std::move(builder));
+    out.insert(out.end(), found.begin(), found.end());
+}
+
+// The partition tree selected by the event's partition attribute, if any.
+const tree_partition* find_partition(
+    const tree_snapshot& snap,
+    const decoded_event& event,
+    std::string& key)
+{
+    if (snap.partitions.empty() || !snap.partition_slot) return nullptr;
+    const auto slot = *snap.partition_slot;
+    if (!event.has_value(slot.index)) return nullptr;
+
+    key.clear();
+    append_value_key(key, event, slot.index, slot.type);
+    auto it = snap.partitions.find(key);
+    return it != snap.partitions.end() ? &it->second : nullptr;
+}
+
+bool search_uncached(
+    const tree_snapshot& snap,
+    const attribute_schema& schema,
+    const decoded_event& event,
+    match_scratch& scratch,
+    std::vector<uint64_t>& out,
+    const std::shared_ptr<spdlog::logger>& log)
+{
+    if (!snap.equality.empty()) {
+        snap.equality.probe(event, schema, scratch.key, out);
+    }
+    const bool search_residual =
+        snap.tree_size > 0 && snap.prefilter.may_match(event, schema, scratch.key);
+    const auto* partition = find_partition(snap, event, scratch.key);
+
+    try {
+        if (search_residual) {
+            if (!snap.linear.empty()) {
+                snap.linear.match(event, out);
+            } else {
+                search_tree(*snap.tree, schema, event, scratch, out);
+            }
+        }
+        if (partition) search_tree(*partition->tree, schema, event, scratch, out);
+        return true;
+    } catch (const std::exception& e) {
+        if (log) log->warn("event_bridge: a-tree search failed: {}", e.what());
+        return false;
+    }
+}
+
+} // anonymous namespace
+
+bool search_event(
+    const tree_snapshot& snap,
+    const attribute_schema& schema,
+    const decoded_event& event,
+    match_scratch& scratch,
+    std::vector<uint64_t>& out,
+    const std::shared_ptr<spdlog::logger>& log)
+{
+    auto& cache = scratch.cache;
+    if (!cache.enabled()) return search_uncached(snap, schema, event, scratch, out, log);
+
+    cache.sync(snap.version);
+    scratch.cache_key.clear();
+    append_event_key(scratch.cache_key, event, schema);
+    if (auto ids = cache.find(scratch.cache_key)) {
+        out.insert(out.end(), ids->begin(), ids->end());
+        return true;
+    }
+
+    const auto first = out.size();
+    if (!search_uncached(snap, schema, event, scratch, out, log)) return false;
+    cache.insert(scratch.cache_key, std::span<const uint64_t>(out).subspan(first));
+    return true;
+}
+
+void search_ranges(
+    const tree_snapshot& snap,
+    const decoded_event& event,
+    match_scratch& scratch,
+    std::vector<uint64_t>& out)
+{
+    if (snap.ranges->empty()) return;
+    const decoded_event* events[] = {&event};
+    snap.ranges->evaluate(events, scratch.ranges);
+    snap.ranges->append_matches(scratch.ranges, 0, out);
+}
+
+bool decode_payload(
     const attribute_schema& schema,
     binary_format format,
     std::span<const char> payload,
-    std::shared_ptr<spdlog::logger> log)
+    decoded_event& event,
+    const std::shared_ptr<spdlog::logger>& log)
 {
     try {
         auto bytes = std::span<const uint8_t>(
@@ -16,26 +177,143 @@ std::optional<std::vector<uint64_t>> deserialize_and_match(
         switch (format) {
             case binary_format::msgpack: {
                 zerialize::MsgPack::Deserializer reader(bytes);
-                return match_message(tree, schema, reader, log);
+                return decode_event(event, schema, reader, log);
             }
             case binary_format::cbor: {
                 zerialize::CBOR::Deserializer reader(bytes);
-                return match_message(tree, schema, reader, log);
+                return decode_event(event, schema, reader, log);
             }
             case binary_format::flexbuffers: {
                 zerialize::Flex::Deserializer reader(bytes);
-                return match_message(tree, schema, reader, log);
+                return decode_event(event, schema, reader, log);
             }
             case binary_format::zera: {
                 zerialize::Zera::Deserializer reader(bytes);
-                return match_message(tree, schema, reader, log);
+                return decode_event(event, schema, reader, log);
             }
         }
     } catch (const std::exception& e) {
         if (log) log->debug("event_bridge: deserialization failed: {}", e.what());
     }
 
+    return false;
+}
+
+namespace {
+
+template <typename Reader>
+std::optional<uint64_t> key_hash(Reader& reader, std::string_view key) {
+    if (!reader.isMap()) return std::nullopt;
+    for (auto key_sv : reader.mapKeys()) {
+        if (key_sv != key) continue;
+        auto value = reader[key_sv];
+        if (value.isString()) return std::hash<std::string_view>{}(value.asStringView());
+        if (value.isInt() || value.isUInt()) return std::hash<int64_t>{}(value.asInt64());
+        if (value.isBool()) return value.asBool() ? 1 : 0;
+        return std::nullopt;
+    }
     return std::nullopt;
 }
 
+} // anonymous namespace
+
+std::optional<uint64_t> payload_key_hash(
+    binary_format format,
+    std::span<const char> payload,
+    std::string_view key)
+{
+    try {
+        auto bytes = std::span<const uint8_t>(
+            reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+
+        switch (format) {
+            case binary_format::msgpack: {
+                zerialize::MsgPack::Deserializer reader(bytes);
+                return key_hash(reader, key);
+            }
+            case binary_format::cbor: {
+                zerialize::CBOR::Deserializer reader(bytes);
+                return key_hash(reader, key);
+            }
+            case binary_format::flexbuffers: {
+                zerialize::Flex::Deserializer reader(bytes);
+                return key_hash(reader, key);
+            }
+            case binary_format::zera: {
+                zerialize::Zera::Deserializer reader(bytes);
+                return key_hash(reader, key);
+            }
+        }
+    } catch (const std::exception&) {
+        // Unreadable payloads are dispatched without a key; the worker
+        // reports the decode failure.
+    }
+    return std::nullopt;
+}
+
+bool deserialize_and_match(
+    const tree_snapshot& snap,
+    const attribute_schema& schema,
+    binary_format format,
+    std::span<const char> payload,
+    match_scratch& scratch,
+    const std::shared_ptr<spdlog::logger>& log)
+{
+    scratch.matches.clear();
+    if (!decode_payload(schema, format, payload, scratch.event, log) ||
+        !search_event(snap, schema, scratch.event, scratch, scratch.matches, log)) {
+        return false;
+    }
+    search_ranges(snap, scratch.event, scratch, scratch.matches);
+    return true;
+}
+
+void match_batch(
+    const tree_snapshot& snap,
+    const attribute_schema& schema,
+    binary_format format,
+    std::span<const std::vector<char>> payloads,
+    match_scratch& scratch,
+    batch_matches& out,
+    const std::shared_ptr<spdlog::logger>& log)
+{
+    const auto n = payloads.size();
+    if (scratch.batch_events.size() < n) scratch.batch_events.resize(n);
+
+    out.ids.clear();
+    out.offsets.assign(1, 0);
+    out.failed.assign(n, 0);
+
+    for (std::size_t k = 0; k < n; ++k) {
+        std::span<const char> payload(payloads[k].data(), payloads[k].size());
+        if (!decode_payload(schema, format, payload, scratch.batch_events[k], log)) {
+            out.failed[k] = 1;
+        }
+    }
+
+    constexpr auto chunk = range_engine::k_max_events;
+    for (std::size_t begin = 0; begin < n; begin += chunk) {
+        const auto end = std::min(n, begin + chunk);
+
+        if (!snap.ranges->empty()) {
+            scratch.range_events.clear();
+            for (auto k = begin; k < end; ++k) {
+                scratch.range_events.push_back(out.failed[k] ? nullptr : &scratch.batch_events[k]);
+            }
+            snap.ranges->evaluate(scratch.range_events, scratch.ranges);
+        }
+
+        for (auto k = begin; k < end; ++k) {
+            if (!out.failed[k] &&
+                !search_event(snap, schema, scratch.batch_events[k], scratch, out.ids, log)) {
+                out.failed[k] = 1;
+            }
+            if (!out.failed[k] && !snap.ranges->empty()) {
+                snap.ranges->append_matches(scratch.ranges, k - begin, out.ids);
+            }
+            out.offsets.push_back(out.ids.size());
+        }
+    }
+}
+
 } // namespace sidecar
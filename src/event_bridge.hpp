@@ -1,6 +1,11 @@
 #pragma once
 
+#include "attribute_schema.hpp"
 #include "config.hpp"
+#include "decoded_event.hpp"
+#include "match_cache.hpp"
+#include "range_engine.hpp"
+#include "tree_snapshot.hpp"
 #include <atree.hpp>
 #include <limits>
 #include <zerialize/zerialize.hpp>
@@ -11,38 +16,54 @@
 #include <spdlog/spdlog.h>
 #include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
-#include <unordered_map>
-#include <unordered_set>
 
 namespace sidecar {
 
-// Precomputed lookup: attribute name -> schema definition
-struct attribute_schema {
-    std::unordered_map<std::string, attribute_type> types;
+// Per-worker reusable matching state. Owned by a single worker thread and
+// reused for every message it processes, so steady-state decoding and event
+// construction reuse the same buffers instead of allocating per message.
+struct match_scratch {
+    decoded_event event;
 
-    explicit attribute_schema(const std::vector<attribute_def>& defs) {
-        for (const auto& d : defs) {
-            types[d.name] = d.type;
-        }
-    }
+    // Staging for a-tree EventBuilder calls, which take owning containers.
+    std::string string_value;
+    std::vector<std::string> string_list;
+    std::vector<int64_t> integer_list;
 
-    std::optional<attribute_type> lookup(const std::string& name) const {
-        auto it = types.find(name);
-        if (it != types.end()) return it->second;
-        return std::nullopt;
-    }
+    // Key buffer for equality index probes.
+    std::string key;
+
+    // Optional result cache (see match_cache) and its key buffer.
+    match_cache cache;
+    std::string cache_key;
+
+    // Matched subscription IDs of the most recent message. Cleared, not
+    // released, between messages.
+    std::vector<uint64_t> matches;
+
+    // Decoded events of the current batch (see match_batch). Grows to the
+    // largest batch seen and is reused afterwards.
+    std::vector<decoded_event> batch_events;
+
+    // Range engine input and output for the current micro-batch.
+    std::vector<const decoded_event*> range_events;
+    range_batch ranges;
 };
 
-// Populate an EventBuilder from a zerialize reader using the schema.
+// Extract schema attributes from a zerialize reader into a decoded_event.
+// Returns false when the payload is not a map.
 template <typename Reader>
-bool populate_event(
-    atree::EventBuilder& builder,
+bool decode_event(
+    decoded_event& event,
     const attribute_schema& schema,
     Reader& reader,
-    std::shared_ptr<spdlog::logger> log)
+    const std::shared_ptr<spdlog::logger>& log)
 {
+    event.reset(schema.size());
+
     if (!reader.isMap()) {
         if (log) log->debug("event_bridge: payload is not a map");
         return false;
@@ -50,116 +71,186 @@ bool populate_event(
 
     auto keys = reader.mapKeys();
     for (auto key_sv : keys) {
-        std::string key(key_sv);
-
-        auto type_opt = schema.lookup(key);
-        if (!type_opt) continue;
+        auto slot = schema.find(key_sv);
+        if (!slot) continue;
 
+        const auto i = slot->index;
         auto value = reader[key_sv];
 
         try {
-            switch (*type_opt) {
+            switch (slot->type) {
                 case attribute_type::boolean:
                     if (value.isBool()) {
-                        builder.with_boolean(key, value.asBool());
+                        event.set_boolean(i, value.asBool());
                     } else {
-                        builder.with_undefined(key);
+                        event.set_undefined(i);
                     }
                     break;
 
                 case attribute_type::integer:
                     if (value.isInt() || value.isUInt()) {
-                        builder.with_integer(key, value.asInt64());
+                        event.set_integer(i, value.asInt64());
                     } else {
-                        builder.with_undefined(key);
+                        event.set_undefined(i);
                     }
                     break;
 
                 case attribute_type::float_val:
                     if (value.isFloat()) {
-                        builder.with_float(key, value.asDouble());
+                        event.set_float(i, value.asDouble());
                     } else if (value.isInt() || value.isUInt()) {
-                        builder.with_float(key, static_cast<double>(value.asInt64()));
+                        event.set_float(i, static_cast<double>(value.asInt64()));
                     } else {
-                        builder.with_undefined(key);
+                        event.set_undefined(i);
                     }
                     break;
 
                 case attribute_type::string:
                     if (value.isString()) {
-                        builder.with_string(key, std::string(value.asStringView()));
+                        event.set_string(i, value.asStringView());
                     } else {
-                        builder.with_undefined(key);
+                        event.set_undefined(i);
                     }
                     break;
 
                 case attribute_type::string_list:
                     if (value.isArray()) {
-                        std::vector<std::string> list;
+                        event.begin_string_list(i);
                         auto sz = value.arraySize();
-                        list.reserve(sz);
-                        for (size_t i = 0; i < sz; ++i) {
-                            auto elem = value[i];
-                            if (elem.isString()) list.emplace_back(elem.asString());
+                        for (size_t k = 0; k < sz; ++k) {
+                            auto elem = value[k];
+                            if (elem.isString()) event.push_string(i, elem.asStringView());
                         }
-                        builder.with_string_list(key, list);
                     } else {
-                        builder.with_undefined(key);
+                        event.set_undefined(i);
                     }
                     break;
 
                 case attribute_type::integer_list:
                     if (value.isArray()) {
-                        std::vector<int64_t> list;
+                        event.begin_integer_list(i);
                         auto sz = value.arraySize();
-                        list.reserve(sz);
-                        for (size_t i = 0; i < sz; ++i) {
-                            auto elem = value[i];
-                            if (elem.isInt() || elem.isUInt()) list.push_back(elem.asInt64());
+                        for (size_t k = 0; k < sz; ++k) {
+                            auto elem = value[k];
+                            if (elem.isInt() || elem.isUInt()) event.push_integer(i, elem.asInt64());
                         }
-                        builder.with_integer_list(key, list);
                     } else {
-                        builder.with_undefined(key);
+                        event.set_undefined(i);
                     }
                     break;
             }
         } catch (const std::exception& e) {
-            if (log) log->debug("event_bridge: failed to extract field '{}': {}", key, e.what());
-            try { builder.with_undefined(key); } catch (...) {}
+            if (log) log->debug("event_bridge: failed to extract field '{}': {}", key_sv, e.what());
+            event.set_undefined(i);
         }
     }
 
     return true;
 }
 
-// Match a deserialized message against all active subscriptions.
+// Populate an a-tree EventBuilder from a decoded event. Attributes absent from
+// the message are left unset, matching the a-tree's own handling.
+void populate_event(
+    atree::EventBuilder& builder,
+    const attribute_schema& schema,
+    const decoded_event& event,
+    match_scratch& scratch);
+
+// Match a decoded event against a snapshot: probe the equality index, search
+// the residual tree unless the snapshot's prefilter rules out every one of
+// its expressions, then search the partition tree selected by the event.
+// With scratch.cache enabled, results for a previously seen attribute tuple
+// are served from the cache. Matched IDs are appended to `out`. Returns
+// false if the a-tree rejected the event.
+bool search_event(
+    const tree_snapshot& snap,
+    const attribute_schema& schema,
+    const decoded_event& event,
+    match_scratch& scratch,
+    std::vector<uint64_t>& out,
+    const std::shared_ptr<spdlog::logger>& log);
+
+// Evaluate the snapshot's range engine for a single event and append its
+// matches to `out`. match_batch() evaluates whole micro-batches instead.
+void search_ranges(
+    const tree_snapshot& snap,
+    const decoded_event& event,
+    match_scratch& scratch,
+    std::vector<uint64_t>& out);
+
+// Match a deserialized message against all active subscriptions. Matched IDs
+// are written to scratch.matches. Returns false if decoding or search failed.
 template <typename Reader>
-std::optional<std::vector<uint64_t>> match_message(
-    const atree::Tree& tree,
+bool match_message(
+    const tree_snapshot& snap,
     const attribute_schema& schema,
     Reader& reader,
-    std::shared_ptr<spdlog::logger> log)
+    match_scratch& scratch,
+    const std::shared_ptr<spdlog::logger>& log)
 {
-    auto event = tree.make_event();
-
-    if (!populate_event(event, schema, reader, log)) {
-        return std::nullopt;
-    }
-
-    try {
-        return tree.search(std::move(event));
-    } catch (const std::exception& e) {
-        if (log) log->warn("event_bridge: a-tree search failed: {}", e.what());
-        return std::nullopt;
+    scratch.matches.clear();
+    if (!decode_event(scratch.event, schema, reader, log) ||
+        !search_event(snap, schema, scratch.event, scratch, scratch.matches, log)) {
+        return false;
     }
+    search_ranges(snap, scratch.event, scratch, scratch.matches);
+    return true;
 }
 
+// Deserialize raw bytes according to format and extract schema attributes.
+bool decode_payload(
+    const attribute_schema& schema,
+    binary_format format,
+    std::span<const char> payload,
+    decoded_event& event,
+    const std::shared_ptr<spdlog::logger>& log);
+
+// Hash of the string, integer or boolean stored under `key` in the payload's
+// top-level map, for keyed dispatch. Returns nullopt when the payload cannot
+// be read or has no such value.
+std::optional<uint64_t> payload_key_hash(
+    binary_format format,
+    std::span<const char> payload,
+    std::string_view key);
+
 // Top-level entry: deserialize raw bytes according to format, then match.
-std::optional<std::vector<uint64_t>> deserialize_and_match(
-    const atree::Tree& tree,
+// Matched IDs are written to scratch.matches.
+bool deserialize_and_match(
+    const tree_snapshot& snap,
     const attribute_schema& schema,
     binary_format format,
     std::span<const char> payload,
-    std::shared_ptr<spdlog::logger> log);
+    match_scratch& scratch,
+    const std::shared_ptr<spdlog::logger>& log);
+
+// Flattened results of match_batch(). Matches of event k are
+// ids[offsets[k], offsets[k + 1]); failed[k] is non-zero when event k could
+// not be decoded or searched.
+struct batch_matches {
+    std::vector<uint64_t> ids;
+    std::vector<std::size_t> offsets;
+    std::vector<uint8_t> failed;
+
+    std::size_t size() const { return failed.size(); }
+
+    std::span<const uint64_t> matches(std::size_t k) const {
+        return std::span<const uint64_t>(ids).subspan(
+            offsets[k], offsets[k + 1] - offsets[k]);
+    }
+};
+
+// Match a batch of payloads against one snapshot. Every payload is decoded
+// first and the searches then run back to back, so consecutive lookups hit
+// the same warm tree nodes. Range expressions are evaluated once per
+// micro-batch of up to range_engine::k_max_events events. Buffers in
+// `scratch` and `out` are reused.
+void match_batch(
+    const tree_snapshot& snap,
+    const attribute_schema& schema,
+    binary_format format,
+    std::span<const std::vector<char>> payloads,
+    match_scratch& scratch,
+    batch_matches& out,
+    const std::shared_ptr<spdlog::logger>& log);
 
 } // namespace sidecar
@@ -0,0 +1,560 @@
+#include "expression.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <utility>
+
+namespace sidecar {
+
+namespace {
+
+struct token {
+    enum class kind { end, identifier, string, integer, real, symbol, error };
+
+    kind type = kind::end;
+    std::string text;     // identifier, symbol or unescaped string value
+    std::string keyword;  // lower-cased identifier, for keyword matching
+    int64_t integer = 0;
+    double real = 0.0;
+};
+
+class lexer {
+public:
+    explicit lexer(std::string_view text) : m_text(text) {}
+
+    token next() {
+        while (m_pos < m_text.size() &&
+               std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+            ++m_pos;
+        }
+
+        token t;
+        if (m_pos >= m_text.size()) return t;
+
+        const char c = m_text[m_pos];
+        if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            const auto start = m_pos;
+            while (m_pos < m_text.size() &&
+                   (std::isalnum(static_cast<unsigned char>(m_text[m_pos])) ||
+                    m_text[m_pos] == '_')) {
+                ++m_pos;
+            }
+            t.type = token::kind::identifier;
+            t.text = std::string(m_text.substr(start, m_pos - start));
+            t.keyword = t.text;
+            for (auto& ch : t.keyword) {
+                ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+            }
+            return t;
+        }
+
+        if (c == '"' || c == '\'') return string_literal(c);
+
+        if (std::isdigit(static_cast<unsigned char>(c)) ||
+            (c == '-' && m_pos + 1 < m_text.size() &&
+             std::isdigit(static_cast<unsigned char>(m_text[m_pos + 1])))) {
+            return number();
+        }
+
+        t.type = token::kind::symbol;
+        for (std::string_view sym : {"<=", ">=", "<>", "!="}) {
+            if (m_text.substr(m_pos, 2) == sym) {
+                t.text = std::string(sym);
+                m_pos += 2;
+                return t;
+            }
+        }
+        if (std::string_view("=<>()[],").find(c) != std::string_view::npos) {
+            t.text = std::string(1, c);
+            ++m_pos;
+            return t;
+        }
+
+        t.type = token::kind::error;
+        return t;
+    }
+
+private:
+    token string_literal(char quote) {
+        token t;
+        t.type = token::kind::string;
+        ++m_pos;
+        while (m_pos < m_text.size() && m_text[m_pos] != quote) {
+            if (m_text[m_pos] == '\\') {
+                if (m_pos + 1 >= m_text.size()) break;
+                ++m_pos;
+            }
+            t.text += m_text[m_pos++];
+        }
+        if (m_pos >= m_text.size()) {
+            t.type = token::kind::error;
+            return t;
+        }
+        ++m_pos;  // closing quote
+        return t;
+    }
+
+    token number() {
+        token t;
+        const auto start = m_pos;
+        if (m_text[m_pos] == '-') ++m_pos;
+        bool is_real = false;
+        while (m_pos < m_text.size()) {
+            const char ch = m_text[m_pos];
+            if (std::isdigit(static_cast<unsigned char>(ch))) {
+                ++m_pos;
+            } else if (ch == '.' || ch == 'e' || ch == 'E') {
+                is_real = true;
+                ++m_pos;
+                if ((ch == 'e' || ch == 'E') && m_pos < m_text.size() &&
+                    (m_text[m_pos] == '+' || m_text[m_pos] == '-')) {
+                    ++m_pos;
+                }
+            } else {
+                break;
+            }
+        }
+
+        const auto literal = m_text.substr(start, m_pos - start);
+        const char* first = literal.data();
+        const char* last = literal.data() + literal.size();
+        if (is_real) {
+            auto [ptr, ec] = std::from_chars(first, last, t.real);
+            t.type = (ec == std::errc{} && ptr == last) ? token::kind::real : token::kind::error;
+        } else {
+            auto [ptr, ec] = std::from_chars(first, last, t.integer);
+            t.type = (ec == std::errc{} && ptr == last) ? token::kind::integer : token::kind::error;
+        }
+        return t;
+    }
+
+    std::string_view m_text;
+    std::size_t m_pos = 0;
+};
+
+class parser {
+public:
+    explicit parser(std::string_view text) : m_lexer(text) { advance(); }
+
+    std::optional<expression_node> parse() {
+        auto node = disjunction();
+        if (!node || m_current.type != token::kind::end) return std::nullopt;
+        return node;
+    }
+
+private:
+    void advance() { m_current = m_lexer.next(); }
+
+    bool at_keyword(std::string_view kw) const {
+        return m_current.type == token::kind::identifier && m_current.keyword == kw;
+    }
+
+    bool at_symbol(std::string_view sym) const {
+        return m_current.type == token::kind::symbol && m_current.text == sym;
+    }
+
+    bool accept_keyword(std::string_view kw) {
+        if (!at_keyword(kw)) return false;
+        advance();
+        return true;
+    }
+
+    bool accept_symbol(std::string_view sym) {
+        if (!at_symbol(sym)) return false;
+        advance();
+        return true;
+    }
+
+    static bool is_reserved(std::string_view kw) {
+        for (std::string_view r : {"and", "or", "not", "in", "one", "none", "all",
+                                   "of", "is", "null", "empty", "true", "false"}) {
+            if (kw == r) return true;
+        }
+        return false;
+    }
+
+    std::optional<expression_node> chain(expression_node::kind type, std::string_view kw) {
+        auto first = type == expression_node::kind::disjunction ? conjunction() : unary();
+        if (!first) return std::nullopt;
+        if (!at_keyword(kw)) return first;
+
+        expression_node node;
+        node.type = type;
+        auto append = [&](expression_node&& child) {
+            if (child.type == type) {
+                for (auto& grandchild : child.children) {
+                    node.children.push_back(std::move(grandchild));
+                }
+            } else {
+                node.children.push_back(std::move(child));
+            }
+        };
+        append(std::move(*first));
+        while (accept_keyword(kw)) {
+            auto next = type == expression_node::kind::disjunction ? conjunction() : unary();
+            if (!next) return std::nullopt;
+            append(std::move(*next));
+        }
+        return node;
+    }
+
+    std::optional<expression_node> disjunction() {
+        return chain(expression_node::kind::disjunction, "or");
+    }
+
+    std::optional<expression_node> conjunction() {
+        return chain(expression_node::kind::conjunction, "and");
+    }
+
+    std::optional<expression_node> unary() {
+        if (accept_keyword("not")) {
+            auto operand = unary();
+            if (!operand) return std::nullopt;
+            expression_node node;
+            node.type = expression_node::kind::negation;
+            node.children.push_back(std::move(*operand));
+            return node;
+        }
+        if (accept_symbol("(")) {
+            auto inner = disjunction();
+            if (!inner || !accept_symbol(")")) return std::nullopt;
+            return inner;
+        }
+        return predicate();
+    }
+
+    std::optional<expression_literal> literal() {
+        std::optional<expression_literal> value;
+        switch (m_current.type) {
+            case token::kind::string:  value = m_current.text; break;
+            case token::kind::integer: value = m_current.integer; break;
+            case token::kind::real:    value = m_current.real; break;
+            case token::kind::identifier:
+                if (m_current.keyword == "true") value = true;
+                else if (m_current.keyword == "false") value = false;
+                break;
+            default:
+                break;
+        }
+        if (value) advance();
+        return value;
+    }
+
+    bool literal_list(std::vector<expression_literal>& out) {
+        if (!accept_symbol("[")) return false;
+        if (accept_symbol("]")) return false;  // empty lists are left to the a-tree
+        do {
+            auto value = literal();
+            if (!value) return false;
+            out.push_back(std::move(*value));
+        } while (accept_symbol(","));
+        return accept_symbol("]");
+    }
+
+    std::optional<expression_node> predicate() {
+        if (m_current.type != token::kind::identifier || is_reserved(m_current.keyword)) {
+            return std::nullopt;
+        }
+
+        expression_node node;
+        node.type = expression_node::kind::predicate;
+        node.attribute = m_current.text;
+        advance();
+
+        static constexpr std::pair<std::string_view, predicate_op> comparisons[] = {
+            {"=", predicate_op::eq},  {"<>", predicate_op::ne}, {"!=", predicate_op::ne},
+            {"<", predicate_op::lt},  {"<=", predicate_op::le},
+            {">", predicate_op::gt},  {">=", predicate_op::ge},
+        };
+        for (const auto& [sym, op] : comparisons) {
+            if (accept_symbol(sym)) {
+                auto value = literal();
+                if (!value) return std::nullopt;
+                node.op = op;
+                node.values.push_back(std::move(*value));
+                return node;
+            }
+        }
+
+        auto list_op = [&](predicate_op op) -> std::optional<expression_node> {
+            node.op = op;
+            if (!literal_list(node.values)) return std::nullopt;
+            return std::move(node);
+        };
+
+        if (accept_keyword("in")) return list_op(predicate_op::in);
+        if (at_keyword("not")) {
+            advance();
+            if (!accept_keyword("in")) return std::nullopt;
+            return list_op(predicate_op::not_in);
+        }
+        if (accept_keyword("one")) {
+            if (!accept_keyword("of")) return std::nullopt;
+            return list_op(predicate_op::one_of);
+        }
+        if (accept_keyword("none")) {
+            if (!accept_keyword("of")) return std::nullopt;
+            return list_op(predicate_op::none_of);
+        }
+        if (accept_keyword("all")) {
+            if (!accept_keyword("of")) return std::nullopt;
+            return list_op(predicate_op::all_of);
+        }
+        if (accept_keyword("is")) {
+            const bool negated = accept_keyword("not");
+            if (accept_keyword("null")) {
+                node.op = negated ? predicate_op::is_not_null : predicate_op::is_null;
+                return node;
+            }
+            if (accept_keyword("empty")) {
+                node.op = negated ? predicate_op::is_not_empty : predicate_op::is_empty;
+                return node;
+            }
+            return std::nullopt;
+        }
+
+        node.op = predicate_op::truthy;
+        return node;
+    }
+
+    lexer m_lexer;
+    token m_current;
+};
+
+void append_literal(std::string& out, const expression_literal& value) {
+    if (auto b = std::get_if<bool>(&value)) {
+        out += *b ? "true" : "false";
+    } else if (auto i = std::get_if<int64_t>(&value)) {
+        out += std::to_string(*i);
+    } else if (auto d = std::get_if<double>(&value)) {
+        char buf[32];
+        auto [ptr, ec] = std::to_chars(buf, buf + sizeof(buf), *d);
+        std::string_view text(buf, ec == std::errc{} ? ptr - buf : 0);
+        out += text;
+        // Keep it lexing as a float.
+        if (text.find_first_of(".eE") == std::string_view::npos) out += ".0";
+    } else {
+        out += '"';
+        for (char c : std::get<std::string>(value)) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        out += '"';
+    }
+}
+
+std::string_view op_text(predicate_op op) {
+    switch (op) {
+        case predicate_op::truthy:       return "";
+        case predicate_op::eq:           return "=";
+        case predicate_op::ne:           return "<>";
+        case predicate_op::lt:           return "<";
+        case predicate_op::le:           return "<=";
+        case predicate_op::gt:           return ">";
+        case predicate_op::ge:           return ">=";
+        case predicate_op::in:           return "in";
+        case predicate_op::not_in:       return "not in";
+        case predicate_op::one_of:       return "one of";
+        case predicate_op::none_of:      return "none of";
+        case predicate_op::all_of:       return "all of";
+        case predicate_op::is_null:      return "is null";
+        case predicate_op::is_not_null:  return "is not null";
+        case predicate_op::is_empty:     return "is empty";
+        case predicate_op::is_not_empty: return "is not empty";
+    }
+    return "";
+}
+
+bool is_list_op(predicate_op op) {
+    return op == predicate_op::in || op == predicate_op::not_in ||
+           op == predicate_op::one_of || op == predicate_op::none_of ||
+           op == predicate_op::all_of;
+}
+
+void format_into(std::string& out, const expression_node& node) {
+    auto operand = [&](const expression_node& child) {
+        if (child.type == expression_node::kind::predicate ||
+            child.type == expression_node::kind::negation) {
+            format_into(out, child);
+        } else {
+            out += '(';
+            format_into(out, child);
+            out += ')';
+        }
+    };
+
+    switch (node.type) {
+        case expression_node::kind::conjunction:
+        case expression_node::kind::disjunction: {
+            const std::string_view sep =
+                node.type == expression_node::kind::conjunction ? " and " : " or ";
+            for (std::size_t k = 0; k < node.children.size(); ++k) {
+                if (k) out += sep;
+                operand(node.children[k]);
+            }
+            return;
+        }
+        case expression_node::kind::negation:
+            out += "not ";
+            operand(node.children.front());
+            return;
+        case expression_node::kind::predicate:
+            break;
+    }
+
+    out += node.attribute;
+    if (node.op == predicate_op::truthy) return;
+    out += ' ';
+    out += op_text(node.op);
+    if (is_list_op(node.op)) {
+        out += " [";
+        for (std::size_t k = 0; k < node.values.size(); ++k) {
+            if (k) out += ", ";
+            append_literal(out, node.values[k]);
+        }
+        out += ']';
+    } else if (!node.values.empty()) {
+        out += ' ';
+        append_literal(out, node.values.front());
+    }
+}
+
+std::string literal_text(const expression_literal& value) {
+    std::string out;
+    append_literal(out, value);
+    return out;
+}
+
+} // anonymous namespace
+
+std::optional<expression_node> parse_expression(std::string_view text) {
+    return parser(text).parse();
+}
+
+void validate_expression(const expression_node& node, const attribute_schema& schema) {
+    if (node.type != expression_node::kind::predicate) {
+        for (const auto& child : node.children) validate_expression(child, schema);
+        return;
+    }
+
+    auto slot = schema.find(node.attribute);
+    if (!slot) throw expression_error("unknown attribute '" + node.attribute + "'");
+
+    const bool is_list = slot->type == attribute_type::string_list ||
+                         slot->type == attribute_type::integer_list;
+    auto fail = [&](std::string_view what) {
+        throw expression_error("attribute '" + node.attribute + "': " + std::string(what));
+    };
+
+    switch (node.op) {
+        case predicate_op::truthy:
+            if (slot->type != attribute_type::boolean) fail("only boolean attributes can stand alone");
+            break;
+        case predicate_op::one_of:
+        case predicate_op::none_of:
+        case predicate_op::all_of:
+        case predicate_op::is_empty:
+        case predicate_op::is_not_empty:
+            if (!is_list) fail("operator requires a list attribute");
+            break;
+        case predicate_op::is_null:
+        case predicate_op::is_not_null:
+            break;
+        default:
+            if (is_list) fail("operator requires a scalar attribute");
+            break;
+    }
+
+    for (const auto& value : node.values) {
+        bool ok = false;
+        switch (slot->type) {
+            case attribute_type::boolean:
+                ok = std::holds_alternative<bool>(value);
+                break;
+            case attribute_type::integer:
+            case attribute_type::float_val:
+            case attribute_type::integer_list:
+                ok = std::holds_alternative<int64_t>(value) || std::holds_alternative<double>(value);
+                break;
+            case attribute_type::string:
+            case attribute_type::string_list:
+                ok = std::holds_alternative<std::string>(value);
+                break;
+        }
+        if (!ok) fail("literal " + literal_text(value) + " does not match the attribute type");
+    }
+}
+
+void canonicalize(expression_node& node, const attribute_schema& schema) {
+    switch (node.type) {
+        case expression_node::kind::predicate: {
+            auto slot = schema.find(node.attribute);
+            if (slot && slot->type == attribute_type::float_val) {
+                for (auto& v : node.values) {
+                    if (auto i = std::get_if<int64_t>(&v)) v = static_cast<double>(*i);
+                }
+            }
+            if (is_list_op(node.op)) {
+                std::vector<std::pair<std::string, expression_literal>> keyed;
+                for (auto& v : node.values) keyed.emplace_back(literal_text(v), std::move(v));
+                std::sort(keyed.begin(), keyed.end(),
+                          [](const auto& a, const auto& b) { return a.first < b.first; });
+                keyed.erase(std::unique(keyed.begin(), keyed.end(),
+                                        [](const auto& a, const auto& b) { return a.first == b.first; }),
+                            keyed.end());
+                node.values.clear();
+                for (auto& [text, v] : keyed) node.values.push_back(std::move(v));
+            }
+            return;
+        }
+
+        case expression_node::kind::negation: {
+            canonicalize(node.children.front(), schema);
+            auto& inner = node.children.front();
+            if (inner.type == expression_node::kind::negation) {
+                // not not x == x, also under three-valued logic.
+                expression_node collapsed = std::move(inner.children.front());
+                node = std::move(collapsed);
+            }
+            return;
+        }
+
+        case expression_node::kind::conjunction:
+        case expression_node::kind::disjunction:
+            break;
+    }
+
+    std::vector<std::pair<std::string, expression_node>> keyed;
+    for (auto& child : node.children) {
+        canonicalize(child, schema);
+        // Collapsing a child may expose a chain of the same kind.
+        if (child.type == node.type) {
+            for (auto& grandchild : child.children) {
+                keyed.emplace_back(format_expression(grandchild), std::move(grandchild));
+            }
+        } else {
+            keyed.emplace_back(format_expression(child), std::move(child));
+        }
+    }
+    std::sort(keyed.begin(), keyed.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    keyed.erase(std::unique(keyed.begin(), keyed.end(),
+                            [](const auto& a, const auto& b) { return a.first == b.first; }),
+                keyed.end());
+
+    if (keyed.size() == 1) {
+        expression_node only = std::move(keyed.front().second);
+        node = std::move(only);
+        return;
+    }
+    node.children.clear();
+    for (auto& [text, child] : keyed) node.children.push_back(std::move(child));
+}
+
+std::string format_expression(const expression_node& node) {
+    std::string out;
+    format_into(out, node);
+    return out;
+}
+
+} // namespace sidecar
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "attribute_schema.hpp"
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace sidecar {
+
+// An expression that references an unknown attribute or compares an
+// attribute with a literal of an incompatible type.
+class expression_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Literal operand of a predicate: true/false, integer, float or string.
+using expression_literal = std::variant<bool, int64_t, double, std::string>;
+
+enum class predicate_op {
+    truthy,       // bare boolean attribute, e.g. `active`
+    eq, ne, lt, le, gt, ge,
+    in, not_in,
+    one_of, none_of, all_of,
+    is_null, is_not_null,
+    is_empty, is_not_empty
+};
+
+// Syntax tree of an a-tree boolean expression. Nested AND/OR chains are
+// flattened, so a conjunction never has a conjunction as a direct child.
+struct expression_node {
+    enum class kind { conjunction, disjunction, negation, predicate };
+
+    kind type = kind::predicate;
+
+    // conjunction/disjunction: two or more operands; negation: exactly one.
+    std::vector<expression_node> children;
+
+    // predicate only
+    std::string attribute;
+    predicate_op op = predicate_op::truthy;
+    std::vector<expression_literal> values;
+};
+
+// Parse an a-tree expression. Keywords are case-insensitive. Returns nullopt
+// for anything this parser does not model; such expressions are still valid
+// input for the a-tree and must be treated as opaque by callers. The a-tree
+// remains the authority on validity.
+std::optional<expression_node> parse_expression(std::string_view text);
+
+// Check every predicate of `node` against the schema and throw
+// expression_error on an unknown attribute, a literal whose kind (boolean,
+// number, string) does not fit the attribute, or an operator that needs a
+// list attribute used on a scalar one (and vice versa). Anything subtler is
+// left to the a-tree.
+void validate_expression(const expression_node& node, const attribute_schema& schema);
+
+// Rewrite `node` into canonical form: operands of AND/OR and list literals
+// are sorted and deduplicated, nested chains flattened, single-operand chains
+// and double negations collapsed, and integer literals compared with float
+// attributes widened to floats. Logically identical expressions that differ
+// only in operand order, repetition, spacing or keyword case end up equal.
+void canonicalize(expression_node& node, const attribute_schema& schema);
+
+// Print `node` as a-tree expression text with lower-case keywords and
+// double-quoted strings. For canonicalized nodes this is the canonical text.
+std::string format_expression(const expression_node& node);
+
+} // namespace sidecar
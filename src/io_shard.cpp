@@ -0,0 +1,95 @@
+#include "io_shard.hpp"
+#include "cpu_affinity.hpp"
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/use_awaitable.hpp>
+#include <chrono>
+
+namespace sidecar {
+
+io_shard::io_shard(std::string role, std::size_t index,
+                   std::shared_ptr<spdlog::logger> log)
+    : m_role(std::move(role)), m_index(index), m_log(std::move(log)),
+      m_work(asio::make_work_guard(m_ioc))
+{}
+
+io_shard::~io_shard() { stop(); }
+
+void io_shard::start(const nats_asio::connect_config& nats_cfg,
+                     const std::optional<nats_asio::ssl_config>& ssl,
+                     std::vector<int> cpus) {
+    auto log = m_log;
+    const auto name = m_role + " shard " + std::to_string(m_index);
+    auto on_connected = [log, name](nats_asio::iconnection& /*c*/) -> asio::awaitable<void> {
+        log->info("{} connected to NATS", name);
+        co_return;
+    };
+    auto on_disconnected = [log, name](nats_asio::iconnection& /*c*/) -> asio::awaitable<void> {
+        log->warn("{} disconnected from NATS", name);
+        co_return;
+    };
+    auto on_error = [log, name](nats_asio::iconnection& /*c*/, std::string_view err) -> asio::awaitable<void> {
+        log->error("{} connection error: {}", name, err);
+        co_return;
+    };
+
+    m_conn = nats_asio::create_connection(m_ioc, on_connected, on_disconnected, on_error, ssl);
+    m_conn->start(nats_cfg);
+    m_thread = std::thread([this, name, cpus = std::move(cpus)] {
+        if (!cpus.empty() && !pin_current_thread(cpus)) {
+            m_log->warn("{}: failed to set CPU affinity", name);
+        }
+        m_ioc.run();
+    });
+}
+
+asio::awaitable<bool> io_shard::subscribe(std::string subject,
+                                          nats_asio::on_message_cb cb,
+                                          nats_asio::subscribe_options opts) {
+    co_return co_await asio::co_spawn(
+        m_ioc,
+        [this, subject = std::move(subject), cb = std::move(cb),
+         opts = std::move(opts)]() mutable -> asio::awaitable<bool> {
+            asio::steady_timer timer(m_ioc);
+            while (!m_conn->is_connected()) {
+                if (m_stopping.load(std::memory_order_acquire)) co_return false;
+                timer.expires_after(std::chrono::milliseconds(100));
+                co_await timer.async_wait(asio::use_awaitable);
+            }
+
+            auto [sub, status] = co_await m_conn->subscribe(subject, std::move(cb), opts);
+            if (status.failed()) {
+                m_log->error("{} shard {} failed to subscribe to '{}': {}",
+                             m_role, m_index, subject, status.error());
+                co_return false;
+            }
+            m_subs.push_back(std::move(sub));
+            co_return true;
+        },
+        asio::use_awaitable);
+}
+
+void io_shard::stop() {
+    if (m_stopping.exchange(true, std::memory_order_acq_rel)) return;
+    if (!m_thread.joinable()) return;
+
+    asio::co_spawn(
+        m_ioc,
+        [this]() -> asio::awaitable<void> {
+            for (auto& sub : m_subs) sub->cancel();
+            m_subs.clear();
+            if (m_conn->is_connected()) {
+                auto status = co_await m_conn->drain(std::chrono::seconds(5));
+                if (status.failed()) {
+                    m_log->warn("{} shard {} drain failed: {}", m_role, m_index, status.error());
+                }
+            }
+            m_work.reset();
+            m_ioc.stop();
+        },
+        asio::detached);
+    m_thread.join();
+}
+
+} // namespace sidecar
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <nats_asio/nats_asio.hpp>
+#include <asio/awaitable.hpp>
+#include <asio/executor_work_guard.hpp>
+#include <asio/io_context.hpp>
+#include <spdlog/spdlog.h>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sidecar {
+
+// An extra NATS connection driven by its own io_context thread. Ingest
+// shards read the input subject and output shards write publications, so
+// that traffic runs beside the main I/O thread instead of on it; control
+// traffic and KV stay on the main connection. Handlers and coroutines
+// spawned on context() run on the shard's thread.
+class io_shard {
+public:
+    // `role` names the shard in logs, e.g. "Ingest" or "Output".
+    io_shard(std::string role, std::size_t index, std::shared_ptr<spdlog::logger> log);
+    ~io_shard();
+
+    // Create the connection and start the shard's thread, pinned to `cpus`
+    // unless empty.
+    void start(const nats_asio::connect_config& nats_cfg,
+               const std::optional<nats_asio::ssl_config>& ssl,
+               std::vector<int> cpus = {});
+
+    // Subscribe on this shard's connection once it is up. May be awaited
+    // from any executor; the subscription itself runs on the shard thread.
+    asio::awaitable<bool> subscribe(std::string subject,
+                                    nats_asio::on_message_cb cb,
+                                    nats_asio::subscribe_options opts);
+
+    // Drain the connection, which flushes the unsubscribes, and join the
+    // thread. Safe to call more than once.
+    void stop();
+
+    std::size_t index() const { return m_index; }
+    asio::io_context& context() { return m_ioc; }
+    const nats_asio::iconnection_sptr& connection() const { return m_conn; }
+
+private:
+    std::string m_role;
+    std::size_t m_index;
+    std::shared_ptr<spdlog::logger> m_log;
+    asio::io_context m_ioc{1};
+    asio::executor_work_guard<asio::io_context::executor_type> m_work;
+    nats_asio::iconnection_sptr m_conn;
+    std::thread m_thread;
+    std::atomic<bool> m_stopping{false};
+
+    // Only touched on the shard thread.
+    std::vector<nats_asio::isubscription_sptr> m_subs;
+};
+
+} // namespace sidecar
@@ -0,0 +1,107 @@
+#include "kv_bucket.hpp"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace sidecar {
+
+asio::awaitable<bool> ensure_kv_bucket(const nats_asio::iconnection_sptr& conn,
+                                       const std::string& bucket,
+                                       std::chrono::seconds max_age,
+                                       spdlog::logger& log,
+                                       std::string_view owner) {
+    using nlohmann::json;
+    constexpr auto timeout = std::chrono::seconds(5);
+
+    const std::string stream_name = "KV_" + bucket;
+    const std::string empty = "{}";
+    auto [info_reply, info_status] = co_await conn->request(
+        "$JS.API.STREAM.INFO." + stream_name,
+        std::span<const char>(empty.data(), empty.size()), timeout);
+    if (info_status.failed()) {
+        log.error("{}: failed to inspect KV bucket '{}': {}", owner, bucket, info_status.error());
+        co_return false;
+    }
+
+    bool missing = false;
+    json info;
+    try {
+        info = json::parse(std::string_view(info_reply.payload.data(), info_reply.payload.size()));
+        missing = info.contains("error") && info["error"].value("code", 0) == 404;
+    } catch (const std::exception& e) {
+        log.error("{}: invalid stream info response: {}", owner, e.what());
+        co_return false;
+    }
+
+    const uint64_t expected_max_age = static_cast<uint64_t>(max_age.count()) * 1'000'000'000ULL;
+    const std::string expected_subject = "$KV." + bucket + ".>";
+
+    if (!missing) {
+        if (info.contains("error") || !info.contains("config")) {
+            auto description = info.contains("error")
+                ? info["error"].value("description", "stream info failed")
+                : std::string("missing stream config");
+            log.error("{}: failed to inspect bucket '{}': {}", owner, bucket, description);
+            co_return false;
+        }
+
+        const auto& cfg = info["config"];
+        const auto existing_max_age = cfg.value("max_age", uint64_t{0});
+        const auto history = cfg.value("max_msgs_per_subject", int64_t{0});
+        const auto subjects = cfg.value("subjects", std::vector<std::string>{});
+        const bool subject_ok = std::find(subjects.begin(), subjects.end(),
+                                          expected_subject) != subjects.end();
+        if (existing_max_age != expected_max_age || history != 1 || !subject_ok) {
+            log.error("{}: bucket '{}' configuration mismatch "
+                      "(expected max_age={}s, history=1, subject='{}')",
+                      owner, bucket, max_age.count(), expected_subject);
+            co_return false;
+        }
+
+        log.info("{}: validated KV bucket '{}' (max_age={}s)", owner, bucket, max_age.count());
+        co_return true;
+    }
+
+    const std::string create_payload = json{
+        {"name", stream_name},
+        {"subjects", {expected_subject}},
+        {"retention", "limits"},
+        {"storage", "file"},
+        {"max_msgs", -1},
+        {"max_bytes", -1},
+        {"max_age", expected_max_age},
+        {"max_msgs_per_subject", 1},
+        {"max_msg_size", -1},
+        {"discard", "old"},
+        {"num_replicas", 1},
+        {"allow_rollup_hdrs", true},
+        {"deny_delete", true},
+        {"allow_direct", true}
+    }.dump();
+    auto [create_reply, create_status] = co_await conn->request(
+        "$JS.API.STREAM.CREATE." + stream_name,
+        std::span<const char>(create_payload.data(), create_payload.size()), timeout);
+    if (create_status.failed()) {
+        log.error("{}: failed to create KV bucket '{}': {}", owner, bucket, create_status.error());
+        co_return false;
+    }
+
+    try {
+        auto response = json::parse(
+            std::string_view(create_reply.payload.data(), create_reply.payload.size()));
+        if (response.contains("error")) {
+            log.error("{}: failed to create KV bucket '{}': {}", owner, bucket,
+                      response["error"].value("description", "unknown error"));
+            co_return false;
+        }
+    } catch (const std::exception& e) {
+        log.error("{}: invalid bucket creation response: {}", owner, e.what());
+        co_return false;
+    }
+
+    log.info("{}: created KV bucket '{}' (max_age={}s)", owner, bucket, max_age.count());
+    co_return true;
+}
+
+} // namespace sidecar
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <nats_asio/nats_asio.hpp>
+#include <asio/awaitable.hpp>
+#include <spdlog/spdlog.h>
+#include <chrono>
+#include <string>
+#include <string_view>
+
+namespace sidecar {
+
+// Make sure JetStream KV bucket `bucket` exists, keeping only the latest
+// value of each key for `max_age` (zero: forever). A missing bucket is
+// created; an existing one must already be configured that way, or this
+// fails rather than run against a bucket with different retention. `owner`
+// prefixes the log lines.
+asio::awaitable<bool> ensure_kv_bucket(const nats_asio::iconnection_sptr& conn,
+                                       const std::string& bucket,
+                                       std::chrono::seconds max_age,
+                                       spdlog::logger& log,
+                                       std::string_view owner);
+
+} // namespace sidecar
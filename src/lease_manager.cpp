@@ -1,5 +1,9 @@
 #include "lease_manager.hpp"
+#include "kv_bucket.hpp"
+#include "shard_membership.hpp"
+#include <algorithm>
 #include <charconv>
+#include <unordered_set>
 #include <asio/co_spawn.hpp>
 #include <asio/detached.hpp>
 #include <asio/redirect_error.hpp>
@@ -23,14 +27,6 @@ lease_manager::lease_manager(asio::io_context& ioc,
 
 lease_manager::~lease_manager() { stop(); }
 
-asio::awaitable<std::pair<nats_asio::message, nats_asio::status>>
-lease_manager::request_plain(const std::string& subject,
-                             const std::string& payload,
-                             std::chrono::milliseconds timeout) {
-    co_return co_await m_conn->request(
-        subject, std::span<const char>(payload.data(), payload.size()), timeout);
-}
-
 asio::awaitable<std::pair<nats_asio::kv_entry, nats_asio::status>>
 lease_manager::get_lease(const std::string& key) {
     co_return co_await m_conn->kv_get(m_bucket, key, std::chrono::seconds(5));
@@ -64,105 +60,8 @@ bool lease_manager::parse_lease_key(const std::string& key,
 }
 
 asio::awaitable<bool> lease_manager::ensure_bucket() {
-    using nlohmann::json;
-    constexpr auto timeout = std::chrono::seconds(5);
-
-    const std::string stream_name = "KV_" + m_bucket;
-    const std::string info_subject = "$JS.API.STREAM.INFO." + stream_name;
-    const std::string request_body = "{}";
-    auto [info_reply, info_status] = co_await request_plain(
-        info_subject, request_body, timeout);
-
-    bool missing = false;
-    json info;
-    if (info_status.failed()) {
-        m_log->error("lease_manager: failed to inspect KV bucket '{}': {}",
-                     m_bucket, info_status.error());
-        co_return false;
-    }
-
-    try {
-        info = json::parse(std::string_view(info_reply.payload.data(), info_reply.payload.size()));
-        missing = info.contains("error") && info["error"].value("code", 0) == 404;
-    } catch (const std::exception& e) {
-        m_log->error("lease_manager: invalid stream info response: {}", e.what());
-        co_return false;
-    }
-
-    const uint64_t expected_max_age = static_cast<uint64_t>(m_ttl_seconds) * 1'000'000'000ULL;
-    const std::string expected_subject = "$KV." + m_bucket + ".>";
-
-    if (!missing) {
-        if (info.contains("error") || !info.contains("config")) {
-            auto description = info.contains("error")
-                ? info["error"].value("description", "stream info failed")
-                : std::string("missing stream config");
-            m_log->error("lease_manager: failed to inspect bucket '{}': {}",
-                         m_bucket, description);
-            co_return false;
-        }
-
-        const auto& cfg = info["config"];
-        const auto max_age = cfg.value("max_age", uint64_t{0});
-        const auto history = cfg.value("max_msgs_per_subject", int64_t{0});
-        const auto subjects = cfg.value("subjects", std::vector<std::string>{});
-        const bool subject_ok = std::find(subjects.begin(), subjects.end(),
-                                          expected_subject) != subjects.end();
-        if (max_age != expected_max_age || history != 1 || !subject_ok) {
-            m_log->error(
-                "lease_manager: bucket '{}' configuration mismatch "
-                "(expected ttl={}s, history=1, subject='{}')",
-                m_bucket, m_ttl_seconds, expected_subject);
-            co_return false;
-        }
-
-        m_log->info("lease_manager: validated KV bucket '{}' (TTL={}s)",
-                    m_bucket, m_ttl_seconds);
-        co_return true;
-    }
-
-    json stream_config = {
-        {"name", stream_name},
-        {"subjects", {expected_subject}},
-        {"retention", "limits"},
-        {"storage", "file"},
-        {"max_msgs", -1},
-        {"max_bytes", -1},
-        {"max_age", expected_max_age},
-        {"max_msgs_per_subject", 1},
-        {"max_msg_size", -1},
-        {"discard", "old"},
-        {"num_replicas", 1},
-        {"allow_rollup_hdrs", true},
-        {"deny_delete", true},
-        {"allow_direct", true}
-    };
-    const std::string create_payload = stream_config.dump();
-    auto [create_reply, create_status] = co_await request_plain(
-        "$JS.API.STREAM.CREATE." + stream_name, create_payload, timeout);
-    if (create_status.failed()) {
-        m_log->error("lease_manager: failed to create KV bucket '{}': {}",
-                     m_bucket, create_status.error());
-        co_return false;
-    }
-
-    try {
-        auto response = json::parse(
-            std::string_view(create_reply.payload.data(), create_reply.payload.size()));
-        if (response.contains("error")) {
-            m_log->error("lease_manager: failed to create KV bucket '{}': {}",
-                         m_bucket,
-                         response["error"].value("description", "unknown error"));
-            co_return false;
-        }
-    } catch (const std::exception& e) {
-        m_log->error("lease_manager: invalid bucket creation response: {}", e.what());
-        co_return false;
-    }
-
-    m_log->info("lease_manager: created KV bucket '{}' (TTL={}s)",
-                m_bucket, m_ttl_seconds);
-    co_return true;
+    co_return co_await ensure_kv_bucket(m_conn, m_bucket, std::chrono::seconds(m_ttl_seconds),
+                                        *m_log, "lease_manager");
 }
 
 asio::awaitable<bool> lease_manager::persist_lease(
@@ -189,6 +88,7 @@ asio::awaitable<bool> lease_manager::persist_lease(
         co_return false;
     }
     m_log->debug("lease_manager: persisted lease '{}' at revision {}", key, revision);
+    m_revision = std::max(m_revision, revision);
     m_expirations[key] = std::chrono::system_clock::now() +
                          std::chrono::seconds(m_ttl_seconds);
     co_return true;
@@ -209,6 +109,7 @@ asio::awaitable<bool> lease_manager::delete_lease(
         co_return false;
     }
     m_log->debug("lease_manager: deleted lease '{}' at revision {}", key, revision);
+    m_revision = std::max(m_revision, revision);
     m_expirations.erase(key);
     co_return true;
 }
@@ -220,8 +121,18 @@ asio::awaitable<bool> lease_manager::restore_leases() {
         co_return false;
     }
 
+    // Leases already loaded from a local or peer snapshot only need their expiry
+    // tracked; the KV record is fetched for the rest.
+    std::unordered_set<std::string> held;
+    for (const auto& [subscription_id, client_id] : m_sub_mgr.leases()) {
+        held.insert(make_lease_key(subscription_id, client_id));
+    }
+
     std::size_t restored = 0;
+    std::size_t confirmed = 0;
     for (const auto& key : keys) {
+        if (shard_membership::is_member_key(key)) continue;
+
         uint64_t key_subscription_id = 0;
         std::string key_client_id;
         if (!parse_lease_key(key, key_subscription_id, key_client_id)) {
@@ -229,6 +140,13 @@ asio::awaitable<bool> lease_manager::restore_leases() {
             continue;
         }
 
+        if (held.erase(key)) {
+            m_expirations[key] = std::chrono::system_clock::now() +
+                                 std::chrono::seconds(m_ttl_seconds);
+            ++confirmed;
+            continue;
+        }
+
         auto [entry, get_status] = co_await get_lease(key);
         if (get_status.failed() || entry.op != nats_asio::kv_entry::operation::put) {
             continue; // It may have expired between the key scan and this get.
@@ -252,13 +170,24 @@ asio::awaitable<bool> lease_manager::restore_leases() {
             const auto created = entry.created == std::chrono::system_clock::time_point{}
                 ? std::chrono::system_clock::now() : entry.created;
             m_expirations[key] = created + std::chrono::seconds(m_ttl_seconds);
+            m_revision = std::max(m_revision, entry.revision);
             ++restored;
         } catch (const std::exception& e) {
             m_log->warn("lease_manager: ignoring invalid lease '{}': {}", key, e.what());
         }
     }
 
-    m_log->info("lease_manager: restored {} active lease(s)", restored);
+    // Snapshot leases with no KV key expired while the sidecar was down.
+    for (const auto& key : held) {
+        uint64_t subscription_id = 0;
+        std::string client_id;
+        if (parse_lease_key(key, subscription_id, client_id)) {
+            m_sub_mgr.remove_lease(subscription_id, client_id);
+        }
+    }
+
+    m_log->info("lease_manager: restored {} active lease(s), confirmed {}, dropped {} stale",
+                restored, confirmed, held.size());
     co_return true;
 }
 
@@ -288,6 +217,7 @@ asio::awaitable<void> lease_manager::cleanup_loop() {
                 const auto created = entry.created == std::chrono::system_clock::time_point{}
                     ? std::chrono::system_clock::now() : entry.created;
                 m_expirations[key] = created + std::chrono::seconds(m_ttl_seconds);
+                m_revision = std::max(m_revision, entry.revision);
                 continue;
             }
             if (status.code() != nats_asio::error_code::key_not_found) {
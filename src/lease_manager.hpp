@@ -46,6 +46,9 @@ public:
 
     void stop();
 
+    // Highest lease bucket revision this instance has written or read.
+    uint64_t revision() const { return m_revision; }
+
     // Build a lease key from subscription ID and client ID
     static std::string make_lease_key(uint64_t subscription_id, const std::string& client_id);
 
@@ -59,9 +62,6 @@ private:
     asio::awaitable<bool> ensure_bucket();
     asio::awaitable<bool> restore_leases();
     asio::awaitable<void> cleanup_loop();
-    asio::awaitable<std::pair<nats_asio::message, nats_asio::status>>
-    request_plain(const std::string& subject, const std::string& payload,
-                  std::chrono::milliseconds timeout);
     asio::awaitable<std::pair<nats_asio::kv_entry, nats_asio::status>>
     get_lease(const std::string& key);
     asio::awaitable<std::pair<std::vector<std::string>, nats_asio::status>>
@@ -76,6 +76,7 @@ private:
     std::shared_ptr<spdlog::logger> m_log;
     std::unique_ptr<asio::steady_timer> m_cleanup_timer;
     std::unordered_map<std::string, std::chrono::system_clock::time_point> m_expirations;
+    uint64_t m_revision = 0;
     std::atomic<bool> m_stopping{false};
 };
 
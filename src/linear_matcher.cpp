@@ -0,0 +1,265 @@
+#include "linear_matcher.hpp"
+#include <algorithm>
+
+namespace sidecar {
+
+namespace {
+
+template <typename T>
+bool compare(predicate_op op, T lhs, T rhs) {
+    switch (op) {
+        case predicate_op::eq: return lhs == rhs;
+        case predicate_op::lt: return lhs < rhs;
+        case predicate_op::le: return lhs <= rhs;
+        case predicate_op::gt: return lhs > rhs;
+        case predicate_op::ge: return lhs >= rhs;
+        default:               return false;
+    }
+}
+
+bool is_comparison(predicate_op op) {
+    return op == predicate_op::eq || op == predicate_op::lt || op == predicate_op::le ||
+           op == predicate_op::gt || op == predicate_op::ge;
+}
+
+template <typename T>
+bool all_hold(const std::vector<expression_literal>& values) {
+    return std::all_of(values.begin(), values.end(),
+                       [](const auto& v) { return std::holds_alternative<T>(v); });
+}
+
+} // anonymous namespace
+
+bool linear_matcher::add(uint64_t subscription_id, const expression_node& node,
+                         const attribute_schema& schema) {
+    const auto code_size = m_code.size();
+    const auto children_size = m_children.size();
+    const auto integers_size = m_integers.size();
+    const auto strings_size = m_strings.size();
+
+    uint32_t root = 0;
+    if (!compile(node, schema, root)) {
+        m_code.resize(code_size);
+        m_children.resize(children_size);
+        m_integers.resize(integers_size);
+        m_strings.resize(strings_size);
+        return false;
+    }
+    m_programs.push_back(program{subscription_id, root});
+    return true;
+}
+
+bool linear_matcher::compile(const expression_node& node, const attribute_schema& schema,
+                             uint32_t& pc) {
+    instruction ins;
+    switch (node.type) {
+        case expression_node::kind::negation:
+            return false;
+
+        case expression_node::kind::predicate:
+            if (!compile_predicate(node, schema, ins)) return false;
+            break;
+
+        case expression_node::kind::conjunction:
+        case expression_node::kind::disjunction: {
+            // Children are emitted first, so every program is in post-order
+            // and the root is its last instruction.
+            std::vector<uint32_t> children;
+            children.reserve(node.children.size());
+            for (const auto& child : node.children) {
+                uint32_t child_pc = 0;
+                if (!compile(child, schema, child_pc)) return false;
+                children.push_back(child_pc);
+            }
+            ins.code = node.type == expression_node::kind::conjunction ? opcode::all : opcode::any;
+            ins.first = static_cast<uint32_t>(m_children.size());
+            ins.count = static_cast<uint32_t>(children.size());
+            m_children.insert(m_children.end(), children.begin(), children.end());
+            break;
+        }
+    }
+
+    pc = static_cast<uint32_t>(m_code.size());
+    m_code.push_back(ins);
+    return true;
+}
+
+bool linear_matcher::compile_predicate(const expression_node& node,
+                                       const attribute_schema& schema, instruction& ins) {
+    auto slot = schema.find(node.attribute);
+    if (!slot) return false;
+    ins.slot = static_cast<uint32_t>(slot->index);
+    ins.op = node.op;
+
+    auto add_strings = [&] {
+        ins.first = static_cast<uint32_t>(m_strings.size());
+        ins.count = static_cast<uint32_t>(node.values.size());
+        for (const auto& v : node.values) m_strings.push_back(std::get<std::string>(v));
+    };
+    auto add_integers = [&] {
+        ins.first = static_cast<uint32_t>(m_integers.size());
+        ins.count = static_cast<uint32_t>(node.values.size());
+        for (const auto& v : node.values) m_integers.push_back(std::get<int64_t>(v));
+    };
+    const bool single = node.values.size() == 1;
+
+    switch (slot->type) {
+        case attribute_type::boolean:
+            ins.code = opcode::boolean_eq;
+            if (node.op == predicate_op::truthy) {
+                ins.boolean = true;
+                return true;
+            }
+            if (node.op != predicate_op::eq || !single || !all_hold<bool>(node.values)) return false;
+            ins.boolean = std::get<bool>(node.values.front());
+            return true;
+
+        case attribute_type::integer:
+            if (!all_hold<int64_t>(node.values)) return false;
+            if (is_comparison(node.op) && single) {
+                ins.code = opcode::integer_cmp;
+                ins.integer = std::get<int64_t>(node.values.front());
+                return true;
+            }
+            if (node.op != predicate_op::in) return false;
+            ins.code = opcode::integer_in;
+            add_integers();
+            return true;
+
+        case attribute_type::float_val: {
+            if (!is_comparison(node.op) || !single) return false;
+            const auto& v = node.values.front();
+            if (auto d = std::get_if<double>(&v)) {
+                ins.real = *d;
+            } else if (auto i = std::get_if<int64_t>(&v)) {
+                ins.real = static_cast<double>(*i);
+            } else {
+                return false;
+            }
+            ins.code = opcode::float_cmp;
+            return true;
+        }
+
+        case attribute_type::string:
+            if (!all_hold<std::string>(node.values)) return false;
+            if (node.op == predicate_op::eq && single) {
+                ins.code = opcode::string_eq;
+            } else if (node.op == predicate_op::in) {
+                ins.code = opcode::string_in;
+            } else {
+                return false;
+            }
+            add_strings();
+            return true;
+
+        case attribute_type::string_list:
+            if (!all_hold<std::string>(node.values)) return false;
+            if (node.op == predicate_op::one_of) {
+                ins.code = opcode::string_list_any;
+            } else if (node.op == predicate_op::all_of) {
+                ins.code = opcode::string_list_all;
+            } else {
+                return false;
+            }
+            add_strings();
+            return true;
+
+        case attribute_type::integer_list:
+            if (!all_hold<int64_t>(node.values)) return false;
+            if (node.op == predicate_op::one_of) {
+                ins.code = opcode::integer_list_any;
+            } else if (node.op == predicate_op::all_of) {
+                ins.code = opcode::integer_list_all;
+            } else {
+                return false;
+            }
+            add_integers();
+            return true;
+    }
+    return false;
+}
+
+bool linear_matcher::contains_string(const instruction& ins, std::string_view value) const {
+    for (uint32_t k = 0; k < ins.count; ++k) {
+        if (m_strings[ins.first + k] == value) return true;
+    }
+    return false;
+}
+
+bool linear_matcher::contains_integer(const instruction& ins, int64_t value) const {
+    for (uint32_t k = 0; k < ins.count; ++k) {
+        if (m_integers[ins.first + k] == value) return true;
+    }
+    return false;
+}
+
+bool linear_matcher::eval(uint32_t pc, const decoded_event& event) const {
+    const auto& ins = m_code[pc];
+    switch (ins.code) {
+        case opcode::all:
+            for (uint32_t k = 0; k < ins.count; ++k) {
+                if (!eval(m_children[ins.first + k], event)) return false;
+            }
+            return true;
+
+        case opcode::any:
+            for (uint32_t k = 0; k < ins.count; ++k) {
+                if (eval(m_children[ins.first + k], event)) return true;
+            }
+            return false;
+
+        default:
+            break;
+    }
+
+    if (!event.has_value(ins.slot)) return false;
+
+    switch (ins.code) {
+        case opcode::boolean_eq:  return event.boolean(ins.slot) == ins.boolean;
+        case opcode::integer_cmp: return compare(ins.op, event.integer(ins.slot), ins.integer);
+        case opcode::float_cmp:   return compare(ins.op, event.real(ins.slot), ins.real);
+        case opcode::integer_in:  return contains_integer(ins, event.integer(ins.slot));
+        case opcode::string_eq:   return event.string(ins.slot) == m_strings[ins.first];
+        case opcode::string_in:   return contains_string(ins, event.string(ins.slot));
+
+        case opcode::string_list_any:
+        case opcode::string_list_all: {
+            const auto n = event.string_list_size(ins.slot);
+            auto present = [&](std::string_view wanted) {
+                for (std::size_t k = 0; k < n; ++k) {
+                    if (event.string_list_at(ins.slot, k) == wanted) return true;
+                }
+                return false;
+            };
+            for (uint32_t k = 0; k < ins.count; ++k) {
+                const bool found = present(m_strings[ins.first + k]);
+                if (found && ins.code == opcode::string_list_any) return true;
+                if (!found && ins.code == opcode::string_list_all) return false;
+            }
+            return ins.code == opcode::string_list_all;
+        }
+
+        case opcode::integer_list_any:
+        case opcode::integer_list_all: {
+            auto values = event.integer_list(ins.slot);
+            for (uint32_t k = 0; k < ins.count; ++k) {
+                const bool found = std::find(values.begin(), values.end(),
+                                             m_integers[ins.first + k]) != values.end();
+                if (found && ins.code == opcode::integer_list_any) return true;
+                if (!found && ins.code == opcode::integer_list_all) return false;
+            }
+            return ins.code == opcode::integer_list_all;
+        }
+
+        default:
+            return false;
+    }
+}
+
+void linear_matcher::match(const decoded_event& event, std::vector<uint64_t>& out) const {
+    for (const auto& p : m_programs) {
+        if (eval(p.root, event)) out.push_back(p.id);
+    }
+}
+
+} // namespace sidecar
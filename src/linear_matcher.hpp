@@ -0,0 +1,76 @@
+#pragma once
+
+#include "attribute_schema.hpp"
+#include "decoded_event.hpp"
+#include "expression.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sidecar {
+
+// Evaluates a handful of expressions directly against a decoded event,
+// without building an a-tree event or crossing the FFI boundary. Each
+// expression is compiled into a small program over a shared instruction
+// array and the programs are run one after another.
+//
+// Only negation-free expressions are compiled. Without NOT, a predicate on a
+// missing or null attribute can simply evaluate to false and the result still
+// agrees with the a-tree's three-valued logic. Expressions using `not`, `<>`,
+// `none of`, null/empty tests or mismatched literal types are rejected by
+// add() and must stay in the tree.
+class linear_matcher {
+public:
+    // Compile and append one expression. Returns false, leaving the matcher
+    // unchanged, if the expression is outside the supported subset.
+    bool add(uint64_t subscription_id, const expression_node& node,
+             const attribute_schema& schema);
+
+    // Append IDs of all compiled expressions matched by `event`.
+    void match(const decoded_event& event, std::vector<uint64_t>& out) const;
+
+    std::size_t size() const { return m_programs.size(); }
+    bool empty() const { return m_programs.empty(); }
+
+private:
+    enum class opcode : uint8_t {
+        all, any,                      // children: m_children[first, first + count)
+        boolean_eq,
+        integer_cmp, float_cmp,        // op + operand
+        integer_in, string_eq, string_in,
+        string_list_any, string_list_all,
+        integer_list_any, integer_list_all
+    };
+
+    struct instruction {
+        opcode code = opcode::all;
+        predicate_op op = predicate_op::eq;
+        uint32_t slot = 0;
+        // Children (all/any) or literal range in m_integers/m_strings.
+        uint32_t first = 0;
+        uint32_t count = 0;
+        bool boolean = false;
+        int64_t integer = 0;
+        double real = 0.0;
+    };
+
+    struct program {
+        uint64_t id;
+        uint32_t root;
+    };
+
+    bool compile(const expression_node& node, const attribute_schema& schema, uint32_t& pc);
+    bool compile_predicate(const expression_node& node, const attribute_schema& schema,
+                           instruction& ins);
+    bool eval(uint32_t pc, const decoded_event& event) const;
+    bool contains_string(const instruction& ins, std::string_view value) const;
+    bool contains_integer(const instruction& ins, int64_t value) const;
+
+    std::vector<instruction> m_code;
+    std::vector<uint32_t> m_children;
+    std::vector<int64_t> m_integers;
+    std::vector<std::string> m_strings;
+    std::vector<program> m_programs;
+};
+
+} // namespace sidecar
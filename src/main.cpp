@@ -1,6 +1,9 @@
 #include "config.hpp"
+#include "cpu_affinity.hpp"
+#include "io_shard.hpp"
 #include "schema_generator.hpp"
 #include "sidecar.hpp"
+#include "worker_pool.hpp"
 #include <nats_asio/nats_asio.hpp>
 #include <asio/io_context.hpp>
 #include <asio/signal_set.hpp>
@@ -9,6 +12,8 @@
 #include <cxxopts.hpp>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/fmt/ranges.h>
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <thread>
@@ -27,13 +32,36 @@ int main(int argc, char* argv[]) {
         ("queue-group", "Input queue group for load balancing", cxxopts::value<std::string>())
         ("subscribe-subject", "Subscription request subject", cxxopts::value<std::string>())
         ("unsubscribe-subject", "Unsubscription request subject", cxxopts::value<std::string>())
+        ("admin-subject", "Schema administration subject (empty = off)", cxxopts::value<std::string>())
         ("lease-bucket", "NATS KV lease bucket name", cxxopts::value<std::string>())
         ("lease-ttl", "Lease TTL in seconds", cxxopts::value<uint32_t>())
         ("lease-check-interval", "Lease reconciliation interval in seconds", cxxopts::value<uint32_t>())
         ("attr", "Attribute as name:type (repeatable)", cxxopts::value<std::vector<std::string>>())
         ("workers", "Worker thread count (0 = auto)", cxxopts::value<unsigned int>())
+        ("worker-batch-size", "Maximum messages matched per worker batch", cxxopts::value<std::size_t>())
+        ("worker-wait", "Idle worker wait strategy: park, spin, yield, adaptive", cxxopts::value<std::string>())
+        ("latency-mode", "Spin idle workers for the lowest match latency (dedicated cores)")
+        ("worker-cpus", "CPUs to pin worker threads to, e.g. 2-5,8", cxxopts::value<std::string>())
+        ("io-cpus", "CPUs to pin the I/O threads to, e.g. 0-1", cxxopts::value<std::string>())
+        ("numa-aware", "Pin workers per NUMA node and give each node its own snapshot replica")
+        ("ingest-shards", "Input connections with their own I/O threads (0 = main connection)", cxxopts::value<unsigned int>())
+        ("output-shards", "Output connections with their own I/O threads (0 = main connection)", cxxopts::value<unsigned int>())
+        ("partition-attribute", "Attribute to partition the a-tree by", cxxopts::value<std::string>())
+        ("partition-key", "Attribute or subject:N token pinning messages to one worker", cxxopts::value<std::string>())
+        ("linear-match-threshold", "Expression count below which the a-tree is bypassed (0 = never)", cxxopts::value<std::size_t>())
+        ("match-cache-entries", "Per-worker match cache entries (0 = disabled)", cxxopts::value<std::size_t>())
+        ("match-cache-max-bytes", "Per-worker match cache byte limit", cxxopts::value<std::size_t>())
+        ("snapshot-path", "File to persist subscriptions to for warm restarts", cxxopts::value<std::string>())
+        ("snapshot-interval", "Seconds between subscription snapshot saves", cxxopts::value<uint32_t>())
+        ("snapshot-bucket", "KV bucket for sharing subscription state with peers", cxxopts::value<std::string>())
+        ("snapshot-publisher", "Publish subscription state to the snapshot bucket")
+        ("shard-id", "Own a consistent-hash slice of subscriptions under this member ID", cxxopts::value<std::string>())
+        ("shard-heartbeat", "Seconds between shard membership heartbeats", cxxopts::value<uint32_t>())
         ("input-queue-max-messages", "Maximum queued input messages", cxxopts::value<std::size_t>())
         ("input-queue-max-bytes", "Maximum queued input bytes", cxxopts::value<std::size_t>())
+        ("ordered-output", "Publish matches in input order through a reorder buffer")
+        ("reorder-timeout-ms", "Give up on a missing result after MS milliseconds", cxxopts::value<uint32_t>())
+        ("reorder-max-pending", "Maximum results held for reordering", cxxopts::value<std::size_t>())
         ("publish-max-inflight", "Maximum in-flight publication tasks", cxxopts::value<std::size_t>())
         ("publish-backpressure-timeout-ms", "NATS publish backpressure timeout", cxxopts::value<uint32_t>())
         ("tls-cert", "TLS certificate path", cxxopts::value<std::string>())
@@ -93,12 +121,30 @@ int main(int argc, char* argv[]) {
     if (result.count("queue-group"))          cfg.input_queue_group = result["queue-group"].as<std::string>();
     if (result.count("subscribe-subject"))    cfg.subscribe_subject = result["subscribe-subject"].as<std::string>();
     if (result.count("unsubscribe-subject"))  cfg.unsubscribe_subject = result["unsubscribe-subject"].as<std::string>();
+    if (result.count("admin-subject"))        cfg.admin_subject = result["admin-subject"].as<std::string>();
     if (result.count("lease-bucket"))         cfg.lease_bucket = result["lease-bucket"].as<std::string>();
     if (result.count("lease-ttl"))            cfg.lease_ttl_seconds = result["lease-ttl"].as<uint32_t>();
     if (result.count("lease-check-interval")) cfg.lease_check_interval_seconds = result["lease-check-interval"].as<uint32_t>();
     if (result.count("workers"))              cfg.worker_threads = result["workers"].as<unsigned int>();
+    if (result.count("worker-batch-size"))    cfg.worker_batch_size = result["worker-batch-size"].as<std::size_t>();
+    if (result.count("ingest-shards"))        cfg.ingest_shards = result["ingest-shards"].as<unsigned int>();
+    if (result.count("output-shards"))        cfg.output_shards = result["output-shards"].as<unsigned int>();
+    if (result.count("partition-attribute")) cfg.partition_attribute = result["partition-attribute"].as<std::string>();
+    if (result.count("partition-key"))       cfg.partition_key = result["partition-key"].as<std::string>();
+    if (result.count("linear-match-threshold")) cfg.linear_match_threshold = result["linear-match-threshold"].as<std::size_t>();
+    if (result.count("match-cache-entries"))  cfg.match_cache_entries = result["match-cache-entries"].as<std::size_t>();
+    if (result.count("match-cache-max-bytes")) cfg.match_cache_max_bytes = result["match-cache-max-bytes"].as<std::size_t>();
+    if (result.count("snapshot-path")) cfg.snapshot_path = result["snapshot-path"].as<std::string>();
+    if (result.count("snapshot-interval")) cfg.snapshot_interval_seconds = result["snapshot-interval"].as<uint32_t>();
+    if (result.count("snapshot-bucket")) cfg.snapshot_bucket = result["snapshot-bucket"].as<std::string>();
+    if (result.count("snapshot-publisher")) cfg.snapshot_publisher = true;
+    if (result.count("shard-id")) cfg.shard_id = result["shard-id"].as<std::string>();
+    if (result.count("shard-heartbeat")) cfg.shard_heartbeat_seconds = result["shard-heartbeat"].as<uint32_t>();
     if (result.count("input-queue-max-messages")) cfg.input_queue_max_messages = result["input-queue-max-messages"].as<std::size_t>();
     if (result.count("input-queue-max-bytes")) cfg.input_queue_max_bytes = result["input-queue-max-bytes"].as<std::size_t>();
+    if (result.count("ordered-output")) cfg.ordered_output = true;
+    if (result.count("reorder-timeout-ms")) cfg.reorder_timeout_ms = result["reorder-timeout-ms"].as<uint32_t>();
+    if (result.count("reorder-max-pending")) cfg.reorder_max_pending = result["reorder-max-pending"].as<std::size_t>();
     if (result.count("publish-max-inflight")) cfg.publish_max_inflight = result["publish-max-inflight"].as<std::size_t>();
     if (result.count("publish-backpressure-timeout-ms")) cfg.publish_backpressure_timeout_ms = result["publish-backpressure-timeout-ms"].as<uint32_t>();
     if (result.count("tls-cert"))             cfg.tls_cert = result["tls-cert"].as<std::string>();
@@ -108,6 +154,27 @@ int main(int argc, char* argv[]) {
     if (result.count("log-level"))            cfg.log_level = result["log-level"].as<std::string>();
     if (result.count("verbose"))              cfg.log_level = "debug";
 
+    if (result.count("worker-wait")) {
+        auto strategy = sidecar::parse_wait_strategy(result["worker-wait"].as<std::string>());
+        if (!strategy) {
+            console->error("Invalid worker wait strategy: {}", result["worker-wait"].as<std::string>());
+            return 1;
+        }
+        cfg.worker_wait_strategy = *strategy;
+    }
+    if (result.count("latency-mode")) cfg.latency_mode = true;
+    for (auto [flag, target] : {std::pair{"worker-cpus", &cfg.worker_cpus},
+                                std::pair{"io-cpus", &cfg.io_cpus}}) {
+        if (!result.count(flag)) continue;
+        auto cpus = sidecar::parse_cpu_list(result[flag].as<std::string>());
+        if (!cpus) {
+            console->error("Invalid CPU list for --{}: {}", flag, result[flag].as<std::string>());
+            return 1;
+        }
+        *target = std::move(*cpus);
+    }
+    if (result.count("numa-aware")) cfg.numa_aware = true;
+
     if (result.count("format")) {
         auto fmt = sidecar::parse_format(result["format"].as<std::string>());
         if (!fmt) {
@@ -139,23 +206,124 @@ int main(int argc, char* argv[]) {
     // Default output_prefix to input_subject if still empty
     if (cfg.output_prefix.empty()) cfg.output_prefix = cfg.input_subject;
 
+    // Every pipeline this process hosts; the top level alone when the config
+    // file lists none. CLI overrides apply to the top level only.
+    const auto pipelines = cfg.pipelines.empty()
+        ? std::vector<sidecar::config>{cfg} : cfg.pipelines;
+
     // Validate required fields
-    if (cfg.input_subject.empty()) {
-        console->error("input_subject is required (via config file or --input-subject)");
-        return 1;
-    }
-    if (cfg.attributes.empty()) {
-        console->error("At least one attribute is required (via config file or --attr)");
-        return 1;
+    auto validate_pipeline = [&](const sidecar::config& p) {
+        if (p.input_subject.empty()) {
+            console->error("input_subject is required (via config file or --input-subject)");
+            return false;
+        }
+        if (p.attributes.empty()) {
+            console->error("At least one attribute is required (via config file or --attr)");
+            return false;
+        }
+        if (!p.partition_attribute.empty()) {
+            auto attr = std::find_if(p.attributes.rbegin(), p.attributes.rend(),
+                                     [&](const auto& a) { return a.name == p.partition_attribute; });
+            if (attr == p.attributes.rend() ||
+                (attr->type != sidecar::attribute_type::string &&
+                 attr->type != sidecar::attribute_type::integer)) {
+                console->error("partition_attribute '{}' must be a declared string or integer attribute",
+                               p.partition_attribute);
+                return false;
+            }
+        }
+        if (!p.partition_key.empty() && !sidecar::partition_key_subject_token(p.partition_key)) {
+            auto attr = std::find_if(p.attributes.rbegin(), p.attributes.rend(),
+                                     [&](const auto& a) { return a.name == p.partition_key; });
+            if (attr == p.attributes.rend() ||
+                (attr->type != sidecar::attribute_type::string &&
+                 attr->type != sidecar::attribute_type::integer &&
+                 attr->type != sidecar::attribute_type::boolean)) {
+                console->error("partition_key '{}' must be subject:N or a declared string, "
+                               "integer or boolean attribute", p.partition_key);
+                return false;
+            }
+        }
+        if (!p.shard_id.empty()) {
+            if (!sidecar::shard_membership::valid_member_id(p.shard_id)) {
+                console->error("shard_id '{}' may only contain letters, digits, '_' and '-'",
+                               p.shard_id);
+                return false;
+            }
+            if (!p.input_queue_group.empty() || p.shard_heartbeat_seconds == 0) {
+                console->error("Sharding needs the full input stream (no input_queue_group) "
+                               "and a non-zero shard_heartbeat_seconds");
+                return false;
+            }
+            // Owners are agreed per expression, but IDs are per instance; see
+            // subscription_manager::set_shard_members().
+            if (p.snapshot_bucket.empty()) {
+                console->warn("shard_id '{}' without snapshot_bucket: after a restart this "
+                              "member may give new subscriptions different IDs than its "
+                              "peers", p.shard_id);
+            }
+            // Membership records live in the lease bucket and expire with its
+            // TTL; allow a missed heartbeat before a live member drops out.
+            if (uint64_t{p.shard_heartbeat_seconds} * 2 > p.lease_ttl_seconds) {
+                console->error("shard_heartbeat_seconds ({}) must be at most half of "
+                               "lease_ttl_seconds ({})",
+                               p.shard_heartbeat_seconds, p.lease_ttl_seconds);
+                return false;
+            }
+        }
+        if (p.lease_ttl_seconds == 0 || p.lease_check_interval_seconds == 0 ||
+            p.input_queue_max_messages == 0 || p.input_queue_max_bytes == 0 ||
+            p.snapshot_interval_seconds == 0) {
+            console->error("Lease TTL, snapshot interval, and all "
+                           "queue/publication limits must be greater than zero");
+            return false;
+        }
+        if (p.ordered_output && (p.reorder_timeout_ms == 0 || p.reorder_max_pending == 0)) {
+            console->error("ordered_output needs a non-zero reorder_timeout_ms and reorder_max_pending");
+            return false;
+        }
+        if (p.input_queue_max_messages > sidecar::worker_pool::k_max_queue_messages ||
+            p.input_queue_max_bytes > sidecar::worker_pool::k_max_queue_bytes) {
+            console->error("input_queue_max_messages may be at most {} and "
+                           "input_queue_max_bytes at most {}",
+                           sidecar::worker_pool::k_max_queue_messages,
+                           sidecar::worker_pool::k_max_queue_bytes);
+            return false;
+        }
+        return true;
+    };
+    for (const auto& p : pipelines) {
+        if (!validate_pipeline(p)) return 1;
     }
-    if (cfg.lease_ttl_seconds == 0 || cfg.lease_check_interval_seconds == 0 ||
-        cfg.input_queue_max_messages == 0 ||
-        cfg.input_queue_max_bytes == 0 || cfg.publish_max_inflight == 0 ||
+    if (cfg.worker_batch_size == 0 || cfg.publish_max_inflight == 0 ||
         cfg.publish_backpressure_timeout_ms == 0) {
-        console->error("Lease TTL and all queue/publication limits must be greater than zero");
+        console->error("Worker batch size and all queue/publication limits "
+                       "must be greater than zero");
         return 1;
     }
 
+    // Pipelines keep separate subscription IDs, so they must not share
+    // control subjects, lease buckets, snapshot files or buckets, or output
+    // prefixes (ID 1 of each would publish to the same subject).
+    for (std::size_t i = 0; i < pipelines.size(); ++i) {
+        for (std::size_t j = 0; j < i; ++j) {
+            const auto& a = pipelines[i];
+            const auto& b = pipelines[j];
+            if (a.name == b.name || a.lease_bucket == b.lease_bucket ||
+                a.output_prefix == b.output_prefix ||
+                a.subscribe_subject == b.subscribe_subject ||
+                a.unsubscribe_subject == b.unsubscribe_subject ||
+                (!a.admin_subject.empty() && a.admin_subject == b.admin_subject) ||
+                (!a.snapshot_path.empty() && a.snapshot_path == b.snapshot_path) ||
+                (!a.snapshot_bucket.empty() && a.snapshot_bucket == b.snapshot_bucket)) {
+                console->error("Pipelines '{}' and '{}' must use distinct names, lease buckets, "
+                               "output prefixes, control subjects and snapshot paths and buckets",
+                               b.name, a.name);
+                return 1;
+            }
+        }
+    }
+
     // Set log level
     if (cfg.log_level == "debug")      spdlog::set_level(spdlog::level::debug);
     else if (cfg.log_level == "warn")  spdlog::set_level(spdlog::level::warn);
@@ -170,15 +338,71 @@ int main(int argc, char* argv[]) {
 
     console->info("nats_sidecar starting");
     console->info("  server: {}:{}", cfg.nats_address, cfg.nats_port);
-    console->info("  input:  {} (format={})", cfg.input_subject, static_cast<int>(cfg.format));
-    console->info("  output: {}.<ID>", cfg.output_prefix);
-    console->info("  attributes: {}", cfg.attributes.size());
-    console->info("  worker threads: {}", effective_workers);
+    if (cfg.pipelines.empty()) {
+        console->info("  input:  {} (format={})", cfg.input_subject, static_cast<int>(cfg.format));
+        console->info("  output: {}.<ID>", cfg.output_prefix);
+        console->info("  attributes: {}", cfg.attributes.size());
+    }
+    console->info("  worker threads: {} (batch size {})",
+                  effective_workers, cfg.worker_batch_size);
+    if (cfg.latency_mode) {
+        console->info("  latency mode: idle workers spin");
+    }
+    if (!cfg.worker_cpus.empty()) {
+        console->info("  worker CPUs: {}", fmt::join(cfg.worker_cpus, ","));
+    }
+    if (!cfg.io_cpus.empty()) {
+        console->info("  I/O CPUs: {}", fmt::join(cfg.io_cpus, ","));
+    }
+    if (cfg.numa_aware) {
+        const auto nodes = sidecar::numa_node_cpus().size();
+        console->info("  NUMA nodes: {}{}", nodes,
+                      nodes > 1 ? " (one snapshot replica per node)" : " (replicas off)");
+    }
+    console->info("  range kernel: {}", sidecar::range_kernel_name());
+    if (cfg.ingest_shards > 0) {
+        console->info("  ingest shards: {}", cfg.ingest_shards);
+    }
+    if (cfg.output_shards > 0) {
+        console->info("  output shards: {}", cfg.output_shards);
+    }
+    if (cfg.ordered_output) {
+        console->info("  ordered output: timeout {}ms, {} pending max",
+                      cfg.reorder_timeout_ms, cfg.reorder_max_pending);
+    }
+    if (!cfg.partition_attribute.empty()) {
+        console->info("  partition attribute: {}", cfg.partition_attribute);
+    }
+    if (!cfg.partition_key.empty()) {
+        console->info("  partition key: {}", cfg.partition_key);
+    }
+    if (cfg.match_cache_entries > 0) {
+        console->info("  match cache: {} entries / {} bytes per worker",
+                      cfg.match_cache_entries, cfg.match_cache_max_bytes);
+    }
+    if (!cfg.snapshot_path.empty()) {
+        console->info("  snapshot: {} (every {}s)", cfg.snapshot_path, cfg.snapshot_interval_seconds);
+    }
+    if (!cfg.shard_id.empty()) {
+        console->info("  shard member: {} (heartbeat {}s)", cfg.shard_id, cfg.shard_heartbeat_seconds);
+    }
+    if (!cfg.snapshot_bucket.empty()) {
+        console->info("  snapshot bucket: {}{}", cfg.snapshot_bucket,
+                      cfg.snapshot_publisher ? " (publisher)" : "");
+    }
     console->info("  lease bucket: {} (TTL={}s)", cfg.lease_bucket, cfg.lease_ttl_seconds);
     console->info("  input queue: {} messages / {} bytes",
                   cfg.input_queue_max_messages, cfg.input_queue_max_bytes);
     console->info("  publication tasks: {} max in-flight",
                   cfg.publish_max_inflight);
+    if (!cfg.pipelines.empty()) {
+        console->info("  pipelines: {}", pipelines.size());
+        for (const auto& p : pipelines) {
+            console->info("    {}: input {} -> {}.<ID> ({} attributes, lease bucket {})",
+                          p.name, p.input_subject, p.output_prefix,
+                          p.attributes.size(), p.lease_bucket);
+        }
+    }
 
     // Single-threaded io_context (NATS I/O + publish coroutines)
     asio::io_context ioc(1);
@@ -190,18 +414,6 @@ int main(int argc, char* argv[]) {
         ioc.stop();
     });
 
-    // Build the sidecar engine
-    std::shared_ptr<sidecar::sidecar_engine> engine;
-    try {
-        engine = std::make_shared<sidecar::sidecar_engine>(ioc, cfg, console);
-    } catch (const atree::Error& e) {
-        console->error("Failed to initialize sidecar engine: {}", e.what());
-        return 1;
-    } catch (const std::exception& e) {
-        console->error("Failed to initialize sidecar engine: {}", e.what());
-        return 1;
-    }
-
     // Build NATS connect config
     nats_asio::connect_config nats_cfg;
     nats_cfg.address = cfg.nats_address;
@@ -219,7 +431,7 @@ int main(int argc, char* argv[]) {
     }
 
     // Callbacks
-    auto on_connected = [engine, console](nats_asio::iconnection& /*c*/) -> asio::awaitable<void> {
+    auto on_connected = [console](nats_asio::iconnection& /*c*/) -> asio::awaitable<void> {
         console->info("Connected to NATS");
         co_return;
     };
@@ -237,36 +449,82 @@ int main(int argc, char* argv[]) {
     auto conn = nats_asio::create_connection(
         ioc, on_connected, on_disconnected, on_error, ssl_conf);
 
+    // Build one engine per pipeline, all feeding the same worker pool
+    auto pool = std::make_shared<sidecar::worker_pool>(ioc, cfg, conn, console);
+    std::vector<std::shared_ptr<sidecar::sidecar_engine>> engines;
+    try {
+        for (const auto& p : pipelines) {
+            engines.push_back(std::make_shared<sidecar::sidecar_engine>(ioc, p, console, pool));
+        }
+    } catch (const atree::Error& e) {
+        console->error("Failed to initialize sidecar engine: {}", e.what());
+        return 1;
+    } catch (const std::exception& e) {
+        console->error("Failed to initialize sidecar engine: {}", e.what());
+        return 1;
+    }
+
+    // Extra input and output connections, each with its own I/O thread
+    std::vector<std::shared_ptr<sidecar::io_shard>> ingest;
+    for (unsigned int i = 0; i < cfg.ingest_shards; ++i) {
+        ingest.push_back(std::make_shared<sidecar::io_shard>("Ingest", i, console));
+    }
+    for (auto& engine : engines) engine->set_ingest_shards(ingest);
+    std::vector<std::shared_ptr<sidecar::io_shard>> output;
+    for (unsigned int i = 0; i < cfg.output_shards; ++i) {
+        output.push_back(std::make_shared<sidecar::io_shard>("Output", i, console));
+    }
+    pool->set_output_shards(output);
+    pool->start();
+
     conn->start(nats_cfg);
+    for (auto& shard : ingest) shard->start(nats_cfg, ssl_conf, cfg.io_cpus);
+    for (auto& shard : output) shard->start(nats_cfg, ssl_conf, cfg.io_cpus);
 
-    // Start engine once connected
+    // Start engines once connected
     asio::co_spawn(ioc,
-        [engine, c = conn]() mutable -> asio::awaitable<void> {
+        [engines, c = conn]() mutable -> asio::awaitable<void> {
             asio::steady_timer timer(co_await asio::this_coro::executor);
             while (!c->is_connected()) {
                 timer.expires_after(std::chrono::milliseconds(100));
                 co_await timer.async_wait(asio::use_awaitable);
             }
-            co_await engine->start(c);
+            for (auto& engine : engines) {
+                co_await engine->start(c);
+            }
         },
         asio::detached
     );
 
     // Run the event loop (single thread)
+    if (!cfg.io_cpus.empty() && !sidecar::pin_current_thread(cfg.io_cpus)) {
+        console->warn("Failed to pin the main I/O thread");
+    }
     ioc.run();
 
     // Shutdown ordering:
-    // 1. Stop worker threads (drain queue + join)
-    engine->stop_workers();
+    // 1. Stop reading input on the ingest shards (drain + join)
+    for (auto& shard : ingest) shard->stop();
 
-    // 2. Resume queued publish coroutines and wait for every accepted task.
-    // 3. Drain NATS writes and close the connection deterministically.
+    // 2. Hand every pipeline's batched input to the shared pool, then stop
+    // worker threads (drain queue + join); the first stop closes the pool
+    // for all pipelines.
+    for (auto& engine : engines) engine->flush_pending_input();
+    for (auto& engine : engines) {
+        engine->stop_workers();
+    }
+
+    // 3. Resume queued publish coroutines and wait for every accepted task.
+    // 4. Drain NATS writes and close the connection deterministically.
     ioc.restart();
     asio::co_spawn(ioc,
-        [engine, c = conn, console, &ioc]() -> asio::awaitable<void> {
-            if (!co_await engine->wait_for_publications(std::chrono::seconds(30))) {
+        [engines, pool, c = conn, console, &ioc]() -> asio::awaitable<void> {
+            if (!co_await pool->wait_for_publications(std::chrono::seconds(30))) {
                 console->warn("Timed out waiting for publication tasks to finish");
             }
+            for (auto& engine : engines) {
+                co_await engine->leave_shard();
+            }
             auto status = co_await c->drain(std::chrono::seconds(30));
             if (status.failed()) {
                 console->warn("NATS connection drain failed: {}", status.error());
@@ -277,6 +535,9 @@ int main(int argc, char* argv[]) {
     );
     ioc.run();
 
+    // 5. Flush and close the output connections.
+    for (auto& shard : output) shard->stop();
+
     console->info("nats_sidecar stopped");
     return 0;
 }
@@ -0,0 +1,113 @@
+#include "match_cache.hpp"
+#include "equality_index.hpp"
+
+namespace sidecar {
+
+namespace {
+
+// Rough per-entry bookkeeping: list node, hash node and container headers.
+constexpr std::size_t k_entry_overhead = 128;
+
+} // anonymous namespace
+
+void match_cache::configure(std::size_t max_entries, std::size_t max_bytes) {
+    m_max_entries = max_entries;
+    m_max_bytes = max_bytes;
+    m_index.clear();
+    m_lru.clear();
+    m_free.clear();
+    m_bytes = 0;
+    m_synced = false;
+    if (enabled()) m_index.reserve(max_entries);
+}
+
+std::size_t match_cache::cost(const entry& e) {
+    return k_entry_overhead + e.key.capacity() + e.ids.capacity() * sizeof(uint64_t);
+}
+
+void match_cache::sync(uint64_t version) {
+    if (m_synced && m_version == version) return;
+    m_version = version;
+    m_synced = true;
+
+    // The nodes keep their buffers, and their bytes, for reuse.
+    m_index.clear();
+    m_free.splice(m_free.begin(), m_lru);
+}
+
+const std::vector<uint64_t>* match_cache::find(std::string_view key) {
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        ++m_misses;
+        return nullptr;
+    }
+    ++m_hits;
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    return &it->second->ids;
+}
+
+void match_cache::evict_one() {
+    auto last = std::prev(m_lru.end());
+    m_index.erase(last->key);
+    m_free.splice(m_free.begin(), m_lru, last);
+}
+
+void match_cache::drop_free() {
+    m_bytes -= cost(m_free.back());
+    m_free.pop_back();
+}
+
+void match_cache::insert(std::string_view key, std::span<const uint64_t> ids) {
+    if (!enabled() || m_index.count(key)) return;
+
+    // What a node allocated just for this entry holds.
+    const auto needed = k_entry_overhead + key.size() + ids.size() * sizeof(uint64_t);
+    if (needed > m_max_bytes) return;
+
+    while (!m_lru.empty() && m_index.size() >= m_max_entries) evict_one();
+
+    if (m_free.empty()) {
+        m_lru.emplace_front();
+        m_bytes += cost(m_lru.front());
+    } else {
+        m_lru.splice(m_lru.begin(), m_free, m_free.begin());
+    }
+    auto& e = m_lru.front();
+    m_bytes -= cost(e);
+    if (cost(e) > 2 * needed) {
+        // Don't let one oversized entry's buffers pin memory in every reuse.
+        e = entry{};
+    }
+    e.key.assign(key);
+    e.ids.assign(ids.begin(), ids.end());
+    m_bytes += cost(e);
+
+    // Over the byte limit: free spare nodes first, then evict.
+    while (m_bytes > m_max_bytes) {
+        if (!m_free.empty()) {
+            drop_free();
+        } else if (m_lru.size() > 1) {
+            evict_one();
+        } else {
+            // Only this entry is left; give it buffers of exactly its size.
+            m_bytes -= cost(e);
+            e = entry{std::string(key), std::vector<uint64_t>(ids.begin(), ids.end())};
+            m_bytes += cost(e);
+            break;
+        }
+    }
+    m_index.emplace(e.key, m_lru.begin());
+}
+
+void append_event_key(std::string& out, const decoded_event& event,
+                      const attribute_schema& schema) {
+    for (std::size_t i = 0; i < schema.size(); ++i) {
+        const auto status = event.status(i);
+        out += static_cast<char>(status);
+        if (status == decoded_event::state::value) {
+            append_value_key(out, event, i, schema.defs[i].type);
+        }
+    }
+}
+
+} // namespace sidecar
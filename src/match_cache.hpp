@@ -0,0 +1,73 @@
+#pragma once
+
+#include "attribute_schema.hpp"
+#include "decoded_event.hpp"
+#include <cstdint>
+#include <list>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace sidecar {
+
+// Per-worker LRU cache from an event's schema attribute tuple to its matched
+// subscription IDs. Bounded by entry count and approximate bytes held, and
+// cleared whenever the worker sees a different snapshot version, so cached
+// results never outlive the subscriptions they were computed against.
+class match_cache {
+public:
+    // max_entries == 0 disables the cache.
+    void configure(std::size_t max_entries, std::size_t max_bytes);
+
+    bool enabled() const { return m_max_entries > 0; }
+
+    // Drop all entries if `version` differs from the last synced snapshot.
+    void sync(uint64_t version);
+
+    // Cached IDs for `key`, or null on a miss. A hit becomes most recent.
+    const std::vector<uint64_t>* find(std::string_view key);
+
+    // Cache `ids` for `key`, evicting least recently used entries as needed.
+    void insert(std::string_view key, std::span<const uint64_t> ids);
+
+    std::size_t size() const { return m_index.size(); }
+    // Approximate bytes held, counting buffer capacity and the buffers kept
+    // by evicted nodes for reuse.
+    std::size_t bytes() const { return m_bytes; }
+    uint64_t hits() const { return m_hits; }
+    uint64_t misses() const { return m_misses; }
+
+private:
+    struct entry {
+        std::string key;
+        std::vector<uint64_t> ids;
+    };
+
+    // Bytes `e` holds, by buffer capacity.
+    static std::size_t cost(const entry& e);
+    void evict_one();
+    // Free the least recently evicted node and its buffers.
+    void drop_free();
+
+    std::size_t m_max_entries = 0;
+    std::size_t m_max_bytes = 0;
+    uint64_t m_version = 0;
+    bool m_synced = false;
+
+    std::list<entry> m_lru;  // most recent first
+    std::list<entry> m_free; // evicted nodes, reused to keep their buffers
+    std::unordered_map<std::string_view, std::list<entry>::iterator> m_index;
+    std::size_t m_bytes = 0; // cost() of every node in m_lru and m_free
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+};
+
+// Append the cache key of `event`: the state and encoded value of every
+// schema attribute, so two events share a key only if they are
+// indistinguishable to every expression.
+void append_event_key(std::string& out, const decoded_event& event,
+                      const attribute_schema& schema);
+
+} // namespace sidecar
@@ -0,0 +1,252 @@
+#include "match_prefilter.hpp"
+#include "equality_index.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string_view>
+
+namespace sidecar {
+
+namespace {
+
+constexpr std::size_t k_bloom_hashes = 4;
+constexpr std::size_t k_bloom_bits_per_key = 10;
+
+// One alternative an event must satisfy for an expression to match.
+struct anchor {
+    bool is_range = false;
+    std::size_t slot = 0;
+    std::string key;  // equality: slot-prefixed value key
+    double lo = 0.0;  // range: closed bounds
+    double hi = 0.0;
+};
+
+// nullopt: the expression cannot be bounded.
+using anchor_set = std::optional<std::vector<anchor>>;
+
+void append_slot_prefix(std::string& out, std::size_t slot) {
+    const auto index = static_cast<uint32_t>(slot);
+    char bytes[sizeof(index)];
+    std::memcpy(bytes, &index, sizeof(index));
+    out.append(bytes, sizeof(index));
+}
+
+std::optional<double> numeric(const expression_literal& value) {
+    if (auto i = std::get_if<int64_t>(&value)) return static_cast<double>(*i);
+    if (auto d = std::get_if<double>(&value)) return *d;
+    return std::nullopt;
+}
+
+anchor equality_anchor(std::size_t slot, const expression_literal& value) {
+    anchor a;
+    a.slot = slot;
+    append_slot_prefix(a.key, slot);
+    append_literal_key(a.key, value);
+    return a;
+}
+
+anchor range_anchor(std::size_t slot, double lo, double hi) {
+    anchor a;
+    a.is_range = true;
+    a.slot = slot;
+    a.lo = lo;
+    a.hi = hi;
+    return a;
+}
+
+anchor_set predicate_anchors(const expression_node& node, const attribute_schema& schema) {
+    auto slot = schema.find(node.attribute);
+    if (!slot) return std::nullopt;
+
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    const auto i = slot->index;
+    std::vector<anchor> anchors;
+
+    // Scalar equality and membership: every listed value must have the
+    // attribute's own literal type.
+    auto keyed = [&](auto holds) -> anchor_set {
+        for (const auto& v : node.values) {
+            if (!holds(v)) return std::nullopt;
+            anchors.push_back(equality_anchor(i, v));
+        }
+        return anchors;
+    };
+
+    switch (slot->type) {
+        case attribute_type::boolean:
+            if (node.op == predicate_op::truthy) return std::vector{equality_anchor(i, true)};
+            if (node.op != predicate_op::eq) return std::nullopt;
+            return keyed([](const auto& v) { return std::holds_alternative<bool>(v); });
+
+        case attribute_type::string:
+            if (node.op != predicate_op::eq && node.op != predicate_op::in) return std::nullopt;
+            return keyed([](const auto& v) { return std::holds_alternative<std::string>(v); });
+
+        case attribute_type::integer:
+        case attribute_type::float_val: {
+            const bool is_integer = slot->type == attribute_type::integer;
+            if (is_integer && (node.op == predicate_op::eq || node.op == predicate_op::in)) {
+                return keyed([](const auto& v) { return std::holds_alternative<int64_t>(v); });
+            }
+
+            double lo = inf;
+            double hi = -inf;
+            for (const auto& v : node.values) {
+                auto d = numeric(v);
+                if (!d) return std::nullopt;
+                lo = std::min(lo, *d);
+                hi = std::max(hi, *d);
+            }
+            if (node.values.empty()) return std::nullopt;
+
+            switch (node.op) {
+                case predicate_op::eq:
+                case predicate_op::in: return std::vector{range_anchor(i, lo, hi)};
+                case predicate_op::lt:
+                case predicate_op::le: return std::vector{range_anchor(i, -inf, hi)};
+                case predicate_op::gt:
+                case predicate_op::ge: return std::vector{range_anchor(i, lo, inf)};
+                default:               return std::nullopt;
+            }
+        }
+
+        default:
+            return std::nullopt;
+    }
+}
+
+anchor_set anchors_of(const expression_node& node, const attribute_schema& schema) {
+    switch (node.type) {
+        case expression_node::kind::predicate:
+            return predicate_anchors(node, schema);
+
+        case expression_node::kind::negation:
+            return std::nullopt;
+
+        case expression_node::kind::disjunction: {
+            // Any branch may match, so the event must satisfy one of them.
+            std::vector<anchor> all;
+            for (const auto& child : node.children) {
+                auto anchors = anchors_of(child, schema);
+                if (!anchors) return std::nullopt;
+                std::move(anchors->begin(), anchors->end(), std::back_inserter(all));
+            }
+            return all;
+        }
+
+        case expression_node::kind::conjunction: {
+            // Every branch must match, so one branch's anchors suffice. Prefer
+            // equality anchors, which are far more selective than bounds.
+            anchor_set best;
+            auto rank = [](const std::vector<anchor>& anchors) {
+                bool has_range = std::any_of(anchors.begin(), anchors.end(),
+                                             [](const anchor& a) { return a.is_range; });
+                return std::pair(has_range, anchors.size());
+            };
+            for (const auto& child : node.children) {
+                auto anchors = anchors_of(child, schema);
+                if (anchors && (!best || rank(*anchors) < rank(*best))) best = std::move(anchors);
+            }
+            return best;
+        }
+    }
+    return std::nullopt;
+}
+
+std::pair<uint64_t, uint64_t> bloom_hashes(std::string_view key) {
+    const uint64_t h1 = std::hash<std::string_view>{}(key);
+    const uint64_t h2 = (std::rotl(h1, 32) * 0x9E3779B97F4A7C15ULL) | 1;
+    return {h1, h2};
+}
+
+} // anonymous namespace
+
+void match_prefilter::add(const expression_node* node, const attribute_schema& schema) {
+    ++m_expressions;
+    if (!m_enabled) return;
+
+    auto anchors = node ? anchors_of(*node, schema) : std::nullopt;
+    if (!anchors) {
+        m_enabled = false;
+        return;
+    }
+
+    for (auto& a : *anchors) {
+        if (!a.is_range) {
+            if (std::find(m_key_slots.begin(), m_key_slots.end(), a.slot) == m_key_slots.end()) {
+                m_key_slots.push_back(a.slot);
+            }
+            m_keys.push_back(std::move(a.key));
+            continue;
+        }
+
+        auto it = std::find_if(m_ranges.begin(), m_ranges.end(),
+                               [&](const range& r) { return r.slot == a.slot; });
+        if (it == m_ranges.end()) {
+            m_ranges.push_back(range{a.slot, a.lo, a.hi});
+        } else {
+            it->lo = std::min(it->lo, a.lo);
+            it->hi = std::max(it->hi, a.hi);
+        }
+    }
+}
+
+void match_prefilter::seal() {
+    if (!m_enabled || m_keys.empty()) {
+        m_keys.clear();
+        return;
+    }
+
+    const uint64_t bits = std::bit_ceil(
+        std::max<uint64_t>(64, m_keys.size() * k_bloom_bits_per_key));
+    m_bits.assign(bits / 64, 0);
+    m_bit_mask = bits - 1;
+
+    for (const auto& key : m_keys) {
+        auto [h1, h2] = bloom_hashes(key);
+        for (std::size_t k = 0; k < k_bloom_hashes; ++k) {
+            const uint64_t bit = (h1 + k * h2) & m_bit_mask;
+            m_bits[bit / 64] |= uint64_t{1} << (bit % 64);
+        }
+    }
+    m_keys.clear();
+    m_keys.shrink_to_fit();
+}
+
+bool match_prefilter::contains(const std::string& key) const {
+    auto [h1, h2] = bloom_hashes(key);
+    for (std::size_t k = 0; k < k_bloom_hashes; ++k) {
+        const uint64_t bit = (h1 + k * h2) & m_bit_mask;
+        if (!(m_bits[bit / 64] & (uint64_t{1} << (bit % 64)))) return false;
+    }
+    return true;
+}
+
+bool match_prefilter::may_match(const decoded_event& event, const attribute_schema& schema,
+                                std::string& key_scratch) const {
+    if (!enabled()) return true;
+
+    if (!m_bits.empty()) {
+        for (auto slot : m_key_slots) {
+            if (!event.has_value(slot)) continue;
+            key_scratch.clear();
+            append_slot_prefix(key_scratch, slot);
+            append_value_key(key_scratch, event, slot, schema.defs[slot].type);
+            if (contains(key_scratch)) return true;
+        }
+    }
+
+    for (const auto& r : m_ranges) {
+        if (!event.has_value(r.slot)) continue;
+        const double v = schema.defs[r.slot].type == attribute_type::integer
+            ? static_cast<double>(event.integer(r.slot))
+            : event.real(r.slot);
+        if (v >= r.lo && v <= r.hi) return true;
+    }
+    return false;
+}
+
+} // namespace sidecar
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "attribute_schema.hpp"
+#include "decoded_event.hpp"
+#include "expression.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sidecar {
+
+// Cheap necessary condition for "some tree expression can match", checked
+// before an event is built and searched. Every expression contributes one or
+// more anchors, at least one of which a matching event must satisfy:
+//   - an equality anchor (`location = "w7"`, `severity in [1, 2]`, `active`)
+//     is recorded in a Bloom filter over (attribute, value);
+//   - a range anchor (`temperature > 30.0`) widens per-attribute min/max
+//     bounds.
+// An event that hits neither the filter nor any bounds cannot match. If any
+// expression has no anchor (negation, `<>`, list operators, unparsed text),
+// the prefilter is disabled and passes every event.
+class match_prefilter {
+public:
+    // Record the anchors of one expression. `node` is null for expressions
+    // the parser does not model.
+    void add(const expression_node* node, const attribute_schema& schema);
+
+    // Build the Bloom filter from the recorded keys. Must be called once after
+    // the last add() and before may_match().
+    void seal();
+
+    bool enabled() const { return m_enabled && m_expressions > 0; }
+
+    // False only if no recorded expression can match `event`.
+    bool may_match(const decoded_event& event, const attribute_schema& schema,
+                   std::string& key_scratch) const;
+
+private:
+    struct range {
+        std::size_t slot;
+        double lo;
+        double hi;
+    };
+
+    bool contains(const std::string& key) const;
+
+    bool m_enabled = true;
+    std::size_t m_expressions = 0;
+
+    std::vector<std::string> m_keys;         // pending until seal()
+    std::vector<std::size_t> m_key_slots;    // slots with equality anchors
+    std::vector<uint64_t> m_bits;
+    uint64_t m_bit_mask = 0;
+
+    std::vector<range> m_ranges;             // one hull per slot
+};
+
+} // namespace sidecar
@@ -0,0 +1,208 @@
+#include "range_engine.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <optional>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SIDECAR_RANGE_X86 1
+#include <immintrin.h>
+#endif
+
+namespace sidecar {
+
+namespace {
+
+using range_kernel = uint64_t (*)(const double*, std::size_t, double, double);
+
+uint64_t range_mask_scalar(const double* column, std::size_t n, double lo, double hi) {
+    uint64_t mask = 0;
+    for (std::size_t k = 0; k < n; ++k) {
+        mask |= static_cast<uint64_t>(column[k] >= lo && column[k] <= hi) << k;
+    }
+    return mask;
+}
+
+#ifdef SIDECAR_RANGE_X86
+
+__attribute__((target("avx2")))
+uint64_t range_mask_avx2(const double* column, std::size_t n, double lo, double hi) {
+    const __m256d lo_v = _mm256_set1_pd(lo);
+    const __m256d hi_v = _mm256_set1_pd(hi);
+    uint64_t mask = 0;
+    for (std::size_t k = 0; k < n; k += 4) {
+        const __m256d v = _mm256_loadu_pd(column + k);
+        const __m256d in = _mm256_and_pd(_mm256_cmp_pd(v, lo_v, _CMP_GE_OQ),
+                                         _mm256_cmp_pd(v, hi_v, _CMP_LE_OQ));
+        mask |= static_cast<uint64_t>(_mm256_movemask_pd(in)) << k;
+    }
+    return n < 64 ? mask & ((uint64_t{1} << n) - 1) : mask;
+}
+
+__attribute__((target("avx512f")))
+uint64_t range_mask_avx512(const double* column, std::size_t n, double lo, double hi) {
+    const __m512d lo_v = _mm512_set1_pd(lo);
+    const __m512d hi_v = _mm512_set1_pd(hi);
+    uint64_t mask = 0;
+    for (std::size_t k = 0; k < n; k += 8) {
+        const __m512d v = _mm512_loadu_pd(column + k);
+        const __mmask8 in = _mm512_cmp_pd_mask(v, lo_v, _CMP_GE_OQ) &
+                            _mm512_cmp_pd_mask(v, hi_v, _CMP_LE_OQ);
+        mask |= static_cast<uint64_t>(in) << k;
+    }
+    return n < 64 ? mask & ((uint64_t{1} << n) - 1) : mask;
+}
+
+#endif
+
+struct kernel_choice {
+    range_kernel fn;
+    const char* name;
+};
+
+kernel_choice select_kernel() {
+#ifdef SIDECAR_RANGE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return {range_mask_avx512, "avx512"};
+    if (__builtin_cpu_supports("avx2")) return {range_mask_avx2, "avx2"};
+#endif
+    return {range_mask_scalar, "scalar"};
+}
+
+const kernel_choice& kernel() {
+    static const kernel_choice choice = select_kernel();
+    return choice;
+}
+
+// Closed interval equivalent to `value <op> literal` over doubles.
+std::optional<std::pair<double, double>> bounds_of(predicate_op op, double literal) {
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    switch (op) {
+        case predicate_op::eq: return std::pair(literal, literal);
+        case predicate_op::lt: return std::pair(-inf, std::nextafter(literal, -inf));
+        case predicate_op::le: return std::pair(-inf, literal);
+        case predicate_op::gt: return std::pair(std::nextafter(literal, inf), inf);
+        case predicate_op::ge: return std::pair(literal, inf);
+        default:               return std::nullopt;
+    }
+}
+
+} // anonymous namespace
+
+uint64_t range_mask(const double* column, std::size_t n, double lo, double hi) {
+    return kernel().fn(column, n, lo, hi);
+}
+
+const char* range_kernel_name() {
+    return kernel().name;
+}
+
+std::size_t range_engine::interval_hash::operator()(const interval& iv) const noexcept {
+    std::size_t h = std::hash<double>{}(iv.lo);
+    h = h * 31 + std::hash<double>{}(iv.hi);
+    return h * 31 + iv.column;
+}
+
+uint32_t range_engine::column_of(std::size_t slot) {
+    auto [it, added] = m_slot_columns.try_emplace(
+        slot, static_cast<uint32_t>(m_column_slots.size()));
+    if (added) m_column_slots.push_back(slot);
+    return it->second;
+}
+
+uint32_t range_engine::interval_of(uint32_t column, double lo, double hi) {
+    const interval iv{column, lo, hi};
+    auto [it, added] = m_interval_ids.try_emplace(iv, static_cast<uint32_t>(m_intervals.size()));
+    if (added) m_intervals.push_back(iv);
+    return it->second;
+}
+
+bool range_engine::add(uint64_t subscription_id, const expression_node& node,
+                       const attribute_schema& schema) {
+    std::span<const expression_node> predicates(&node, 1);
+    if (node.type == expression_node::kind::conjunction) predicates = node.children;
+
+    // Intersect all bounds on the same attribute first, so each expression
+    // tests at most one interval per column.
+    std::vector<std::pair<std::size_t, std::pair<double, double>>> bounds;
+    for (const auto& p : predicates) {
+        if (p.type != expression_node::kind::predicate || p.values.size() != 1) return false;
+        auto slot = schema.find(p.attribute);
+        if (!slot || slot->type != attribute_type::float_val) return false;
+
+        double literal = 0.0;
+        if (auto d = std::get_if<double>(&p.values.front())) {
+            literal = *d;
+        } else if (auto i = std::get_if<int64_t>(&p.values.front())) {
+            literal = static_cast<double>(*i);
+        } else {
+            return false;
+        }
+        auto b = bounds_of(p.op, literal);
+        if (!b) return false;
+
+        auto it = std::find_if(bounds.begin(), bounds.end(),
+                               [&](const auto& e) { return e.first == slot->index; });
+        if (it == bounds.end()) {
+            bounds.emplace_back(slot->index, *b);
+        } else {
+            it->second.first = std::max(it->second.first, b->first);
+            it->second.second = std::min(it->second.second, b->second);
+        }
+    }
+
+    for (const auto& [slot, b] : bounds) {
+        m_terms.push_back(interval_of(column_of(slot), b.first, b.second));
+    }
+    m_term_offsets.push_back(static_cast<uint32_t>(m_terms.size()));
+    m_ids.push_back(subscription_id);
+    return true;
+}
+
+void range_engine::evaluate(std::span<const decoded_event* const> events,
+                            range_batch& batch) const {
+    const std::size_t n = std::min(events.size(), k_max_events);
+    batch.masks.assign(m_ids.size(), 0);
+    batch.hits.clear();
+    if (n == 0 || m_ids.empty()) return;
+
+    // Transpose into columns. Missing values become NaN, which fails every
+    // comparison; padding past n keeps the vector loads in bounds.
+    batch.columns.assign(m_column_slots.size() * k_max_events,
+                         std::numeric_limits<double>::quiet_NaN());
+    for (std::size_t c = 0; c < m_column_slots.size(); ++c) {
+        double* column = batch.columns.data() + c * k_max_events;
+        const auto slot = m_column_slots[c];
+        for (std::size_t k = 0; k < n; ++k) {
+            if (events[k] && events[k]->has_value(slot)) column[k] = events[k]->real(slot);
+        }
+    }
+
+    batch.interval_masks.resize(m_intervals.size());
+    for (std::size_t i = 0; i < m_intervals.size(); ++i) {
+        const auto& iv = m_intervals[i];
+        batch.interval_masks[i] = range_mask(
+            batch.columns.data() + iv.column * k_max_events, n, iv.lo, iv.hi);
+    }
+
+    const uint64_t all = n == 64 ? ~uint64_t{0} : (uint64_t{1} << n) - 1;
+    for (std::size_t e = 0; e < m_ids.size(); ++e) {
+        uint64_t mask = all;
+        for (auto t = m_term_offsets[e]; t < m_term_offsets[e + 1] && mask; ++t) {
+            mask &= batch.interval_masks[m_terms[t]];
+        }
+        batch.masks[e] = mask;
+        if (mask) batch.hits.push_back(static_cast<uint32_t>(e));
+    }
+}
+
+void range_engine::append_matches(const range_batch& batch, std::size_t k,
+                                  std::vector<uint64_t>& out) const {
+    const uint64_t bit = uint64_t{1} << k;
+    for (auto e : batch.hits) {
+        if (batch.masks[e] & bit) out.push_back(m_ids[e]);
+    }
+}
+
+} // namespace sidecar
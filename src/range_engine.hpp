@@ -0,0 +1,82 @@
+#pragma once
+
+#include "attribute_schema.hpp"
+#include "decoded_event.hpp"
+#include "expression.hpp"
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace sidecar {
+
+// Per-worker buffers for range_engine::evaluate().
+struct range_batch {
+    std::vector<double> columns;          // one k_max_events column per attribute
+    std::vector<uint64_t> interval_masks; // one per distinct interval
+    std::vector<uint64_t> masks;          // one per expression
+    std::vector<uint32_t> hits;           // expressions matching any event
+};
+
+// Columnar matcher for conjunctions of numeric range predicates on float
+// attributes, e.g. `temperature > 30.0 AND pressure <= 2.5`. A micro-batch of
+// up to 64 decoded events is transposed into one column per attribute, each
+// distinct interval is tested against its column with a compare-and-mask
+// kernel, and expression results are the AND of their interval masks.
+class range_engine {
+public:
+    static constexpr std::size_t k_max_events = 64;
+
+    // Add an expression. Returns false, leaving the engine unchanged, unless
+    // it is a conjunction of `<float attribute> <op> <number>` predicates
+    // with op one of = < <= > >=.
+    bool add(uint64_t subscription_id, const expression_node& node,
+             const attribute_schema& schema);
+
+    // Evaluate all expressions against `events` (at most k_max_events; null
+    // entries never match). Bit k of batch.masks[i] is set when events[k]
+    // matches expression i.
+    void evaluate(std::span<const decoded_event* const> events, range_batch& batch) const;
+
+    // Append IDs of the expressions matched by event k of the last evaluate().
+    void append_matches(const range_batch& batch, std::size_t k,
+                        std::vector<uint64_t>& out) const;
+
+    std::size_t size() const { return m_ids.size(); }
+    bool empty() const { return m_ids.empty(); }
+
+private:
+    struct interval {
+        uint32_t column;
+        double lo;  // inclusive; strict bounds are stored as the next double
+        double hi;
+
+        bool operator==(const interval&) const = default;
+    };
+
+    struct interval_hash {
+        std::size_t operator()(const interval& iv) const noexcept;
+    };
+
+    uint32_t column_of(std::size_t slot);
+    uint32_t interval_of(uint32_t column, double lo, double hi);
+
+    std::vector<std::size_t> m_column_slots;  // column -> event slot
+    std::unordered_map<std::size_t, uint32_t> m_slot_columns;
+    std::vector<interval> m_intervals;
+    std::unordered_map<interval, uint32_t, interval_hash> m_interval_ids;
+    std::vector<uint64_t> m_ids;
+    // Expression i tests m_terms[m_term_offsets[i], m_term_offsets[i + 1]).
+    std::vector<uint32_t> m_terms;
+    std::vector<uint32_t> m_term_offsets{0};
+};
+
+// Bit k of the result is set when lo <= column[k] <= hi, for k < n. Reads the
+// column rounded up to the kernel width, so columns must be padded to 64.
+// Uses the widest kernel the CPU supports.
+uint64_t range_mask(const double* column, std::size_t n, double lo, double hi);
+
+// Name of the kernel range_mask() dispatches to: "avx512", "avx2" or "scalar".
+const char* range_kernel_name();
+
+} // namespace sidecar
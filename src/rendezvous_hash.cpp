@@ -0,0 +1,50 @@
+#include "rendezvous_hash.hpp"
+
+namespace sidecar {
+
+namespace {
+
+uint64_t fnv1a(std::string_view text) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : text) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// splitmix64 finalizer: spreads nearby IDs across the whole range.
+uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+} // anonymous namespace
+
+uint64_t rendezvous_weight(std::string_view member, uint64_t id) {
+    return mix(fnv1a(member) ^ mix(id + 0x9e3779b97f4a7c15ULL));
+}
+
+uint64_t rendezvous_key(std::string_view text) {
+    return mix(fnv1a(text));
+}
+
+const std::string* rendezvous_owner(std::span<const std::string> members, uint64_t id) {
+    const std::string* owner = nullptr;
+    uint64_t best = 0;
+    for (const auto& m : members) {
+        const auto w = rendezvous_weight(m, id);
+        // Ties are broken by name so the choice never depends on list order.
+        if (!owner || w > best || (w == best && m < *owner)) {
+            owner = &m;
+            best = w;
+        }
+    }
+    return owner;
+}
+
+} // namespace sidecar
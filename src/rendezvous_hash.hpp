@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace sidecar {
+
+// Highest-random-weight (rendezvous) hashing of keys onto shard members.
+// The same key and member list give the same owner on every instance, and
+// when a member joins or leaves only the keys it wins or held move.
+// The hash is fixed (FNV-1a plus a 64-bit finalizer), never std::hash, so
+// instances built by different toolchains agree.
+uint64_t rendezvous_weight(std::string_view member, uint64_t id);
+
+// Fixed 64-bit key for `text`, to hash onto members like an ID.
+uint64_t rendezvous_key(std::string_view text);
+
+// Member with the highest weight for `id`, or nullptr if `members` is empty.
+const std::string* rendezvous_owner(std::span<const std::string> members, uint64_t id);
+
+} // namespace sidecar
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace sidecar {
+
+// Puts results computed out of order back into input order. Every input is
+// numbered when it is admitted; its result is submitted under that sequence
+// number and released once every earlier sequence has been released.
+//
+// A missing sequence is given up (skipped) when the oldest result waiting
+// behind it has been held for `timeout`, or when holding a new result would
+// need more than `capacity` slots. A result whose sequence was already given
+// up is released right away, out of order, and counted as late.
+//
+// Not thread-safe: callers serialize access.
+template <typename T>
+class reorder_buffer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    reorder_buffer(std::size_t capacity, std::chrono::milliseconds timeout)
+        : m_slots(capacity > 0 ? capacity : 1), m_timeout(timeout) {}
+
+    // Hold `value` for `sequence`, then pass every result that is now in
+    // order to `release` (as T&&), lowest sequence first.
+    template <typename Release>
+    void submit(uint64_t sequence, T value, clock::time_point now, Release&& release) {
+        if (sequence < m_next) {
+            ++m_late;
+            release(std::move(value));
+            return;
+        }
+        if (sequence - m_next >= m_slots.size()) {
+            advance_to(sequence - m_slots.size() + 1, release);
+        }
+        auto& s = m_slots[sequence % m_slots.size()];
+        s.filled = true;
+        s.held_since = now;
+        s.value = std::move(value);
+        ++m_pending;
+        release_ready(release);
+        expire(now, release);
+    }
+
+    // Give up on missing sequences that have held a later result for longer
+    // than the timeout.
+    template <typename Release>
+    void expire(clock::time_point now, Release&& release) {
+        while (m_pending > 0) {
+            const auto first = first_held();
+            if (now - m_slots[first % m_slots.size()].held_since < m_timeout) return;
+            advance_to(first, release);
+            release_ready(release);
+        }
+    }
+
+    // Release everything held, skipping all gaps.
+    template <typename Release>
+    void flush(Release&& release) {
+        while (m_pending > 0) {
+            advance_to(first_held(), release);
+            release_ready(release);
+        }
+    }
+
+    // Sequence number the next in-order release needs.
+    uint64_t next() const { return m_next; }
+    std::size_t pending() const { return m_pending; }
+    uint64_t skipped() const { return m_skipped; }
+    uint64_t late() const { return m_late; }
+
+private:
+    struct slot {
+        bool filled = false;
+        clock::time_point held_since;
+        T value{};
+    };
+
+    // Lowest held sequence. Only valid while m_pending > 0.
+    uint64_t first_held() const {
+        uint64_t seq = m_next;
+        while (!m_slots[seq % m_slots.size()].filled) ++seq;
+        return seq;
+    }
+
+    // Move m_next up to `target`, releasing held results and skipping gaps.
+    template <typename Release>
+    void advance_to(uint64_t target, Release& release) {
+        for (; m_next < target; ++m_next) {
+            auto& s = m_slots[m_next % m_slots.size()];
+            if (!s.filled) {
+                ++m_skipped;
+                continue;
+            }
+            take(s, release);
+        }
+    }
+
+    template <typename Release>
+    void release_ready(Release& release) {
+        for (;; ++m_next) {
+            auto& s = m_slots[m_next % m_slots.size()];
+            if (!s.filled) return;
+            take(s, release);
+        }
+    }
+
+    template <typename Release>
+    void take(slot& s, Release& release) {
+        s.filled = false;
+        --m_pending;
+        release(std::move(s.value));
+        s.value = T{};
+    }
+
+    std::vector<slot> m_slots;  // ring indexed by sequence % capacity
+    std::chrono::milliseconds m_timeout;
+    uint64_t m_next = 0;
+    std::size_t m_pending = 0;
+    uint64_t m_skipped = 0;
+    uint64_t m_late = 0;
+};
+
+} // namespace sidecar
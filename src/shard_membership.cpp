@@ -0,0 +1,137 @@
+#include "shard_membership.hpp"
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/use_awaitable.hpp>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cctype>
+
+namespace sidecar {
+
+namespace {
+
+constexpr auto k_timeout = std::chrono::seconds(5);
+
+} // anonymous namespace
+
+shard_membership::shard_membership(asio::io_context& ioc,
+                                   nats_asio::iconnection_sptr conn,
+                                   subscription_manager& sub_mgr,
+                                   const std::string& bucket,
+                                   const std::string& member_id,
+                                   uint32_t interval_seconds,
+                                   std::shared_ptr<spdlog::logger> log)
+    : m_ioc(ioc), m_conn(std::move(conn)), m_sub_mgr(sub_mgr),
+      m_bucket(bucket), m_member_id(member_id),
+      m_key(std::string(k_key_prefix) + member_id),
+      m_interval_seconds(interval_seconds), m_log(std::move(log))
+{}
+
+shard_membership::~shard_membership() { stop(); }
+
+bool shard_membership::is_member_key(std::string_view key) {
+    return key.substr(0, k_key_prefix.size()) == k_key_prefix;
+}
+
+bool shard_membership::valid_member_id(std::string_view id) {
+    return !id.empty() && std::all_of(id.begin(), id.end(), [](unsigned char c) {
+        return std::isalnum(c) || c == '_' || c == '-';
+    });
+}
+
+asio::awaitable<bool> shard_membership::heartbeat() {
+    const std::string value = nlohmann::json{
+        {"version", 1},
+        {"member", m_member_id}
+    }.dump();
+    auto [revision, status] = co_await m_conn->kv_put(
+        m_bucket, m_key, std::span<const char>(value.data(), value.size()), k_timeout);
+    if (status.failed()) {
+        m_log->warn("shard_membership: heartbeat failed: {}", status.error());
+        co_return false;
+    }
+    co_return true;
+}
+
+asio::awaitable<bool> shard_membership::refresh_members() {
+    auto [keys, keys_status] = co_await m_conn->kv_keys(m_bucket, k_timeout);
+    if (keys_status.failed()) {
+        m_log->warn("shard_membership: failed to list members: {}", keys_status.error());
+        co_return false;
+    }
+
+    // Liveness uses the server-assigned write time, so only this host's
+    // clock has to roughly agree with the server, not every member's.
+    const auto now = std::chrono::system_clock::now();
+    const auto max_age = std::chrono::seconds(3 * m_interval_seconds);
+    std::vector<std::string> members;
+    for (const auto& key : keys) {
+        if (!is_member_key(key)) continue;
+        auto member = key.substr(k_key_prefix.size());
+        if (member == m_member_id) {
+            members.push_back(std::move(member));
+            continue;
+        }
+        auto [entry, status] = co_await m_conn->kv_get(m_bucket, key, k_timeout);
+        if (status.failed() || entry.op != nats_asio::kv_entry::operation::put) continue;
+        if (entry.created != std::chrono::system_clock::time_point{} &&
+            now - entry.created > max_age) {
+            continue;
+        }
+        members.push_back(std::move(member));
+    }
+    if (std::find(members.begin(), members.end(), m_member_id) == members.end()) {
+        members.push_back(m_member_id);
+    }
+
+    m_sub_mgr.set_shard_members(m_member_id, std::move(members));
+    co_return true;
+}
+
+asio::awaitable<void> shard_membership::membership_loop() {
+    while (!m_stopping.load(std::memory_order_acquire)) {
+        m_timer->expires_after(std::chrono::seconds(m_interval_seconds));
+        std::error_code ec;
+        co_await m_timer->async_wait(asio::redirect_error(asio::use_awaitable, ec));
+        if (m_stopping.load(std::memory_order_acquire) ||
+            ec == asio::error::operation_aborted) {
+            co_return;
+        }
+        if (ec) {
+            m_log->warn("shard_membership: timer failed: {}", ec.message());
+            continue;
+        }
+        co_await heartbeat();
+        co_await refresh_members();
+    }
+}
+
+asio::awaitable<bool> shard_membership::start() {
+    if (!co_await heartbeat()) co_return false;
+    if (!co_await refresh_members()) co_return false;
+
+    m_stopping.store(false, std::memory_order_release);
+    m_timer = std::make_unique<asio::steady_timer>(m_ioc);
+    asio::co_spawn(m_ioc, membership_loop(), asio::detached);
+    m_log->info("shard_membership: joined as '{}' (heartbeat every {}s)",
+                m_member_id, m_interval_seconds);
+    co_return true;
+}
+
+asio::awaitable<void> shard_membership::leave() {
+    auto [revision, status] = co_await m_conn->kv_delete(m_bucket, m_key, k_timeout);
+    if (status.failed()) {
+        m_log->warn("shard_membership: failed to leave: {}", status.error());
+    }
+}
+
+void shard_membership::stop() {
+    if (m_stopping.exchange(true, std::memory_order_acq_rel)) return;
+    if (m_timer) {
+        std::error_code ec;
+        m_timer->cancel(ec);
+    }
+}
+
+} // namespace sidecar
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "subscription_manager.hpp"
+#include <nats_asio/nats_asio.hpp>
+#include <asio/awaitable.hpp>
+#include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
+#include <spdlog/spdlog.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sidecar {
+
+// Shard membership through the lease bucket. Each instance writes a
+// heartbeat under `members.<member-id>` every interval; a member whose last
+// heartbeat is older than three intervals is considered gone. Whenever the
+// live set changes, the subscription manager re-slices ownership with
+// rendezvous hashing, so only subscriptions of the joining or leaving
+// member move.
+class shard_membership {
+public:
+    shard_membership(asio::io_context& ioc,
+                     nats_asio::iconnection_sptr conn,
+                     subscription_manager& sub_mgr,
+                     const std::string& bucket,
+                     const std::string& member_id,
+                     uint32_t interval_seconds,
+                     std::shared_ptr<spdlog::logger> log);
+
+    ~shard_membership();
+
+    // Register this member, load the live member set and start heartbeats.
+    // The lease bucket must already exist.
+    asio::awaitable<bool> start();
+
+    // Delete this member's key so peers take over its slice right away.
+    asio::awaitable<void> leave();
+
+    void stop();
+
+    // Keys under this prefix are membership records, not leases.
+    static constexpr std::string_view k_key_prefix = "members.";
+    static bool is_member_key(std::string_view key);
+
+    // Member IDs become KV key tokens: [A-Za-z0-9_-]+.
+    static bool valid_member_id(std::string_view id);
+
+private:
+    asio::awaitable<bool> heartbeat();
+    asio::awaitable<bool> refresh_members();
+    asio::awaitable<void> membership_loop();
+
+    asio::io_context& m_ioc;
+    nats_asio::iconnection_sptr m_conn;
+    subscription_manager& m_sub_mgr;
+    std::string m_bucket;
+    std::string m_member_id;
+    std::string m_key;
+    uint32_t m_interval_seconds;
+    std::shared_ptr<spdlog::logger> m_log;
+    std::unique_ptr<asio::steady_timer> m_timer;
+    std::atomic<bool> m_stopping{false};
+};
+
+} // namespace sidecar
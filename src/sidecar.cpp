@@ -1,23 +1,85 @@
 #include "sidecar.hpp"
 #include <nlohmann/json.hpp>
 #include <asio/detached.hpp>
+#include <asio/post.hpp>
 #include <asio/redirect_error.hpp>
 #include <asio/use_awaitable.hpp>
+#include <algorithm>
 #include <charconv>
+#include <functional>
+#include <random>
+#include <string_view>
 
 namespace sidecar {
 
+namespace {
+
+// Payloads batched per I/O thread before they are flushed regardless.
+constexpr std::size_t k_max_input_batch = 1024;
+
+// Hash of the dot-separated subject token at `index`, if there is one.
+std::optional<uint64_t> subject_token_hash(std::string_view subject, std::size_t index) {
+    for (std::size_t i = 0; i < index; ++i) {
+        const auto dot = subject.find('.');
+        if (dot == std::string_view::npos) return std::nullopt;
+        subject.remove_prefix(dot + 1);
+    }
+    return std::hash<std::string_view>{}(subject.substr(0, subject.find('.')));
+}
+
+// JSON reply to a failed request: `reason`, then the error message.
+std::string error_reply(std::string_view reason, const char* what) {
+    return nlohmann::json({{"error", std::string(reason) + ": " + what}}).dump();
+}
+
+// Reply to a subscribe request whose expression the parser or the a-tree
+// refused.
+std::string invalid_expression_reply(const char* what) {
+    return error_reply("Invalid expression", what);
+}
+
+} // anonymous namespace
+
 sidecar_engine::sidecar_engine(asio::io_context& ioc, const config& cfg,
-                               std::shared_ptr<spdlog::logger> log)
+                               std::shared_ptr<spdlog::logger> log,
+                               std::shared_ptr<worker_pool> pool)
     : m_ioc(ioc), m_cfg(cfg), m_log(std::move(log)),
-      m_sub_mgr(cfg.attributes, cfg.output_prefix, m_log),
-      m_schema(cfg.attributes)
-{}
+      m_sub_mgr(cfg.attributes, cfg.output_prefix, m_log, cfg.partition_attribute,
+                cfg.linear_match_threshold),
+      m_worker_pool(std::move(pool)),
+      m_partition_token(partition_key_subject_token(cfg.partition_key))
+{
+    if (m_worker_pool) m_pipeline = m_worker_pool->add_pipeline(m_cfg, m_sub_mgr);
+}
 
 asio::awaitable<void> sidecar_engine::start(nats_asio::iconnection_sptr conn) {
     m_conn = std::move(conn);
     m_shutting_down.store(false, std::memory_order_relaxed);
 
+    // A shard owns nothing until it has seen the member set, so subscriptions
+    // loaded below are only indexed once ownership is known.
+    if (!m_cfg.shard_id.empty()) m_sub_mgr.set_shard_members(m_cfg.shard_id, {});
+
+    // A local or peer snapshot lets matching resume before the lease bucket
+    // has been scanned; the lease manager then only reconciles the difference.
+    std::size_t loaded = 0;
+    if (!m_cfg.snapshot_path.empty()) {
+        loaded = m_sub_mgr.load_state(m_cfg.snapshot_path);
+    }
+    if (!m_cfg.snapshot_bucket.empty()) {
+        m_snapshot_exchange = std::make_unique<snapshot_exchange>(
+            m_ioc, m_conn, m_sub_mgr, m_cfg.snapshot_bucket,
+            m_cfg.snapshot_interval_seconds, m_log);
+        if (!co_await m_snapshot_exchange->ensure_bucket()) {
+            m_log->error("Snapshot bucket unavailable; refusing startup");
+            m_ioc.stop();
+            co_return;
+        }
+        if (loaded == 0) loaded = co_await m_snapshot_exchange->bootstrap();
+    }
+    const bool warm = loaded > 0;
+    if (warm && !co_await start_input()) co_return;
+
     // Provision/validate the lease bucket, start reconciliation, and restore
     // persisted subscriptions before accepting any input data.
     m_lease_mgr = std::make_unique<lease_manager>(
@@ -30,32 +92,22 @@ asio::awaitable<void> sidecar_engine::start(nats_asio::iconnection_sptr conn) {
         co_return;
     }
 
-    m_worker_pool = std::make_unique<worker_pool>(
-        m_ioc, m_cfg, m_schema, m_sub_mgr, m_conn, m_log);
-    m_worker_pool->start();
-
-    // Subscribe to the input data subject
-    nats_asio::subscribe_options data_opts;
-    if (!m_cfg.input_queue_group.empty()) {
-        data_opts.queue_group = m_cfg.input_queue_group;
+    if (!m_cfg.shard_id.empty()) {
+        m_shard = std::make_unique<shard_membership>(
+            m_ioc, m_conn, m_sub_mgr, m_cfg.lease_bucket, m_cfg.shard_id,
+            m_cfg.shard_heartbeat_seconds, m_log);
+        if (!co_await m_shard->start()) {
+            m_log->error("Shard membership failed to start; refusing startup");
+            m_ioc.stop();
+            co_return;
+        }
     }
 
-    auto [data_sub, data_status] = co_await m_conn->subscribe(
-        m_cfg.input_subject,
-        [this](auto subject, auto reply_to, auto payload) {
-            return on_data_message(subject, reply_to, payload);
-        },
-        data_opts
-    );
+    if (!warm && !co_await start_input()) co_return;
 
-    if (data_status.failed()) {
-        m_log->error("Failed to subscribe to input subject '{}': {}",
-                    m_cfg.input_subject, data_status.error());
-        m_ioc.stop();
-        co_return;
+    if (m_snapshot_exchange && m_cfg.snapshot_publisher) {
+        m_snapshot_exchange->start_publishing(*m_lease_mgr);
     }
-    m_data_sub = std::move(data_sub);
-    m_log->info("Subscribed to input subject '{}'", m_cfg.input_subject);
 
     // Subscribe to subscription control subject (request/reply)
     auto [sub_ctrl, sub_ctrl_status] = co_await m_conn->subscribe(
@@ -109,12 +161,121 @@ asio::awaitable<void> sidecar_engine::start(nats_asio::iconnection_sptr conn) {
     m_unsubscribe_sub = std::move(unsub_ctrl);
     m_log->info("Listening for unsubscribe requests on '{}'", m_cfg.unsubscribe_subject);
 
+    // Subscribe to the schema administration subject, if enabled
+    if (!m_cfg.admin_subject.empty()) {
+        auto [admin_ctrl, admin_ctrl_status] = co_await m_conn->subscribe(
+            m_cfg.admin_subject,
+            [this](auto subject, auto reply_to, auto payload) -> asio::awaitable<void> {
+                std::string subject_copy(subject);
+                std::optional<std::string> reply_copy;
+                if (reply_to) reply_copy = std::string(*reply_to);
+                std::vector<char> payload_copy(payload.begin(), payload.end());
+                asio::co_spawn(
+                    m_ioc,
+                    on_admin_request(std::move(subject_copy), std::move(reply_copy),
+                                     std::move(payload_copy)),
+                    asio::detached);
+                co_return;
+            }
+        );
+
+        if (admin_ctrl_status.failed()) {
+            m_log->error("Failed to subscribe to admin subject '{}': {}",
+                        m_cfg.admin_subject, admin_ctrl_status.error());
+            m_ioc.stop();
+            co_return;
+        }
+        m_admin_sub = std::move(admin_ctrl);
+        m_log->info("Listening for schema administration requests on '{}'", m_cfg.admin_subject);
+    }
+
     // Start stats reporting
     m_stats_timer = std::make_unique<asio::steady_timer>(m_ioc);
     asio::co_spawn(m_ioc, stats_loop(), asio::detached);
 
+    if (!m_cfg.snapshot_path.empty()) {
+        m_snapshot_timer = std::make_unique<asio::steady_timer>(m_ioc);
+        asio::co_spawn(m_ioc, snapshot_loop(), asio::detached);
+    }
+
     m_log->info("Sidecar engine started (format={}, {} attributes, output={}.<ID>)",
-               static_cast<int>(m_cfg.format), m_cfg.attributes.size(), m_cfg.output_prefix);
+               static_cast<int>(m_cfg.format), m_sub_mgr.schema()->size(), m_cfg.output_prefix);
+}
+
+void sidecar_engine::set_ingest_shards(std::vector<std::shared_ptr<io_shard>> shards) {
+    m_ingest_shards = std::move(shards);
+}
+
+asio::awaitable<bool> sidecar_engine::start_input() {
+    // A shared pool is started by its owner once every pipeline is added.
+    if (!m_worker_pool) {
+        m_worker_pool = std::make_shared<worker_pool>(
+            m_ioc, m_cfg, m_sub_mgr, m_conn, m_log);
+        m_worker_pool->start();
+    }
+
+    // Subscribe to the input data subject
+    nats_asio::subscribe_options data_opts;
+    data_opts.queue_group = input_queue_group();
+
+    if (!m_ingest_shards.empty()) {
+        for (auto& shard : m_ingest_shards) {
+            auto& batch = add_input_batch(shard->context());
+            bool ok = co_await shard->subscribe(
+                m_cfg.input_subject,
+                [this, &batch](auto subject, auto, auto payload) -> asio::awaitable<void> {
+                    on_data(batch, subject, payload);
+                    co_return;
+                },
+                data_opts);
+            if (!ok) {
+                m_log->error("Failed to subscribe to input subject '{}' on ingest shard {}",
+                            m_cfg.input_subject, shard->index());
+                m_ioc.stop();
+                co_return false;
+            }
+        }
+        m_log->info("Subscribed to input subject '{}' on {} ingest shard(s)",
+                   m_cfg.input_subject, m_ingest_shards.size());
+        co_return true;
+    }
+
+    auto& batch = add_input_batch(m_ioc);
+    auto [data_sub, data_status] = co_await m_conn->subscribe(
+        m_cfg.input_subject,
+        // nats_asio only takes awaitable callbacks; this one completes without
+        // suspending, and asio recycles its frame per thread.
+        [this, &batch](auto subject, auto, auto payload) -> asio::awaitable<void> {
+            on_data(batch, subject, payload);
+            co_return;
+        },
+        data_opts
+    );
+
+    if (data_status.failed()) {
+        m_log->error("Failed to subscribe to input subject '{}': {}",
+                    m_cfg.input_subject, data_status.error());
+        m_ioc.stop();
+        co_return false;
+    }
+    m_data_sub = std::move(data_sub);
+    m_log->info("Subscribed to input subject '{}'", m_cfg.input_subject);
+    co_return true;
+}
+
+std::optional<std::string> sidecar_engine::input_queue_group() const {
+    if (!m_cfg.input_queue_group.empty()) return m_cfg.input_queue_group;
+    // Without a configured group, a group private to this process splits
+    // the stream between its shards only; other instances still see all
+    // of it.
+    if (m_ingest_shards.size() < 2) return std::nullopt;
+    std::random_device rd;
+    const uint64_t tag = (uint64_t{rd()} << 32) | rd();
+    return "_sidecar_ingest." + std::to_string(tag);
+}
+
+sidecar_engine::input_batch& sidecar_engine::add_input_batch(asio::io_context& ctx) {
+    return *m_input_batches.emplace_back(std::make_unique<input_batch>(ctx));
 }
 
 void sidecar_engine::stop_workers() {
@@ -122,7 +283,10 @@ void sidecar_engine::stop_workers() {
     if (m_data_sub) m_data_sub->cancel();
     if (m_subscribe_sub) m_subscribe_sub->cancel();
     if (m_unsubscribe_sub) m_unsubscribe_sub->cancel();
+    if (m_admin_sub) m_admin_sub->cancel();
     if (m_lease_mgr) m_lease_mgr->stop();
+    if (m_snapshot_exchange) m_snapshot_exchange->stop();
+    if (m_shard) m_shard->stop();
     if (m_stats_timer) {
         std::error_code ec;
         m_stats_timer->cancel(ec);
@@ -130,9 +294,27 @@ void sidecar_engine::stop_workers() {
             m_log->debug("Failed to cancel stats timer: {}", ec.message());
         }
     }
+    if (m_snapshot_timer) {
+        std::error_code ec;
+        m_snapshot_timer->cancel(ec);
+    }
+    flush_pending_input();
     if (m_worker_pool) {
         m_worker_pool->stop();
     }
+    if (!m_cfg.snapshot_path.empty()) {
+        m_sub_mgr.save_state(m_cfg.snapshot_path);
+    }
+}
+
+void sidecar_engine::flush_pending_input() {
+    // Input threads have stopped by now, so pending batches are safe to
+    // flush from here.
+    for (auto& batch : m_input_batches) flush_input(*batch);
+}
+
+asio::awaitable<void> sidecar_engine::leave_shard() {
+    if (m_shard) co_await m_shard->leave();
 }
 
 asio::awaitable<bool> sidecar_engine::wait_for_publications(
@@ -141,26 +323,47 @@ asio::awaitable<bool> sidecar_engine::wait_for_publications(
     co_return co_await m_worker_pool->wait_for_publications(timeout);
 }
 
-asio::awaitable<void> sidecar_engine::on_data_message(
-    std::string_view /*subject*/,
-    std::optional<std::string_view> /*reply_to*/,
-    std::span<const char> payload)
-{
-    m_messages_received++;
+void sidecar_engine::on_data(input_batch& batch, std::string_view subject,
+                             std::span<const char> payload) {
+    m_messages_received.fetch_add(1, std::memory_order_relaxed);
 
     // Skip empty payloads
-    if (payload.empty()) co_return;
+    if (payload.empty()) return;
 
     if (!m_worker_pool) {
         m_log->warn("Received data before worker pool initialization; dropping payload");
-        co_return;
+        return;
     }
 
-    // Copy payload and enqueue for worker processing
-    std::vector<char> payload_copy(payload.begin(), payload.end());
-    if (!m_worker_pool->enqueue(std::move(payload_copy))) {
-        m_log->debug("Input queue full or stopping; dropped payload");
+    // Copy payload into a recycled buffer; the batch is enqueued once the
+    // current read has been parsed, or as soon as it is full.
+    auto& buffer = batch.payloads.emplace_back(m_worker_pool->acquire_buffer(payload.size()));
+    buffer.assign(payload.begin(), payload.end());
+    if (!m_cfg.partition_key.empty()) {
+        auto key = m_partition_token
+            ? subject_token_hash(subject, *m_partition_token)
+            : payload_key_hash(m_cfg.format, payload, m_cfg.partition_key);
+        // Messages without a key are spread over the workers in turn.
+        batch.keys.push_back(key ? *key : batch.unkeyed++);
+    }
+    if (batch.payloads.size() >= k_max_input_batch) {
+        flush_input(batch);
+    } else if (!batch.flush_posted) {
+        batch.flush_posted = true;
+        asio::post(batch.ctx, [this, &batch] { flush_input(batch); });
+    }
+}
+
+void sidecar_engine::flush_input(input_batch& batch) {
+    batch.flush_posted = false;
+    if (batch.payloads.empty() || !m_worker_pool) return;
+    const auto accepted = m_worker_pool->enqueue_bulk(m_pipeline, batch.payloads, batch.keys);
+    if (accepted < batch.payloads.size()) {
+        m_log->debug("Input queue full or stopping; dropped {} payload(s)",
+                     batch.payloads.size() - accepted);
     }
+    batch.payloads.clear();
+    batch.keys.clear();
 }
 
 asio::awaitable<void> sidecar_engine::on_subscribe_request(
@@ -209,9 +412,11 @@ asio::awaitable<void> sidecar_engine::on_subscribe_request(
         reply_str = reply.dump();
 
     } catch (const atree::Error& e) {
-        reply_str = nlohmann::json({{"error", std::string("Invalid expression: ") + e.what()}}).dump();
+        reply_str = invalid_expression_reply(e.what());
+    } catch (const expression_error& e) {
+        reply_str = invalid_expression_reply(e.what());
     } catch (const std::exception& e) {
-        reply_str = nlohmann::json({{"error", std::string("Bad request: ") + e.what()}}).dump();
+        reply_str = error_reply("Bad request", e.what());
     }
 
     auto s = co_await m_conn->publish(
@@ -254,7 +459,62 @@ asio::awaitable<void> sidecar_engine::on_unsubscribe_request(
         reply_str = nlohmann::json({{"id", sub_id}, {"removed", fully_removed}}).dump();
 
     } catch (const std::exception& e) {
-        reply_str = nlohmann::json({{"error", std::string("Bad request: ") + e.what()}}).dump();
+        reply_str = error_reply("Bad request", e.what());
+    }
+
+    if (!reply_subject.empty()) {
+        co_await m_conn->publish(
+            reply_subject,
+            std::span<const char>(reply_str.data(), reply_str.size()),
+            std::nullopt);
+    }
+}
+
+asio::awaitable<void> sidecar_engine::on_admin_request(
+    std::string /*subject*/,
+    std::optional<std::string> reply_to,
+    std::vector<char> payload)
+{
+    std::string reply_subject;
+    if (reply_to) reply_subject = std::string(*reply_to);
+
+    // Parse request: JSON { "action": "...", "name": "...", "type": "..." }
+    std::string reply_str;
+    try {
+        auto req = nlohmann::json::parse(
+            std::string_view(payload.data(), payload.size()));
+
+        std::string action = req.at("action").get<std::string>();
+        bool changed = false;
+        if (action == "add_attribute") {
+            std::string name = req.at("name").get<std::string>();
+            std::string type_str = req.at("type").get<std::string>();
+            auto type = parse_attribute_type(type_str);
+            if (!type) throw std::invalid_argument("invalid attribute type '" + type_str + "'");
+            changed = m_sub_mgr.add_attribute({std::move(name), *type});
+        } else if (action == "deprecate_attribute") {
+            changed = m_sub_mgr.deprecate_attribute(req.at("name").get<std::string>());
+        } else if (action != "list_attributes") {
+            throw std::invalid_argument("unknown action '" + action + "'");
+        }
+
+        const auto schema = m_sub_mgr.schema();
+        const auto deprecated = m_sub_mgr.deprecated_attributes();
+        auto attributes = nlohmann::json::array();
+        for (const auto& d : schema->defs) {
+            attributes.push_back({
+                {"name", d.name},
+                {"type", attribute_type_name(d.type)},
+                {"deprecated", std::find(deprecated.begin(), deprecated.end(), d.name) !=
+                                   deprecated.end()}
+            });
+        }
+        reply_str = nlohmann::json({{"changed", changed}, {"attributes", std::move(attributes)}}).dump();
+
+    } catch (const atree::Error& e) {
+        reply_str = error_reply("Invalid attribute", e.what());
+    } catch (const std::exception& e) {
+        reply_str = error_reply("Bad request", e.what());
     }
 
     if (!reply_subject.empty()) {
@@ -279,12 +539,15 @@ asio::awaitable<void> sidecar_engine::stats_loop() {
             co_return;
         }
 
-        auto ws = m_worker_pool ? m_worker_pool->get_stats() : worker_pool::stats{};
+        auto ws = m_worker_pool ? m_worker_pool->get_stats(m_pipeline) : worker_pool::stats{};
 
-        m_log->info("stats: received={} processed={} matched={} published={} "
+        m_log->info("stats{}: received={} processed={} matched={} published={} "
                     "match_failures={} publish_failures={} input_dropped={} "
                     "publish_tasks_dropped={} subscriptions={} queue_depth={} "
-                    "queue_bytes={} publish_inflight={}",
+                    "queue_bytes={} publish_inflight={} cache_hits={} cache_misses={} "
+                    "cache_entries={} cache_bytes={} stolen={} reorder_pending={} "
+                    "reorder_skipped={} reorder_late={}",
+                   m_cfg.name.empty() ? std::string() : "[" + m_cfg.name + "]",
                    m_messages_received.load(),
                    ws.processed,
                    ws.matched,
@@ -296,7 +559,32 @@ asio::awaitable<void> sidecar_engine::stats_loop() {
                    m_sub_mgr.active_count(),
                    ws.queue_depth,
                    ws.queue_bytes,
-                   ws.publish_inflight);
+                   ws.publish_inflight,
+                   ws.cache_hits,
+                   ws.cache_misses,
+                   ws.cache_entries,
+                   ws.cache_bytes,
+                   ws.stolen,
+                   ws.reorder_pending,
+                   ws.reorder_skipped,
+                   ws.reorder_late);
+    }
+}
+
+asio::awaitable<void> sidecar_engine::snapshot_loop() {
+    while (!m_shutting_down.load(std::memory_order_relaxed)) {
+        m_snapshot_timer->expires_after(std::chrono::seconds(m_cfg.snapshot_interval_seconds));
+        std::error_code ec;
+        co_await m_snapshot_timer->async_wait(asio::redirect_error(asio::use_awaitable, ec));
+        if (m_shutting_down.load(std::memory_order_relaxed) ||
+            ec == asio::error::operation_aborted) {
+            co_return;
+        }
+        if (ec) {
+            m_log->debug("snapshot loop timer error: {}", ec.message());
+            co_return;
+        }
+        m_sub_mgr.save_state(m_cfg.snapshot_path);
     }
 }
 
@@ -2,8 +2,11 @@
 
 #include "config.hpp"
 #include "event_bridge.hpp"
+#include "io_shard.hpp"
 #include "subscription_manager.hpp"
 #include "lease_manager.hpp"
+#include "shard_membership.hpp"
+#include "snapshot_exchange.hpp"
 #include "worker_pool.hpp"
 #include <nats_asio/nats_asio.hpp>
 #include <asio/awaitable.hpp>
@@ -20,27 +23,63 @@ struct sidecar_engine_test_access;
 
 class sidecar_engine {
 public:
+    // Serves the pipeline described by `cfg`. With a shared `pool`, the
+    // pipeline is registered with it here and the caller starts the pool;
+    // otherwise start() creates a private pool.
     sidecar_engine(asio::io_context& ioc, const config& cfg,
-                   std::shared_ptr<spdlog::logger> log);
+                   std::shared_ptr<spdlog::logger> log,
+                   std::shared_ptr<worker_pool> pool = nullptr);
+
+    // Read input data through these connections instead of the main one.
+    // With several shards they join one queue group, so each message is
+    // delivered to exactly one of them. Must be called before start().
+    void set_ingest_shards(std::vector<std::shared_ptr<io_shard>> shards);
 
     // Called once the NATS connection is established.
     // Sets up subscriptions (input + control) and starts the lease manager.
     asio::awaitable<void> start(nats_asio::iconnection_sptr conn);
 
-    // Stop the worker pool. Called during shutdown before ioc cleanup.
+    // Hand payloads still batched on the input connections to the worker
+    // pool. Input must have stopped. With a shared pool, call this on every
+    // engine before any of them calls stop_workers(), which closes the pool
+    // for all pipelines.
+    void flush_pending_input();
+
+    // Flush pending input and stop the worker pool. Called during shutdown
+    // before ioc cleanup.
     void stop_workers();
 
+    // Drop this instance from the shard member set, if sharding is enabled.
+    asio::awaitable<void> leave_shard();
+
     // Wait until every accepted output publication task has completed.
     asio::awaitable<bool> wait_for_publications(std::chrono::milliseconds timeout);
 
 private:
     friend struct sidecar_engine_test_access;
 
-    // Callback: incoming data message on the input subject
-    asio::awaitable<void> on_data_message(
-        std::string_view subject,
-        std::optional<std::string_view> reply_to,
-        std::span<const char> payload);
+    // Payloads received during one turn of an I/O thread. nats_asio invokes
+    // the callback once per message parsed from a socket read; the first
+    // message posts a flush that runs after the read handler returns, so
+    // each read reaches the worker pool as a single enqueue_bulk. Only
+    // touched on the thread running `ctx` (or after it has stopped).
+    struct input_batch {
+        explicit input_batch(asio::io_context& ctx) : ctx(ctx) {}
+        asio::io_context& ctx;
+        std::vector<std::vector<char>> payloads;
+        std::vector<uint64_t> keys;  // one per payload with partition_key set
+        uint64_t unkeyed = 0;        // spreads messages that carry no key
+        bool flush_posted = false;
+    };
+
+    // Incoming data message on the input subject. Synchronous: it only
+    // copies the payload into a recycled buffer (and reads its partition
+    // key) and adds it to `batch`, so the subscription callback wrapping it
+    // never suspends.
+    void on_data(input_batch& batch, std::string_view subject, std::span<const char> payload);
+
+    // Hand the batched payloads to the worker pool.
+    void flush_input(input_batch& batch);
 
     // Callback: subscription request from a client (request/reply pattern)
     asio::awaitable<void> on_subscribe_request(
@@ -54,9 +93,29 @@ private:
         std::optional<std::string> reply_to,
         std::vector<char> payload);
 
+    // Callback: schema administration request (add/deprecate/list attributes)
+    asio::awaitable<void> on_admin_request(
+        std::string subject,
+        std::optional<std::string> reply_to,
+        std::vector<char> payload);
+
+    // Start the worker pool and subscribe to the input subject.
+    asio::awaitable<bool> start_input();
+
+    // Queue group for the input subscription: the configured one, else a
+    // fresh one private to this process when several ingest shards share
+    // the stream.
+    std::optional<std::string> input_queue_group() const;
+
+    // Batch for an input connection whose callbacks run on `ctx`.
+    input_batch& add_input_batch(asio::io_context& ctx);
+
     // Periodic stats logging
     asio::awaitable<void> stats_loop();
 
+    // Periodic save of subscription state to cfg.snapshot_path
+    asio::awaitable<void> snapshot_loop();
+
     asio::io_context& m_ioc;
     config m_cfg;
     std::shared_ptr<spdlog::logger> m_log;
@@ -65,11 +124,18 @@ private:
     nats_asio::isubscription_sptr m_data_sub;
     nats_asio::isubscription_sptr m_subscribe_sub;
     nats_asio::isubscription_sptr m_unsubscribe_sub;
+    nats_asio::isubscription_sptr m_admin_sub;
     subscription_manager m_sub_mgr;
-    attribute_schema m_schema;
     std::unique_ptr<lease_manager> m_lease_mgr;
-    std::unique_ptr<worker_pool> m_worker_pool;
+    std::unique_ptr<snapshot_exchange> m_snapshot_exchange;
+    std::unique_ptr<shard_membership> m_shard;
+    std::vector<std::shared_ptr<io_shard>> m_ingest_shards;
+    std::vector<std::unique_ptr<input_batch>> m_input_batches;  // one per input connection
+    std::shared_ptr<worker_pool> m_worker_pool;
+    std::size_t m_pipeline = 0;  // index of this engine's queue in m_worker_pool
+    std::optional<std::size_t> m_partition_token;  // partition_key is subject:N
     std::unique_ptr<asio::steady_timer> m_stats_timer;
+    std::unique_ptr<asio::steady_timer> m_snapshot_timer;
 
     // Only m_messages_received is tracked here (at enqueue time).
     // All other stats come from worker_pool::get_stats().
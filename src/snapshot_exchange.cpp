@@ -0,0 +1,187 @@
+#include "snapshot_exchange.hpp"
+#include "kv_bucket.hpp"
+#include <asio/co_spawn.hpp>
+#include <asio/detached.hpp>
+#include <asio/redirect_error.hpp>
+#include <asio/use_awaitable.hpp>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+
+namespace sidecar {
+
+namespace {
+
+constexpr auto k_timeout = std::chrono::seconds(5);
+
+std::string chunk_key(uint64_t generation, std::size_t n) {
+    return "chunk." + std::to_string(generation) + "." + std::to_string(n);
+}
+
+} // anonymous namespace
+
+snapshot_exchange::snapshot_exchange(asio::io_context& ioc,
+                                     nats_asio::iconnection_sptr conn,
+                                     subscription_manager& sub_mgr,
+                                     const std::string& bucket,
+                                     uint32_t interval_seconds,
+                                     std::shared_ptr<spdlog::logger> log)
+    : m_ioc(ioc), m_conn(std::move(conn)), m_sub_mgr(sub_mgr),
+      m_bucket(bucket), m_interval_seconds(interval_seconds),
+      m_log(std::move(log))
+{}
+
+snapshot_exchange::~snapshot_exchange() { stop(); }
+
+asio::awaitable<bool> snapshot_exchange::ensure_bucket() {
+    // Only the latest value of each key is kept, forever; chunks of
+    // superseded generations are deleted by the publisher.
+    co_return co_await ensure_kv_bucket(m_conn, m_bucket, std::chrono::seconds(0),
+                                        *m_log, "snapshot_exchange");
+}
+
+asio::awaitable<std::size_t> snapshot_exchange::bootstrap() {
+    auto [manifest_entry, manifest_status] = co_await m_conn->kv_get(m_bucket, "latest", k_timeout);
+    if (manifest_status.failed()) {
+        if (manifest_status.code() != nats_asio::error_code::key_not_found) {
+            m_log->warn("snapshot_exchange: failed to read manifest: {}", manifest_status.error());
+        }
+        co_return 0;
+    }
+    if (manifest_entry.op != nats_asio::kv_entry::operation::put) co_return 0;
+
+    uint64_t generation = 0;
+    uint64_t revision = 0;
+    std::size_t chunks = 0;
+    std::size_t bytes = 0;
+    try {
+        auto manifest = nlohmann::json::parse(
+            std::string_view(manifest_entry.value.data(), manifest_entry.value.size()));
+        if (manifest.at("version").get<int>() != 1) {
+            throw std::runtime_error("unsupported version");
+        }
+        generation = manifest.at("generation").get<uint64_t>();
+        revision = manifest.at("revision").get<uint64_t>();
+        chunks = manifest.at("chunks").get<std::size_t>();
+        bytes = manifest.at("bytes").get<std::size_t>();
+    } catch (const std::exception& e) {
+        m_log->warn("snapshot_exchange: ignoring invalid manifest: {}", e.what());
+        co_return 0;
+    }
+
+    std::string state;
+    state.reserve(bytes);
+    for (std::size_t n = 0; n < chunks; ++n) {
+        auto [chunk, status] = co_await m_conn->kv_get(m_bucket, chunk_key(generation, n), k_timeout);
+        if (status.failed() || chunk.op != nats_asio::kv_entry::operation::put) {
+            // Superseded while we were reading; fall back to the lease scan.
+            m_log->warn("snapshot_exchange: generation {} incomplete at chunk {}", generation, n);
+            co_return 0;
+        }
+        state.append(chunk.value.data(), chunk.value.size());
+    }
+    if (state.size() != bytes) {
+        m_log->warn("snapshot_exchange: generation {} has {} bytes, expected {}",
+                    generation, state.size(), bytes);
+        co_return 0;
+    }
+
+    std::size_t loaded = 0;
+    try {
+        loaded = m_sub_mgr.restore_state(state);
+    } catch (const std::exception& e) {
+        m_log->warn("snapshot_exchange: ignoring unreadable state: {}", e.what());
+        co_return 0;
+    }
+    m_log->info("snapshot_exchange: loaded {} subscription(s) from generation {} "
+                "(lease revision {}, {} bytes)", loaded, generation, revision, bytes);
+    co_return loaded;
+}
+
+asio::awaitable<bool> snapshot_exchange::publish() {
+    const auto changes = m_sub_mgr.change_count();
+    if (m_published && changes == m_published_changes) co_return true;
+
+    const auto revision = m_leases ? m_leases->revision() : 0;
+    const auto state = m_sub_mgr.encode_state();
+    const auto generation = std::max<uint64_t>(
+        m_generation + 1,
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+
+    const std::size_t chunks = (state.size() + k_chunk_bytes - 1) / k_chunk_bytes;
+    for (std::size_t n = 0; n < chunks; ++n) {
+        const auto offset = n * k_chunk_bytes;
+        const auto size = std::min(k_chunk_bytes, state.size() - offset);
+        auto [rev, status] = co_await m_conn->kv_put(
+            m_bucket, chunk_key(generation, n),
+            std::span<const char>(state.data() + offset, size), k_timeout);
+        if (status.failed()) {
+            m_log->warn("snapshot_exchange: failed to write chunk {}: {}", n, status.error());
+            co_return false;
+        }
+    }
+
+    // The manifest is written last, so readers never see a partial generation.
+    const std::string manifest = nlohmann::json{
+        {"version", 1},
+        {"generation", generation},
+        {"revision", revision},
+        {"chunks", chunks},
+        {"bytes", state.size()}
+    }.dump();
+    auto [rev, status] = co_await m_conn->kv_put(
+        m_bucket, "latest", std::span<const char>(manifest.data(), manifest.size()), k_timeout);
+    if (status.failed()) {
+        m_log->warn("snapshot_exchange: failed to write manifest: {}", status.error());
+        co_return false;
+    }
+
+    if (m_published) {
+        for (std::size_t n = 0; n < m_chunks; ++n) {
+            co_await m_conn->kv_delete(m_bucket, chunk_key(m_generation, n), k_timeout);
+        }
+    }
+    m_generation = generation;
+    m_chunks = chunks;
+    m_published_changes = changes;
+    m_published = true;
+    m_log->debug("snapshot_exchange: published generation {} ({} bytes, lease revision {})",
+                 generation, state.size(), revision);
+    co_return true;
+}
+
+asio::awaitable<void> snapshot_exchange::publish_loop() {
+    while (!m_stopping.load(std::memory_order_acquire)) {
+        co_await publish();
+
+        m_publish_timer->expires_after(std::chrono::seconds(m_interval_seconds));
+        std::error_code ec;
+        co_await m_publish_timer->async_wait(asio::redirect_error(asio::use_awaitable, ec));
+        if (m_stopping.load(std::memory_order_acquire) ||
+            ec == asio::error::operation_aborted) {
+            co_return;
+        }
+        if (ec) {
+            m_log->warn("snapshot_exchange: publish timer failed: {}", ec.message());
+        }
+    }
+}
+
+void snapshot_exchange::start_publishing(const lease_manager& leases) {
+    m_leases = &leases;
+    m_stopping.store(false, std::memory_order_release);
+    m_publish_timer = std::make_unique<asio::steady_timer>(m_ioc);
+    asio::co_spawn(m_ioc, publish_loop(), asio::detached);
+    m_log->info("snapshot_exchange: publishing state to '{}' every {}s",
+                m_bucket, m_interval_seconds);
+}
+
+void snapshot_exchange::stop() {
+    if (m_stopping.exchange(true, std::memory_order_acq_rel)) return;
+    if (m_publish_timer) {
+        std::error_code ec;
+        m_publish_timer->cancel(ec);
+    }
+}
+
+} // namespace sidecar
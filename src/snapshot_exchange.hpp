@@ -0,0 +1,74 @@
+#pragma once
+
+#include "lease_manager.hpp"
+#include "subscription_manager.hpp"
+#include <nats_asio/nats_asio.hpp>
+#include <asio/awaitable.hpp>
+#include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
+#include <spdlog/spdlog.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace sidecar {
+
+// Shares compacted subscription state between sidecar instances through a
+// JetStream KV bucket, so a new instance can load every subscription with a
+// handful of reads instead of one kv_get per lease.
+//
+// Key layout: `latest` holds a JSON manifest {version, generation, revision,
+// chunks, bytes}; the encoded state is split across `chunk.<generation>.<n>`
+// keys to stay below the server's maximum payload. `revision` is the lease
+// bucket revision the state reflects; it is only logged. A reader that
+// bootstraps from it still runs the lease restore, which lists every lease
+// key, fetches only the ones the blob does not already hold, and drops held
+// leases whose key has since expired.
+class snapshot_exchange {
+public:
+    static constexpr std::size_t k_chunk_bytes = 512 * 1024;
+
+    snapshot_exchange(asio::io_context& ioc,
+                      nats_asio::iconnection_sptr conn,
+                      subscription_manager& sub_mgr,
+                      const std::string& bucket,
+                      uint32_t interval_seconds,
+                      std::shared_ptr<spdlog::logger> log);
+
+    ~snapshot_exchange();
+
+    // Create the bucket if it does not exist, or check that the existing one
+    // keeps one value per key.
+    asio::awaitable<bool> ensure_bucket();
+
+    // Load the most recently published state. Returns the number of
+    // subscriptions loaded; 0 when nothing was published or it is unreadable.
+    asio::awaitable<std::size_t> bootstrap();
+
+    // Publish the current state now and then every interval while it keeps
+    // changing, tagged with the revision of `leases`.
+    void start_publishing(const lease_manager& leases);
+
+    void stop();
+
+private:
+    asio::awaitable<bool> publish();
+    asio::awaitable<void> publish_loop();
+
+    asio::io_context& m_ioc;
+    nats_asio::iconnection_sptr m_conn;
+    subscription_manager& m_sub_mgr;
+    std::string m_bucket;
+    uint32_t m_interval_seconds;
+    std::shared_ptr<spdlog::logger> m_log;
+    const lease_manager* m_leases = nullptr;
+    std::unique_ptr<asio::steady_timer> m_publish_timer;
+    uint64_t m_generation = 0;       // generation of the last published blob
+    std::size_t m_chunks = 0;        // chunk count of the last published blob
+    uint64_t m_published_changes = 0;
+    bool m_published = false;
+    std::atomic<bool> m_stopping{false};
+};
+
+} // namespace sidecar
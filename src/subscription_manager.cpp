@@ -1,4 +1,15 @@
 #include "subscription_manager.hpp"
+#include "cpu_affinity.hpp"
+#include "rendezvous_hash.hpp"
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <future>
+#include <stdexcept>
+#include <thread>
 
 namespace sidecar {
 
@@ -20,49 +31,365 @@ static atree::Tree build_tree(const std::vector<attribute_def>& attributes) {
 subscription_manager::subscription_manager(
     const std::vector<attribute_def>& attributes,
     const std::string& output_prefix,
-    std::shared_ptr<spdlog::logger> log)
+    std::shared_ptr<spdlog::logger> log,
+    const std::string& partition_attribute,
+    std::size_t linear_match_threshold)
     : m_log(std::move(log)),
-      m_attributes(attributes),
-      m_output_prefix(output_prefix)
+      m_schema(std::make_shared<const attribute_schema>(attributes)),
+      m_accepting(attributes),
+      m_partition_attribute(partition_attribute),
+      m_output_prefix(output_prefix),
+      m_linear_match_threshold(linear_match_threshold)
 {
+    if (!partition_attribute.empty()) {
+        m_partition_slot = m_schema->find(partition_attribute);
+        if (!m_partition_slot ||
+            (m_partition_slot->type != attribute_type::string &&
+             m_partition_slot->type != attribute_type::integer)) {
+            throw std::runtime_error("partition attribute '" + partition_attribute +
+                                     "' must be a declared string or integer attribute");
+        }
+    }
+
     // Publish an initial empty snapshot
     publish_snapshot();
 }
 
-void subscription_manager::publish_snapshot() {
-    // Build a fresh tree and insert all current expressions
-    auto tree = std::make_shared<atree::Tree>(build_tree(m_attributes));
-    for (const auto& [id, sub] : m_subscriptions) {
-        tree->insert(id, sub.expression);
+void subscription_manager::mark_dirty(const route& r) {
+    switch (r.type) {
+        case route::kind::equality:  break;
+        case route::kind::range:     m_ranges_dirty = true; break;
+        case route::kind::residual:  m_residual_dirty = true; break;
+        case route::kind::partition: m_dirty_partitions.insert(r.partition); break;
+    }
+}
+
+void subscription_manager::validate(const std::string& expression,
+                                    const std::optional<expression_node>& parsed) const {
+    if (parsed) validate_expression(*parsed, m_accepting);
+
+    // The a-tree has the final word; a single-expression tree costs the same
+    // whatever the number of active subscriptions.
+    auto tree = build_tree(m_accepting.defs);
+    tree.insert(0, expression);
+}
+
+std::optional<expression_node> subscription_manager::parse_canonical(
+    const std::string& expression) const {
+    auto parsed = parse_expression(expression);
+    if (parsed) canonicalize(*parsed, *m_schema);
+    return parsed;
+}
+
+std::string subscription_manager::dedup_key(const std::string& expression,
+                                            const std::optional<expression_node>& parsed) {
+    return parsed ? format_expression(*parsed) : expression;
+}
+
+std::string subscription_manager::dedup_key(uint64_t id) const {
+    return dedup_key(m_subscriptions.at(id).expression, m_parsed.at(id));
+}
+
+void subscription_manager::index_expression(const std::string& key, uint64_t id) {
+    auto [it, inserted] = m_expr_to_id.emplace(key, id);
+    if (!inserted) m_equivalents[key].push_back(id);
+}
+
+void subscription_manager::unindex_expression(const std::string& key, uint64_t id) {
+    auto eq = m_equivalents.find(key);
+    auto it = m_expr_to_id.find(key);
+    if (it != m_expr_to_id.end() && it->second == id) {
+        if (eq == m_equivalents.end()) {
+            m_expr_to_id.erase(it);
+            return;
+        }
+        it->second = eq->second.front();
+        eq->second.erase(eq->second.begin());
+    } else if (eq != m_equivalents.end()) {
+        std::erase(eq->second, id);
+    } else {
+        return;
     }
+    if (eq->second.empty()) m_equivalents.erase(eq);
+}
+
+bool subscription_manager::indexed_verbatim(const std::string& key,
+                                            const std::string& expression) const {
+    auto it = m_expr_to_id.find(key);
+    if (it == m_expr_to_id.end()) return false;
+    if (m_subscriptions.at(it->second).expression == expression) return true;
+    auto eq = m_equivalents.find(key);
+    return eq != m_equivalents.end() &&
+           std::any_of(eq->second.begin(), eq->second.end(), [&](uint64_t id) {
+               return m_subscriptions.at(id).expression == expression;
+           });
+}
+
+bool subscription_manager::owns(uint64_t id) const {
+    if (!m_sharded) return true;
+    // Hash the canonical expression, not the ID: IDs are assigned by each
+    // instance and may differ between them.
+    auto owner = rendezvous_owner(m_shard_members, rendezvous_key(dedup_key(id)));
+    return owner && *owner == m_shard_self;
+}
+
+void subscription_manager::add_parsed(uint64_t id, std::optional<expression_node> parsed_expr) {
+    m_parsed[id] = std::move(parsed_expr);
+    if (owns(id)) add_route(id);
+}
+
+void subscription_manager::add_route(uint64_t id) {
+    const auto& parsed = m_parsed.at(id);
+    route r;
+    if (parsed) {
+        if (auto terms = equality_terms(*parsed, *m_schema)) {
+            r.type = route::kind::equality;
+            r.terms = std::move(*terms);
+        } else if (range_engine probe; probe.add(id, *parsed, *m_schema)) {
+            r.type = route::kind::range;
+        } else if (m_partition_slot) {
+            if (auto key = pinned_value_key(*parsed, *m_schema, *m_partition_slot)) {
+                r.type = route::kind::partition;
+                r.partition = std::move(*key);
+            }
+        }
+    }
+    mark_dirty(r);
+    m_routes[id] = std::move(r);
+}
+
+void subscription_manager::remove_parsed(uint64_t id) {
+    auto it = m_routes.find(id);
+    if (it != m_routes.end()) {
+        mark_dirty(it->second);
+        m_routes.erase(it);
+    }
+    m_parsed.erase(id);
+}
+
+static bool node_references(const expression_node& node, const std::string& name) {
+    if (node.type == expression_node::kind::predicate) return node.attribute == name;
+    return std::any_of(node.children.begin(), node.children.end(),
+                       [&](const auto& child) { return node_references(child, name); });
+}
+
+static bool is_identifier_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool subscription_manager::references(uint64_t id, const std::string& name) const {
+    if (const auto& parsed = m_parsed.at(id)) return node_references(*parsed, name);
+
+    // Opaque expression: any whole-word occurrence counts, even inside a
+    // string literal, which only delays retirement.
+    const auto& text = m_subscriptions.at(id).expression;
+    for (auto pos = text.find(name); pos != std::string::npos; pos = text.find(name, pos + 1)) {
+        const auto end = pos + name.size();
+        if ((pos == 0 || !is_identifier_char(text[pos - 1])) &&
+            (end == text.size() || !is_identifier_char(text[end]))) {
+            return true;
+        }
+    }
+    return false;
+}
 
+void subscription_manager::refresh_accepting() {
+    std::vector<attribute_def> accepting;
+    for (const auto& d : m_schema->defs) {
+        if (!m_deprecated.count(d.name)) accepting.push_back(d);
+    }
+    m_accepting = attribute_schema(accepting);
+}
+
+void subscription_manager::set_schema(std::vector<attribute_def> defs) {
+    m_schema = std::make_shared<const attribute_schema>(defs);
+    if (!m_partition_attribute.empty()) m_partition_slot = m_schema->find(m_partition_attribute);
+    refresh_accepting();
+
+    // Slot indices may have moved, so every route is recomputed and every
+    // tree rebuilt with the new attribute list: none of the previous
+    // snapshot's trees can be reused.
+    m_routes.clear();
+    for (const auto& [id, parsed] : m_parsed) {
+        if (owns(id)) add_route(id);
+    }
+    m_rebuild_all = true;
+}
+
+bool subscription_manager::retire_deprecated() {
+    std::vector<std::string> retired;
+    for (const auto& name : m_deprecated) {
+        const bool used = std::any_of(m_subscriptions.begin(), m_subscriptions.end(),
+                                      [&](const auto& entry) { return references(entry.first, name); });
+        if (!used) retired.push_back(name);
+    }
+    if (retired.empty()) return false;
+
+    std::vector<attribute_def> defs;
+    for (const auto& d : m_schema->defs) {
+        if (std::find(retired.begin(), retired.end(), d.name) == retired.end()) defs.push_back(d);
+    }
+    for (const auto& name : retired) {
+        m_deprecated.erase(name);
+        m_retired.insert(name);
+        m_log->info("Removed deprecated attribute '{}' from the schema", name);
+    }
+    set_schema(std::move(defs));
+    return true;
+}
+
+std::shared_ptr<const atree::Tree> subscription_manager::build_expressions(
+    const std::vector<uint64_t>& ids) const {
+    auto tree = std::make_shared<atree::Tree>(build_tree(m_schema->defs));
+    for (auto id : ids) {
+        tree->insert(id, m_subscriptions.at(id).expression);
+    }
+    return tree;
+}
+
+std::shared_ptr<const tree_snapshot> subscription_manager::build_snapshot(
+    const tree_snapshot* prev, uint64_t version) const {
     auto snap = std::make_shared<tree_snapshot>();
-    snap->tree = std::move(tree);
+    snap->schema = m_schema;
+    snap->partition_slot = m_partition_slot;
+
+    // Route every expression: pure equality conjunctions to the hash index,
+    // float range conjunctions to the columnar range engine, expressions
+    // pinning the partition attribute to their partition tree,
+    // everything else to the residual tree.
+    std::vector<uint64_t> residual;
+    std::unordered_map<std::string, std::vector<uint64_t>> pinned;
+    const bool reuse_ranges = prev && !m_ranges_dirty;
+    auto ranges = reuse_ranges ? nullptr : std::make_shared<range_engine>();
+    for (const auto& [id, r] : m_routes) {
+        switch (r.type) {
+            case route::kind::equality:
+                snap->equality.add(id, r.terms);
+                break;
+            case route::kind::range:
+                if (ranges) ranges->add(id, *m_parsed.at(id), *m_schema);
+                break;
+            case route::kind::residual: {
+                const auto& parsed = m_parsed.at(id);
+                snap->prefilter.add(parsed ? &*parsed : nullptr, *m_schema);
+                residual.push_back(id);
+                break;
+            }
+            case route::kind::partition:
+                pinned[r.partition].push_back(id);
+                break;
+        }
+    }
+    snap->prefilter.seal();
+    snap->ranges = reuse_ranges ? prev->ranges : std::move(ranges);
+
+    snap->tree = (m_residual_dirty || !prev) ? build_expressions(residual) : prev->tree;
+    snap->tree_size = residual.size();
+
+    // Few residual expressions: evaluate them directly if they all compile.
+    if (!residual.empty() && residual.size() < m_linear_match_threshold) {
+        for (auto id : residual) {
+            const auto& parsed = m_parsed.at(id);
+            if (!parsed || !snap->linear.add(id, *parsed, *m_schema)) {
+                snap->linear = linear_matcher{};
+                break;
+            }
+        }
+    }
+
+    // Reuse unchanged partition trees; rebuild the changed ones in parallel.
+    std::vector<const std::pair<const std::string, std::vector<uint64_t>>*> rebuild;
+    for (const auto& entry : pinned) {
+        if (prev && !m_dirty_partitions.count(entry.first)) {
+            auto it = prev->partitions.find(entry.first);
+            if (it != prev->partitions.end()) {
+                snap->partitions.emplace(entry.first, it->second);
+                continue;
+            }
+        }
+        rebuild.push_back(&entry);
+    }
+
+    const std::size_t width = std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t begin = 0; begin < rebuild.size(); begin += width) {
+        const auto end = std::min(rebuild.size(), begin + width);
+        std::vector<std::future<std::shared_ptr<const atree::Tree>>> builds;
+        for (auto k = begin; k < end; ++k) {
+            builds.push_back(std::async(
+                end - begin > 1 ? std::launch::async : std::launch::deferred,
+                [this, ids = &rebuild[k]->second] { return build_expressions(*ids); }));
+        }
+        for (auto k = begin; k < end; ++k) {
+            const auto& [key, ids] = *rebuild[k];
+            snap->partitions.emplace(key, tree_partition{builds[k - begin].get(), ids.size()});
+        }
+    }
+
+    snap->version = version;
     snap->active_count = m_subscriptions.size();
 
-    for (const auto& [id, sub] : m_subscriptions) {
+    for (const auto& [id, r] : m_routes) {
         snap->output_subjects[id] = m_output_prefix + "." + std::to_string(id);
     }
+    return snap;
+}
 
-    m_snapshot.store(std::shared_ptr<const tree_snapshot>(std::move(snap)),
-                     std::memory_order_release);
+void subscription_manager::publish_snapshot() {
+    const auto version = ++m_snapshot_version;
+    if (m_replica_nodes.empty()) {
+        auto prev = m_rebuild_all ? nullptr : m_snapshot.load(std::memory_order_acquire);
+        m_snapshot.store(build_snapshot(prev.get(), version), std::memory_order_release);
+    } else {
+        // Each replica is built (and so first touched) by a thread pinned to
+        // its node; threads it spawns for partition trees inherit the pin.
+        auto slot = [this](std::size_t node) -> std::atomic<std::shared_ptr<const tree_snapshot>>& {
+            return node == 0 ? m_snapshot : m_replicas[node - 1];
+        };
+        std::vector<std::future<std::shared_ptr<const tree_snapshot>>> builds;
+        for (std::size_t node = 0; node < m_replica_nodes.size(); ++node) {
+            auto prev = m_rebuild_all ? nullptr : slot(node).load(std::memory_order_acquire);
+            builds.push_back(std::async(std::launch::async, [this, node, prev, version] {
+                pin_current_thread(m_replica_nodes[node]);
+                return build_snapshot(prev.get(), version);
+            }));
+        }
+        std::vector<std::shared_ptr<const tree_snapshot>> built;
+        for (auto& b : builds) built.push_back(b.get());
+        for (std::size_t node = 0; node < built.size(); ++node) {
+            slot(node).store(std::move(built[node]), std::memory_order_release);
+        }
+    }
+    m_residual_dirty = false;
+    m_ranges_dirty = false;
+    m_dirty_partitions.clear();
+    m_rebuild_all = false;
 }
 
 uint64_t subscription_manager::subscribe(const std::string& expression,
                                          const std::string& client_id) {
     std::lock_guard<std::mutex> lock(m_write_mutex);
 
-    // Check if expression already exists — lease-only change, no snapshot publish
-    auto it = m_expr_to_id.find(expression);
+    // Check if an equivalent expression already exists — lease-only change,
+    // no snapshot publish
+    auto parsed = parse_canonical(expression);
+    const auto key = dedup_key(expression, parsed);
+    auto it = m_expr_to_id.find(key);
     if (it != m_expr_to_id.end()) {
         auto& sub = m_subscriptions[it->second];
+        // A new holder must not keep a deprecated attribute alive; current
+        // holders may still refresh their lease.
+        if (!m_deprecated.empty() && !sub.lease_holders.contains(client_id)) {
+            validate(expression, parsed);
+        }
         sub.lease_holders.insert(client_id);
+        ++m_changes;
         m_log->info("Reused subscription {} for expression '{}', client '{}'",
                    it->second, expression, client_id);
         return it->second;
     }
 
-    // New expression — build tree first to validate (throws before maps are modified)
+    // New expression — validate before touching any state
+    validate(expression, parsed);
     uint64_t id = m_next_id++;
 
     // Temporarily add to maps to include in rebuild
@@ -72,18 +399,21 @@ uint64_t subscription_manager::subscribe(const std::string& expression,
     info.lease_holders.insert(client_id);
 
     m_subscriptions[id] = std::move(info);
-    m_expr_to_id[expression] = id;
+    m_expr_to_id[key] = id;
+    add_parsed(id, std::move(parsed));
 
     try {
         publish_snapshot();
     } catch (...) {
-        // Rollback maps if tree rebuild fails (invalid expression)
+        // Rollback maps if the rebuild still fails
         m_subscriptions.erase(id);
-        m_expr_to_id.erase(expression);
+        m_expr_to_id.erase(key);
+        remove_parsed(id);
         m_next_id--;
         throw;
     }
 
+    ++m_changes;
     m_log->info("New subscription {} for expression '{}', client '{}'",
                id, expression, client_id);
     return id;
@@ -94,33 +424,39 @@ bool subscription_manager::restore(uint64_t subscription_id,
                                    const std::string& client_id) {
     std::lock_guard<std::mutex> lock(m_write_mutex);
 
-    auto expr_it = m_expr_to_id.find(expression);
-    if (expr_it != m_expr_to_id.end()) {
-        if (expr_it->second != subscription_id) return false;
-        m_subscriptions.at(subscription_id).lease_holders.insert(client_id);
+    auto parsed = parse_canonical(expression);
+    const auto key = dedup_key(expression, parsed);
+    auto id_it = m_subscriptions.find(subscription_id);
+    if (id_it != m_subscriptions.end()) {
+        if (dedup_key(subscription_id) != key) return false;
+        id_it->second.lease_holders.insert(client_id);
         m_next_id = std::max(m_next_id, subscription_id + 1);
+        ++m_changes;
         return true;
     }
+    if (indexed_verbatim(key, expression)) return false;
 
-    auto id_it = m_subscriptions.find(subscription_id);
-    if (id_it != m_subscriptions.end()) return false;
+    validate(expression, parsed);
 
     subscription_info info;
     info.id = subscription_id;
     info.expression = expression;
     info.lease_holders.insert(client_id);
     m_subscriptions.emplace(subscription_id, std::move(info));
-    m_expr_to_id.emplace(expression, subscription_id);
+    index_expression(key, subscription_id);
+    add_parsed(subscription_id, std::move(parsed));
 
     try {
         publish_snapshot();
     } catch (...) {
+        unindex_expression(key, subscription_id);
         m_subscriptions.erase(subscription_id);
-        m_expr_to_id.erase(expression);
+        remove_parsed(subscription_id);
         throw;
     }
 
     m_next_id = std::max(m_next_id, subscription_id + 1);
+    ++m_changes;
     return true;
 }
 
@@ -131,14 +467,16 @@ bool subscription_manager::remove_lease(uint64_t subscription_id,
     auto it = m_subscriptions.find(subscription_id);
     if (it == m_subscriptions.end()) return false;
 
-    it->second.lease_holders.erase(client_id);
+    if (it->second.lease_holders.erase(client_id)) ++m_changes;
 
     if (it->second.lease_holders.empty()) {
         // No more clients — remove subscription and publish new snapshot
-        m_expr_to_id.erase(it->second.expression);
+        unindex_expression(dedup_key(subscription_id), subscription_id);
         m_log->info("Removed subscription {} (expression '{}') - no active leases",
                    subscription_id, it->second.expression);
         m_subscriptions.erase(it);
+        remove_parsed(subscription_id);
+        retire_deprecated();
         publish_snapshot();
         return true;
     }
@@ -154,10 +492,13 @@ bool subscription_manager::remove_subscription(uint64_t subscription_id) {
     auto it = m_subscriptions.find(subscription_id);
     if (it == m_subscriptions.end()) return false;
 
-    m_expr_to_id.erase(it->second.expression);
+    unindex_expression(dedup_key(subscription_id), subscription_id);
+    ++m_changes;
     m_log->info("Force-removed subscription {} (expression '{}')",
                subscription_id, it->second.expression);
     m_subscriptions.erase(it);
+    remove_parsed(subscription_id);
+    retire_deprecated();
     publish_snapshot();
     return true;
 }
@@ -171,15 +512,308 @@ std::optional<subscription_info> subscription_manager::get_subscription(uint64_t
 
 std::optional<uint64_t> subscription_manager::find_by_expression(const std::string& expression) const {
     std::lock_guard<std::mutex> lock(m_write_mutex);
-    auto it = m_expr_to_id.find(expression);
+    auto it = m_expr_to_id.find(dedup_key(expression, parse_canonical(expression)));
     if (it != m_expr_to_id.end()) return it->second;
     return std::nullopt;
 }
 
+std::vector<std::pair<uint64_t, std::string>> subscription_manager::leases() const {
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    std::vector<std::pair<uint64_t, std::string>> out;
+    for (const auto& [id, sub] : m_subscriptions) {
+        for (const auto& client : sub.lease_holders) out.emplace_back(id, client);
+    }
+    return out;
+}
+
+bool subscription_manager::set_shard_members(const std::string& self,
+                                             std::vector<std::string> members) {
+    std::sort(members.begin(), members.end());
+    members.erase(std::unique(members.begin(), members.end()), members.end());
+
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    if (m_sharded && self == m_shard_self && members == m_shard_members) return false;
+    m_sharded = true;
+    m_shard_self = self;
+    m_shard_members = std::move(members);
+
+    std::size_t gained = 0;
+    std::size_t lost = 0;
+    for (const auto& [id, parsed] : m_parsed) {
+        const bool routed = m_routes.count(id) > 0;
+        if (owns(id) == routed) continue;
+        if (routed) {
+            mark_dirty(m_routes.at(id));
+            m_routes.erase(id);
+            ++lost;
+        } else {
+            add_route(id);
+            ++gained;
+        }
+    }
+    publish_snapshot();
+    m_log->info("Shard '{}' of {} member(s): owns {}/{} subscription(s) (+{} -{})",
+                m_shard_self, m_shard_members.size(), m_routes.size(),
+                m_subscriptions.size(), gained, lost);
+    return true;
+}
+
+bool subscription_manager::add_attribute(const attribute_def& attr) {
+    if (attr.name.empty()) throw std::invalid_argument("attribute name must not be empty");
+
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    if (auto existing = m_schema->find(attr.name)) {
+        if (existing->type != attr.type) {
+            throw std::invalid_argument("attribute '" + attr.name +
+                                        "' already exists with a different type");
+        }
+        if (!m_deprecated.erase(attr.name)) return false;
+        refresh_accepting();
+        ++m_changes;
+        m_log->info("Attribute '{}' is no longer deprecated", attr.name);
+        return true;
+    }
+
+    auto defs = m_schema->defs;
+    defs.push_back(attr);
+    // Reject anything the a-tree refuses before the live schema changes.
+    build_tree(defs);
+    set_schema(std::move(defs));
+    m_retired.erase(attr.name);
+    publish_snapshot();
+    ++m_changes;
+    m_log->info("Added attribute '{}' ({} attributes)", attr.name, m_schema->size());
+    return true;
+}
+
+bool subscription_manager::deprecate_attribute(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    if (!m_schema->find(name)) {
+        throw std::invalid_argument("unknown attribute '" + name + "'");
+    }
+    if (name == m_partition_attribute) {
+        throw std::invalid_argument("the partition attribute cannot be deprecated");
+    }
+
+    m_deprecated.insert(name);
+    refresh_accepting();
+    ++m_changes;
+    if (retire_deprecated()) {
+        publish_snapshot();
+        return true;
+    }
+    m_log->info("Deprecated attribute '{}'; it stays until no subscription references it", name);
+    return false;
+}
+
+std::shared_ptr<const attribute_schema> subscription_manager::schema() const {
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    return m_schema;
+}
+
+std::vector<std::string> subscription_manager::deprecated_attributes() const {
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    std::vector<std::string> out(m_deprecated.begin(), m_deprecated.end());
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+uint64_t subscription_manager::change_count() const {
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    return m_changes;
+}
+
+std::string subscription_manager::encode_state() const {
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    auto subs = nlohmann::json::array();
+    for (const auto& [id, sub] : m_subscriptions) {
+        subs.push_back({
+            {"id", id},
+            {"expression", sub.expression},
+            {"lease_holders", std::vector<std::string>(sub.lease_holders.begin(),
+                                                       sub.lease_holders.end())}
+        });
+    }
+    // The schema travels with the state so attributes added, deprecated or
+    // retired at runtime stay that way across a warm restart or a peer
+    // bootstrap.
+    auto attributes = nlohmann::json::array();
+    for (const auto& d : m_schema->defs) {
+        attributes.push_back({{"name", d.name}, {"type", attribute_type_name(d.type)},
+                              {"deprecated", m_deprecated.count(d.name) > 0}});
+    }
+    std::vector<std::string> retired(m_retired.begin(), m_retired.end());
+    std::sort(retired.begin(), retired.end());
+    return nlohmann::json{
+        {"version", 1},
+        {"next_id", m_next_id},
+        {"attributes", std::move(attributes)},
+        {"retired", std::move(retired)},
+        {"subscriptions", std::move(subs)}
+    }.dump();
+}
+
+std::size_t subscription_manager::restore_state(std::string_view state) {
+    auto doc = nlohmann::json::parse(state);
+    if (doc.at("version").get<int>() != 1) {
+        throw std::runtime_error("unsupported subscription state version");
+    }
+
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+
+    // Retired attributes leave the schema, and ones missing from it were
+    // added at runtime; configured ones keep their configured type. The
+    // partition attribute is never retired or deprecated.
+    std::unordered_set<std::string> retired;
+    for (auto& name : doc.value("retired", std::vector<std::string>{})) {
+        if (name != m_partition_attribute) retired.insert(std::move(name));
+    }
+    std::vector<attribute_def> defs;
+    for (const auto& d : m_schema->defs) {
+        if (!retired.count(d.name)) defs.push_back(d);
+    }
+    bool schema_changed = defs.size() != m_schema->size();
+    std::vector<std::string> deprecated;
+    for (const auto& record : doc.value("attributes", nlohmann::json::array())) {
+        auto name = record.at("name").get<std::string>();
+        auto type = parse_attribute_type(record.at("type").get<std::string>());
+        if (!type) throw std::runtime_error("unknown type of attribute '" + name + "'");
+        if (retired.count(name)) continue;
+        if (record.value("deprecated", false) && name != m_partition_attribute) {
+            deprecated.push_back(name);
+        }
+        if (!m_schema->find(name)) {
+            defs.push_back({std::move(name), *type});
+            schema_changed = true;
+        }
+    }
+    if (schema_changed) {
+        build_tree(defs);
+        set_schema(std::move(defs));
+    }
+    m_retired.insert(retired.begin(), retired.end());
+
+    std::size_t loaded = 0;
+    for (const auto& record : doc.value("subscriptions", nlohmann::json::array())) {
+        try {
+            const auto id = record.at("id").get<uint64_t>();
+            const auto expression = record.at("expression").get<std::string>();
+            const auto holders = record.at("lease_holders").get<std::vector<std::string>>();
+            if (holders.empty()) continue;
+
+            auto parsed = parse_canonical(expression);
+            auto key = dedup_key(expression, parsed);
+            if (m_subscriptions.count(id) || indexed_verbatim(key, expression)) {
+                throw std::runtime_error("conflicts with an existing subscription");
+            }
+            validate(expression, parsed);
+
+            subscription_info info;
+            info.id = id;
+            info.expression = expression;
+            info.lease_holders.insert(holders.begin(), holders.end());
+            m_subscriptions.emplace(id, std::move(info));
+            index_expression(key, id);
+            add_parsed(id, std::move(parsed));
+            m_next_id = std::max(m_next_id, id + 1);
+            ++loaded;
+        } catch (const std::exception& e) {
+            m_log->warn("Skipping subscription state record {}: {}", record.dump(), e.what());
+        }
+    }
+    m_next_id = std::max(m_next_id, doc.value("next_id", uint64_t{1}));
+
+    // Deprecate only now, so restored subscriptions that still reference a
+    // deprecated attribute are accepted and keep it in the schema.
+    if (!deprecated.empty()) {
+        m_deprecated.insert(deprecated.begin(), deprecated.end());
+        refresh_accepting();
+        retire_deprecated();
+    }
+
+    publish_snapshot();
+    ++m_changes;
+    return loaded;
+}
+
+bool subscription_manager::save_state(const std::string& path) {
+    // Read the counter first: a change racing with encode_state() is then
+    // simply written again by the next save.
+    const auto changes = change_count();
+    {
+        std::lock_guard<std::mutex> lock(m_write_mutex);
+        if (changes == m_saved_changes && std::filesystem::exists(path)) return true;
+    }
+    const auto body = encode_state();
+
+    // Write beside the target and rename, so a crash never leaves a torn file.
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(body.data(), static_cast<std::streamsize>(body.size()));
+        out.flush();
+        if (!out) {
+            m_log->warn("Failed to write subscription state to '{}'", tmp);
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        m_log->warn("Failed to replace subscription state '{}': {}", path, ec.message());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    m_saved_changes = changes;
+    return true;
+}
+
+std::size_t subscription_manager::load_state(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        m_log->info("No subscription state at '{}'; starting empty", path);
+        return 0;
+    }
+    const std::string body((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    std::size_t loaded = 0;
+    try {
+        loaded = restore_state(body);
+    } catch (const std::exception& e) {
+        m_log->warn("Ignoring unreadable subscription state '{}': {}", path, e.what());
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    m_saved_changes = m_changes;
+    m_log->info("Loaded {} subscription(s) from '{}'", loaded, path);
+    return loaded;
+}
+
 std::shared_ptr<const tree_snapshot> subscription_manager::snapshot() const {
     return m_snapshot.load(std::memory_order_acquire);
 }
 
+void subscription_manager::set_replica_nodes(std::vector<std::vector<int>> node_cpus) {
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    if (node_cpus.size() < 2) node_cpus.clear();  // one node needs no replicas
+    m_replica_nodes = std::move(node_cpus);
+    m_replicas.reset();
+    if (!m_replica_nodes.empty()) {
+        m_replicas = std::make_unique<std::atomic<std::shared_ptr<const tree_snapshot>>[]>(
+            m_replica_nodes.size() - 1);
+    }
+    // Node 0's current trees were built on whatever thread published them.
+    m_rebuild_all = true;
+    publish_snapshot();
+}
+
+std::shared_ptr<const tree_snapshot> subscription_manager::snapshot(std::size_t node) const {
+    if (node == 0 || node >= m_replica_nodes.size()) return snapshot();
+    return m_replicas[node - 1].load(std::memory_order_acquire);
+}
+
 std::size_t subscription_manager::active_count() const {
     return m_snapshot.load(std::memory_order_acquire)->active_count;
 }
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "attribute_schema.hpp"
 #include "config.hpp"
+#include "equality_index.hpp"
+#include "expression.hpp"
 #include "tree_snapshot.hpp"
 #include <atree.hpp>
 #include <spdlog/spdlog.h>
@@ -10,6 +13,7 @@
 #include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -28,16 +32,30 @@ struct subscription_info {
 // while writers serialize via mutex and publish replacements atomically.
 class subscription_manager {
 public:
+    // A non-empty `partition_attribute` (string or integer) splits the tree
+    // by that attribute's value; see tree_snapshot::partitions. Below
+    // `linear_match_threshold` residual expressions, snapshots evaluate them
+    // with a linear_matcher instead of searching the tree (0 = never).
     subscription_manager(const std::vector<attribute_def>& attributes,
                          const std::string& output_prefix,
-                         std::shared_ptr<spdlog::logger> log);
+                         std::shared_ptr<spdlog::logger> log,
+                         const std::string& partition_attribute = {},
+                         std::size_t linear_match_threshold = k_default_linear_match_threshold);
 
     // Subscribe with a boolean expression. Returns the subscription ID
-    // (new or existing). Throws atree::Error on invalid expression.
+    // (new or existing). Expressions are deduplicated by canonical form, so
+    // reordered or reformatted equivalents share one subscription. Throws
+    // expression_error or atree::Error on an invalid expression, before any
+    // state changes; joining an existing subscription that references a
+    // deprecated attribute counts as invalid for a client not yet holding it.
     uint64_t subscribe(const std::string& expression, const std::string& client_id);
 
     // Restore a persisted subscription using its original ID. Returns false
-    // if the record conflicts with already-restored state.
+    // if the ID is already restored with a different expression, or the
+    // same text is restored under another ID. A different spelling of a
+    // restored expression (persisted before equivalent spellings were
+    // deduplicated) keeps its own ID and output subject; new subscribers
+    // share the first one restored.
     bool restore(uint64_t subscription_id, const std::string& expression,
                  const std::string& client_id);
 
@@ -51,17 +69,156 @@ public:
     // Look up subscription by ID
     std::optional<subscription_info> get_subscription(uint64_t id) const;
 
-    // Look up subscription ID by expression string
+    // Look up subscription ID by expression, or any equivalent spelling
     std::optional<uint64_t> find_by_expression(const std::string& expression) const;
 
+    // Every (subscription ID, client ID) lease currently held.
+    std::vector<std::pair<uint64_t, std::string>> leases() const;
+
+    // Index only the subscriptions `self` owns among `members` by rendezvous
+    // hashing of their canonical expression; the others are still tracked
+    // (IDs, leases, deduplication) but never matched. Until the first call
+    // every subscription is owned; a member list without `self` owns nothing.
+    // Returns false if unchanged.
+    //
+    // IDs are assigned by each instance, so instances agree on the owner of
+    // an expression but not necessarily on its ID: the owner publishes on
+    // its own ID for it, which matches the one a client was given only while
+    // the instances' ID counters agree (see README).
+    bool set_shard_members(const std::string& self, std::vector<std::string> members);
+
+    // Counter bumped by every subscription, lease or schema change.
+    uint64_t change_count() const;
+
+    // Serialize all subscriptions and their lease holders as JSON, along
+    // with the schema: every attribute, whether it is deprecated, and the
+    // attributes retired at runtime.
+    std::string encode_state() const;
+
+    // Add the subscriptions in a blob produced by encode_state() and publish
+    // them in a single snapshot. Its runtime schema changes are applied too:
+    // added attributes join the schema, retired ones leave it, and
+    // deprecated ones are deprecated here. Records that are invalid or
+    // conflict with existing state are skipped; a malformed blob throws.
+    // Returns the number of subscriptions added.
+    std::size_t restore_state(std::string_view state);
+
+    // Write all subscriptions and their lease holders to `path` (via a
+    // temporary file and rename) if anything changed since the last save.
+    // Returns false on I/O failure.
+    bool save_state(const std::string& path);
+
+    // restore_state() from a file written by save_state(). A missing or
+    // unreadable file loads nothing.
+    std::size_t load_state(const std::string& path);
+
+    // Add an attribute at runtime. The next snapshot carries the new schema
+    // and every tree is rebuilt with it, so workers switch over with that
+    // snapshot. Re-adding a deprecated attribute that is still in the schema
+    // revives it. Returns false if it already exists with that type; throws
+    // std::invalid_argument on a type conflict.
+    bool add_attribute(const attribute_def& attr);
+
+    // Stop accepting new expressions that reference `name`; it is dropped
+    // from the schema once no subscription references it. Returns true if it
+    // was dropped right away. Throws std::invalid_argument for an unknown or
+    // partition attribute.
+    bool deprecate_attribute(const std::string& name);
+
+    // Current schema, including deprecated attributes still referenced.
+    std::shared_ptr<const attribute_schema> schema() const;
+
+    // Deprecated attributes waiting for their last reference to go.
+    std::vector<std::string> deprecated_attributes() const;
+
     // Get an immutable snapshot for lock-free concurrent reads.
     std::shared_ptr<const tree_snapshot> snapshot() const;
 
+    // Keep one snapshot replica per NUMA node, given as each node's CPUs.
+    // Every publish builds each replica on a thread pinned to its node, so
+    // its trees are allocated in that node's memory. Rebuilds everything
+    // once; must be called before any reader uses snapshot(node).
+    void set_replica_nodes(std::vector<std::vector<int>> node_cpus);
+
+    // Snapshot replica of `node` (same version and content as snapshot());
+    // the primary one without replicas.
+    std::shared_ptr<const tree_snapshot> snapshot(std::size_t node) const;
+
     // Stats
     std::size_t active_count() const;
 
 private:
-    // Rebuild tree from all current expressions and publish a new snapshot.
+    // Where an expression is matched. Only tree-backed routes are rebuilt.
+    struct route {
+        enum class kind { equality, range, residual, partition };
+        kind type = kind::residual;
+        std::vector<equality_term> terms;  // kind::equality
+        std::string partition;             // kind::partition: value key
+    };
+
+    // Reject an invalid expression without touching any state: schema checks
+    // on the parsed form, then an insert into a scratch single-expression
+    // tree. Throws expression_error or atree::Error.
+    void validate(const std::string& expression,
+                  const std::optional<expression_node>& parsed) const;
+
+    // Parse and canonicalize an expression; nullopt if it is not modelled.
+    std::optional<expression_node> parse_canonical(const std::string& expression) const;
+
+    // Deduplication key: the canonical text, or the raw text for expressions
+    // the parser does not model.
+    static std::string dedup_key(const std::string& expression,
+                                 const std::optional<expression_node>& parsed);
+    std::string dedup_key(uint64_t id) const;
+
+    // Make `id` the subscription new subscribers of `key` share, or keep it
+    // as an equivalent duplicate when another subscription already is.
+    void index_expression(const std::string& key, uint64_t id);
+
+    // Undo index_expression(); a duplicate takes over when `id` was shared.
+    void unindex_expression(const std::string& key, uint64_t id);
+
+    // Whether a subscription indexed under `key` has exactly this text.
+    bool indexed_verbatim(const std::string& key, const std::string& expression) const;
+
+    // Record the parsed form of a new expression and, if this shard owns it,
+    // route it and mark the tree it lands in for rebuild.
+    void add_parsed(uint64_t id, std::optional<expression_node> parsed);
+    void add_route(uint64_t id);
+    // Whether this shard matches `id`. Needs its subscription and parsed
+    // form recorded.
+    bool owns(uint64_t id) const;
+
+    // Drop the parsed form and route of an expression, marking its tree.
+    void remove_parsed(uint64_t id);
+
+    // Whether subscription `id` may reference attribute `name`. Expressions
+    // the parser does not model are scanned for the name as a whole word.
+    bool references(uint64_t id, const std::string& name) const;
+
+    // Drop deprecated attributes no subscription references any more.
+    // Returns true if the schema changed.
+    bool retire_deprecated();
+
+    // Rebuild m_accepting from m_schema and m_deprecated.
+    void refresh_accepting();
+
+    // Install `defs` as the schema, re-route every owned subscription and
+    // mark all trees for rebuild. The caller publishes the snapshot.
+    void set_schema(std::vector<attribute_def> defs);
+
+    void mark_dirty(const route& r);
+
+    // Build a tree holding the given subscriptions. Reads only immutable
+    // writer state, so several builds may run concurrently.
+    std::shared_ptr<const atree::Tree> build_expressions(const std::vector<uint64_t>& ids) const;
+
+    // Build the next snapshot. Only trees whose expressions changed since
+    // `prev` are rebuilt; the others are shared with it (null = build all).
+    std::shared_ptr<const tree_snapshot> build_snapshot(const tree_snapshot* prev,
+                                                        uint64_t version) const;
+
+    // Publish a new snapshot (one per replica node).
     void publish_snapshot();
 
     std::shared_ptr<spdlog::logger> m_log;
@@ -70,17 +227,56 @@ private:
     // Near-zero contention: all writers run on the ASIO thread.
     mutable std::mutex m_write_mutex;
 
-    // Needed to rebuild tree from scratch on expression changes.
-    std::vector<attribute_def> m_attributes;
+    // Needed to rebuild tree from scratch on expression changes. Replaced,
+    // never mutated, so published snapshots can share it.
+    std::shared_ptr<const attribute_schema> m_schema;
+
+    // m_schema minus deprecated attributes; new expressions are validated
+    // against it.
+    attribute_schema m_accepting;
+    std::unordered_set<std::string> m_deprecated;
+    // Attributes dropped from the schema at runtime, kept in the state so a
+    // restore drops configured ones too.
+    std::unordered_set<std::string> m_retired;
+    std::string m_partition_attribute;
     std::string m_output_prefix;
 
     // Current snapshot — atomically published for concurrent reader access.
+    // With replica nodes, m_snapshot is node 0's and m_replicas[n - 1] node n's.
     std::atomic<std::shared_ptr<const tree_snapshot>> m_snapshot;
+    std::vector<std::vector<int>> m_replica_nodes;
+    std::unique_ptr<std::atomic<std::shared_ptr<const tree_snapshot>>[]> m_replicas;
+    bool m_rebuild_all = false;  // next publish reuses no tree from the last snapshot
 
     // Writer-only state (protected by m_write_mutex)
     uint64_t m_next_id = 1;
-    std::unordered_map<std::string, uint64_t> m_expr_to_id;
+    uint64_t m_snapshot_version = 0;
+
+    // Bumped on every subscription or lease change; save_state() skips the
+    // write while it equals m_saved_changes.
+    uint64_t m_changes = 0;
+    uint64_t m_saved_changes = 0;
+    std::unordered_map<std::string, uint64_t> m_expr_to_id;  // keyed by dedup_key()
+    // Restored subscriptions equivalent to the one in m_expr_to_id.
+    std::unordered_map<std::string, std::vector<uint64_t>> m_equivalents;
     std::unordered_map<uint64_t, subscription_info> m_subscriptions;
+
+    // Parsed form of each expression, or nullopt when the expression uses
+    // syntax the sidecar does not model. Drives the equality fast path.
+    std::unordered_map<uint64_t, std::optional<expression_node>> m_parsed;
+    std::unordered_map<uint64_t, route> m_routes;  // owned subscriptions only
+
+    bool m_sharded = false;
+    std::string m_shard_self;
+    std::vector<std::string> m_shard_members;  // sorted
+
+    std::optional<attribute_slot> m_partition_slot;
+    std::size_t m_linear_match_threshold;
+
+    // Trees (and the range engine) changed since the last published snapshot.
+    bool m_residual_dirty = true;
+    bool m_ranges_dirty = true;
+    std::unordered_set<std::string> m_dirty_partitions;
 };
 
 } // namespace sidecar
@@ -1,19 +1,65 @@
 #pragma once
 
+#include "attribute_schema.hpp"
+#include "equality_index.hpp"
+#include "linear_matcher.hpp"
+#include "match_prefilter.hpp"
+#include "range_engine.hpp"
 #include <atree.hpp>
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
 
 namespace sidecar {
 
+// A-tree holding the expressions pinned to one value of the partition
+// attribute.
+struct tree_partition {
+    std::shared_ptr<const atree::Tree> tree;
+    std::size_t size = 0;
+};
+
 // Immutable snapshot of the a-tree and associated metadata.
 // Shared by worker threads via shared_ptr<const tree_snapshot>.
-// Workers only need the tree (for search) and precomputed output subjects.
+// Workers only need the matchers (for search) and precomputed output subjects.
 struct tree_snapshot {
     std::shared_ptr<const atree::Tree> tree;
 
+    // Schema every tree and index in this snapshot was built with; workers
+    // decode events with it, so a schema change takes effect per snapshot.
+    std::shared_ptr<const attribute_schema> schema;
+
+    // Increases with every published snapshot; keys per-worker match caches.
+    uint64_t version = 0;
+
+    // Number of expressions inserted into `tree`; search is skipped when zero.
+    std::size_t tree_size = 0;
+
+    // Compiled copy of the residual expressions, used instead of searching
+    // `tree` when there are few enough of them and all compile. The tree is
+    // still built, as it validates every expression.
+    linear_matcher linear;
+
+    // Necessary condition for any tree expression to match; events it
+    // rejects skip event construction and search.
+    match_prefilter prefilter;
+
+    // With a partition attribute configured, expressions that pin it by
+    // equality live in per-value trees keyed by append_value_key() of that
+    // value; `tree` holds only the residual expressions. An event searches
+    // the residual tree plus at most one partition.
+    std::optional<attribute_slot> partition_slot;
+    std::unordered_map<std::string, tree_partition> partitions;
+
+    // Pure equality conjunctions, matched by hash lookup instead of the tree.
+    equality_index equality;
+
+    // Float range conjunctions, evaluated per micro-batch (see match_batch).
+    // Shared with the previous snapshot when no range expression changed.
+    std::shared_ptr<const range_engine> ranges = std::make_shared<const range_engine>();
+
     // subscription_id -> precomputed output subject (e.g. "sensor.filtered.42")
     std::unordered_map<uint64_t, std::string> output_subjects;
 
@@ -1,28 +1,147 @@
 #include "worker_pool.hpp"
+#include "cpu_affinity.hpp"
 #include <asio/co_spawn.hpp>
 #include <asio/detached.hpp>
 #include <asio/redirect_error.hpp>
 #include <asio/steady_timer.hpp>
 #include <asio/use_awaitable.hpp>
+#include <algorithm>
+#include <charconv>
 #include <chrono>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
 
 namespace sidecar {
 
+namespace {
+
+// Records whose wire buffer grew beyond this are released instead of pooled,
+// so one oversized fan-out does not pin its memory indefinitely.
+constexpr std::size_t k_max_pooled_wire_bytes = 1024 * 1024;
+
+// Same for input payload buffers.
+constexpr std::size_t k_max_pooled_payload_bytes = 64 * 1024;
+
+// The byte budget charges a payload's capacity, so a pooled buffer is only
+// reused for a payload needing at least half of it (or for small ones).
+constexpr std::size_t k_min_reused_capacity = 4096;
+
+// How often an idle worker looks for a backlogged lane to steal from, and
+// the smallest backlog worth stealing from; the owner keeps at least half.
+constexpr std::int64_t k_idle_poll_us = 1000;
+constexpr moodycamel::LightweightSemaphore::ssize_t k_min_steal_backlog = 2;
+
+// How long an idle worker parks when no peer has a backlog worth stealing
+// and no ordered result waits to expire. New input and new backlogs wake it
+// early; the timeout is only a fallback.
+constexpr std::int64_t k_idle_park_us = 100000;
+
+// Spin budget bounds of the adaptive wait strategy, in polls. The yield
+// strategy pauses for the minimum before it starts yielding.
+constexpr unsigned int k_min_spins = 64;
+constexpr unsigned int k_max_spins = 32768;
+
+// Tell the CPU this is a spin-wait loop.
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+void append_publication(std::string& wire, const std::string& subject,
+                        std::span<const char> payload) {
+    char size_buf[24];
+    auto [end, ec] = std::to_chars(size_buf, size_buf + sizeof(size_buf), payload.size());
+    wire += "PUB ";
+    wire += subject;
+    wire += ' ';
+    wire.append(size_buf, end);
+    wire += "\r\n";
+    wire.append(payload.data(), payload.size());
+    wire += "\r\n";
+}
+
+} // namespace
+
+worker_pool::pipeline::pipeline(const config& cfg, subscription_manager& sub_mgr,
+                                std::size_t lane_count)
+    : format(cfg.format), sub_mgr(sub_mgr),
+      max_messages(std::min(cfg.input_queue_max_messages, k_max_queue_messages)),
+      max_bytes(std::min(cfg.input_queue_max_bytes, k_max_queue_bytes)),
+      lanes(std::make_unique<lane_queue[]>(lane_count)),
+      ordered(cfg.ordered_output
+          ? std::make_unique<ordered_output>(cfg.reorder_max_pending,
+                                             std::chrono::milliseconds(cfg.reorder_timeout_ms))
+          : nullptr)
+{}
+
 worker_pool::worker_pool(asio::io_context& ioc, const config& cfg,
-                         const attribute_schema& schema,
-                         subscription_manager& sub_mgr,
                          nats_asio::iconnection_sptr conn,
                          std::shared_ptr<spdlog::logger> log)
-    : m_ioc(ioc), m_format(cfg.format), m_schema(schema),
-      m_sub_mgr(sub_mgr), m_conn(std::move(conn)), m_log(std::move(log)),
+    : m_ioc(ioc), m_conn(std::move(conn)), m_log(std::move(log)),
       m_thread_count(cfg.worker_threads > 0 ? cfg.worker_threads
                                             : std::thread::hardware_concurrency()),
-      m_queue_max_messages(cfg.input_queue_max_messages),
-      m_queue_max_bytes(cfg.input_queue_max_bytes),
+      m_batch_size(std::max<std::size_t>(cfg.worker_batch_size, 1)),
+      m_match_cache_entries(cfg.match_cache_entries),
+      m_match_cache_max_bytes(cfg.match_cache_max_bytes),
+      m_wait_strategy(cfg.latency_mode ? wait_strategy::spin : cfg.worker_wait_strategy),
       m_publish_max_inflight(cfg.publish_max_inflight),
       m_publish_backpressure_timeout(cfg.publish_backpressure_timeout_ms)
 {
     if (m_thread_count == 0) m_thread_count = 1;
+    m_ready = std::make_unique<moodycamel::LightweightSemaphore[]>(m_thread_count);
+    m_idle = std::make_unique<idle_worker[]>(m_thread_count);
+    m_park_us = k_idle_park_us;
+
+    // A worker_cpus entry pins a worker to one CPU (and so to that CPU's
+    // node); in NUMA-aware mode a worker without one is pinned to a whole
+    // node, round-robin over the nodes.
+    if (cfg.numa_aware) m_numa_nodes = numa_node_cpus();
+    if (m_numa_nodes.size() < 2) m_numa_nodes.clear();
+    m_placement.resize(m_thread_count);
+    for (unsigned int i = 0; i < m_thread_count; ++i) {
+        auto& w = m_placement[i];
+        if (!cfg.worker_cpus.empty()) {
+            w.cpus = {cfg.worker_cpus[i % cfg.worker_cpus.size()]};
+            if (!m_numa_nodes.empty()) w.node = numa_node_of(m_numa_nodes, w.cpus[0]).value_or(0);
+        } else if (!m_numa_nodes.empty()) {
+            w.node = i % m_numa_nodes.size();
+            w.cpus = m_numa_nodes[w.node];
+        }
+    }
+}
+
+worker_pool::worker_pool(asio::io_context& ioc, const config& cfg,
+                         subscription_manager& sub_mgr,
+                         nats_asio::iconnection_sptr conn,
+                         std::shared_ptr<spdlog::logger> log)
+    : worker_pool(ioc, cfg, std::move(conn), std::move(log))
+{
+    add_pipeline(cfg, sub_mgr);
+}
+
+std::size_t worker_pool::add_pipeline(const config& cfg, subscription_manager& sub_mgr) {
+    if (m_running.load(std::memory_order_acquire)) {
+        throw std::logic_error("worker_pool: pipelines must be added before start()");
+    }
+    if (!m_numa_nodes.empty()) sub_mgr.set_replica_nodes(m_numa_nodes);
+    m_pipelines.push_back(std::make_unique<pipeline>(cfg, sub_mgr, m_thread_count));
+    return m_pipelines.size() - 1;
+}
+
+void worker_pool::set_output_shards(std::vector<std::shared_ptr<io_shard>> shards) {
+    if (m_running.load(std::memory_order_acquire)) {
+        throw std::logic_error("worker_pool: output shards must be set before start()");
+    }
+    m_output_shards = std::move(shards);
+}
+
+io_shard* worker_pool::output_shard(unsigned int worker_id) const {
+    return m_output_shards.empty()
+        ? nullptr : m_output_shards[worker_id % m_output_shards.size()].get();
 }
 
 worker_pool::~worker_pool() {
@@ -31,68 +150,258 @@ worker_pool::~worker_pool() {
 
 void worker_pool::start() {
     if (m_running.exchange(true)) return; // already started
-    m_accepting.store(true, std::memory_order_release);
+    for (std::size_t i = 0; i < m_pipelines.size(); ++i) {
+        auto& p = *m_pipelines[i];
+        // An ordered pipeline writes through one connection only.
+        if (p.ordered && !m_output_shards.empty()) {
+            p.ordered->out = m_output_shards[i % m_output_shards.size()].get();
+        }
+        p.budget.fetch_and(~k_budget_closed, std::memory_order_acq_rel);
+    }
 
     m_threads.reserve(m_thread_count);
     for (unsigned int i = 0; i < m_thread_count; ++i) {
         m_threads.emplace_back(&worker_pool::worker_loop, this, i);
     }
-    m_log->info("Worker pool started with {} threads", m_thread_count);
+    m_log->info("Worker pool started with {} threads for {} pipeline(s)",
+                m_thread_count, m_pipelines.size());
 }
 
 void worker_pool::stop() {
-    {
-        std::lock_guard<std::mutex> lock(m_enqueue_mutex);
-        m_accepting.store(false, std::memory_order_release);
-        if (!m_running.exchange(false)) return; // already stopped
-    }
+    // Close every budget before clearing m_running: a worker that sees
+    // m_running false also sees every reservation made before the close,
+    // and keeps going until those messages are processed.
+    for (auto& p : m_pipelines) p->budget.fetch_or(k_budget_closed, std::memory_order_acq_rel);
+    if (!m_running.exchange(false)) return; // already stopped
+    // A worker parking from here on sees m_running false and does not block.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (unsigned int i = 0; i < m_thread_count; ++i) wake(i);
 
     for (auto& t : m_threads) {
         if (t.joinable()) t.join();
     }
     m_threads.clear();
+
+    // Every admitted message has been processed, so nothing should be held
+    // back any more; release whatever is, gaps and all.
+    for (auto& p : m_pipelines) {
+        if (!p->ordered) continue;
+        {
+            std::lock_guard<std::mutex> lock(p->ordered->mutex);
+            p->ordered->reorder.flush([&](publication_ptr&& record) {
+                release_ordered(*p, std::move(record));
+            });
+        }
+        wake_ordered_writer(*p);
+    }
     m_log->info("Worker pool stopped");
 }
 
-bool worker_pool::enqueue(std::vector<char> payload) {
-    std::lock_guard<std::mutex> lock(m_enqueue_mutex);
-    if (!m_accepting.load(std::memory_order_acquire) ||
-        m_queued_messages.load(std::memory_order_relaxed) >= m_queue_max_messages ||
-        payload.size() > m_queue_max_bytes - std::min(
-            m_queue_max_bytes, m_queued_bytes.load(std::memory_order_relaxed))) {
-        m_input_dropped.fetch_add(1, std::memory_order_relaxed);
-        return false;
+bool worker_pool::enqueue(std::size_t index, std::vector<char> payload) {
+    return enqueue_bulk(index, std::span<std::vector<char>>(&payload, 1)) == 1;
+}
+
+std::pair<std::size_t, std::size_t> worker_pool::admit(const pipeline& p, uint64_t budget,
+                                                       std::span<std::vector<char>> payloads,
+                                                       std::span<uint64_t> keys, bool compact) {
+    const auto queued_messages = budget_messages(budget);
+    const auto queued_bytes = budget_bytes(budget);
+    std::size_t admitted = 0;
+    std::size_t admitted_bytes = 0;
+    for (auto& payload : payloads) {
+        if (queued_messages + admitted >= p.max_messages ||
+            payload.capacity() > p.max_bytes - std::min(p.max_bytes, queued_bytes + admitted_bytes)) {
+            continue;
+        }
+        admitted_bytes += payload.capacity();
+        if (compact && &payload != &payloads[admitted]) {
+            const auto k = static_cast<std::size_t>(&payload - payloads.data());
+            std::swap(payload, payloads[admitted]);
+            if (!keys.empty()) std::swap(keys[k], keys[admitted]);
+        }
+        ++admitted;
+    }
+    return {admitted, admitted_bytes};
+}
+
+std::size_t worker_pool::enqueue_bulk(std::size_t index,
+                                      std::span<std::vector<char>> payloads,
+                                      std::span<uint64_t> keys) {
+    if (payloads.empty()) return 0;
+    if (index >= m_pipelines.size()) return 0;
+    auto& p = *m_pipelines[index];
+
+    // Reserve messages and bytes for everything that fits in one CAS on the
+    // budget word. A closed budget admits nothing; a lost race re-decides
+    // against the fresh value, so nothing is moved until the CAS succeeds.
+    uint64_t budget = p.budget.load(std::memory_order_acquire);
+    std::size_t admitted = 0;
+    std::size_t admitted_bytes = 0;
+    while (!(budget & k_budget_closed)) {
+        std::tie(admitted, admitted_bytes) = admit(p, budget, payloads, keys, false);
+        if (admitted == 0) break;
+        const uint64_t reservation =
+            (uint64_t{admitted} << k_budget_message_shift) + admitted_bytes;
+        if (p.budget.compare_exchange_weak(budget, budget + reservation,
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire)) {
+            break;
+        }
+        admitted = 0;
+    }
+
+    if (admitted > 0) {
+        // Same budget, same decisions: this pass only moves them into place.
+        admit(p, budget, payloads, keys, true);
+        admitted = dispatch(p, payloads.first(admitted),
+                            keys.empty() ? keys : keys.first(admitted));
+    }
+
+    if (admitted < payloads.size()) {
+        p.input_dropped.fetch_add(payloads.size() - admitted, std::memory_order_relaxed);
+    }
+    return admitted;
+}
+
+std::size_t worker_pool::dispatch(pipeline& p, std::span<std::vector<char>> payloads,
+                                  std::span<const uint64_t> keys) {
+    // An ordered pipeline numbers the batch as one block, in batch order.
+    const uint64_t first = p.ordered
+        ? p.next_sequence.fetch_add(payloads.size(), std::memory_order_relaxed) : 0;
+    if (keys.empty()) {
+        const auto lane = p.next_lane.fetch_add(1, std::memory_order_relaxed) % m_thread_count;
+        return insert(p, lane, payloads, first);
     }
 
-    const auto bytes = payload.size();
-    m_queued_messages.fetch_add(1, std::memory_order_relaxed);
-    m_queued_bytes.fetch_add(bytes, std::memory_order_relaxed);
-    if (!m_queue.enqueue(std::move(payload))) {
-        m_queued_messages.fetch_sub(1, std::memory_order_relaxed);
-        m_queued_bytes.fetch_sub(bytes, std::memory_order_relaxed);
-        m_input_dropped.fetch_add(1, std::memory_order_relaxed);
+    // Consecutive payloads bound to the same lane go in with one insert.
+    std::size_t queued = 0;
+    for (std::size_t begin = 0; begin < payloads.size();) {
+        const auto lane = keys[begin] % m_thread_count;
+        auto end = begin + 1;
+        while (end < payloads.size() && keys[end] % m_thread_count == lane) ++end;
+        queued += insert(p, lane, payloads.subspan(begin, end - begin), first + begin);
+        begin = end;
+    }
+    return queued;
+}
+
+std::size_t worker_pool::insert(pipeline& p, std::size_t lane,
+                                std::span<std::vector<char>> payloads,
+                                uint64_t first_sequence) {
+    // Staging reused per ingest thread, so numbering the payloads does not
+    // allocate in steady state.
+    thread_local std::vector<input_message> staging;
+    staging.clear();
+    std::size_t bytes = 0;
+    for (std::size_t k = 0; k < payloads.size(); ++k) {
+        bytes += payloads[k].capacity();
+        staging.push_back({std::move(payloads[k]), first_sequence + k});
+    }
+    // Tokenless bulk insert: each ingest thread gets its own implicit
+    // producer, so concurrent producers never share one.
+    if (!p.lanes[lane].enqueue_bulk(std::make_move_iterator(staging.begin()), staging.size())) {
+        p.budget.fetch_sub((uint64_t{payloads.size()} << k_budget_message_shift) + bytes,
+                           std::memory_order_acq_rel);
+        if (p.ordered) {
+            // Their sequence numbers will never be matched; don't hold later
+            // results back for them.
+            std::vector<uint64_t> sequences(staging.size());
+            for (std::size_t k = 0; k < staging.size(); ++k) sequences[k] = staging[k].sequence;
+            std::vector<publication_ptr> none(staging.size());
+            submit_ordered(p, sequences, none);
+        }
+        staging.clear();
+        return 0;
+    }
+    staging.clear();
+    m_ready[lane].signal(static_cast<moodycamel::LightweightSemaphore::ssize_t>(payloads.size()));
+    wake_idle(lane);
+    return payloads.size();
+}
+
+void worker_pool::wake_idle(std::size_t lane) {
+    // Pairs with the fence in the worker's park: either it sees this
+    // signal before blocking, or this sees it parked.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_parked.load(std::memory_order_relaxed) == 0) return;
+    wake(lane);
+    if (m_ready[lane].availableApprox() < k_min_steal_backlog) return;
+    for (unsigned int turn = 1; turn < m_thread_count; ++turn) {
+        if (wake((lane + turn) % m_thread_count)) return;
+    }
+}
+
+bool worker_pool::wake(std::size_t worker) {
+    auto& idle = m_idle[worker];
+    if (!idle.parked.load(std::memory_order_relaxed) ||
+        !idle.parked.exchange(false, std::memory_order_acq_rel)) {
         return false;
     }
+    m_parked.fetch_sub(1, std::memory_order_relaxed);
+    idle.wake.signal();
     return true;
 }
 
+std::size_t worker_pool::reserved_messages() const {
+    std::size_t total = 0;
+    for (const auto& p : m_pipelines) {
+        total += budget_messages(p->budget.load(std::memory_order_acquire));
+    }
+    return total;
+}
+
 std::size_t worker_pool::queue_depth() const {
-    return m_queued_messages.load(std::memory_order_relaxed);
+    return reserved_messages();
+}
+
+worker_pool::stats worker_pool::get_stats(std::size_t index) const {
+    stats s;
+    if (index < m_pipelines.size()) {
+        const auto& p = *m_pipelines[index];
+        s.processed = p.processed.load(std::memory_order_relaxed);
+        s.matched = p.matched.load(std::memory_order_relaxed);
+        s.published = p.published.load(std::memory_order_relaxed);
+        s.match_failures = p.match_failures.load(std::memory_order_relaxed);
+        s.input_dropped = p.input_dropped.load(std::memory_order_relaxed);
+        s.publish_tasks_dropped = p.publish_tasks_dropped.load(std::memory_order_relaxed);
+        s.publish_failures = p.publish_failures.load(std::memory_order_relaxed);
+        const auto budget = p.budget.load(std::memory_order_relaxed);
+        s.queue_depth = budget_messages(budget);
+        s.queue_bytes = budget_bytes(budget);
+        if (p.ordered) {
+            std::lock_guard<std::mutex> lock(p.ordered->mutex);
+            s.reorder_pending = p.ordered->reorder.pending();
+            s.reorder_skipped = p.ordered->reorder.skipped();
+            s.reorder_late = p.ordered->reorder.late();
+        }
+    }
+    s.publish_inflight = m_publish_inflight.load(std::memory_order_relaxed);
+    s.cache_hits = m_cache_hits.load(std::memory_order_relaxed);
+    s.cache_misses = m_cache_misses.load(std::memory_order_relaxed);
+    s.cache_entries = m_cache_entries.load(std::memory_order_relaxed);
+    s.cache_bytes = m_cache_bytes.load(std::memory_order_relaxed);
+    s.stolen = m_stolen.load(std::memory_order_relaxed);
+    return s;
 }
 
 worker_pool::stats worker_pool::get_stats() const {
-    return {
-        m_processed.load(std::memory_order_relaxed),
-        m_matched.load(std::memory_order_relaxed),
-        m_published.load(std::memory_order_relaxed),
-        m_match_failures.load(std::memory_order_relaxed),
-        m_input_dropped.load(std::memory_order_relaxed),
-        m_publish_tasks_dropped.load(std::memory_order_relaxed),
-        m_publish_failures.load(std::memory_order_relaxed),
-        m_queued_messages.load(std::memory_order_relaxed),
-        m_queued_bytes.load(std::memory_order_relaxed),
-        m_publish_inflight.load(std::memory_order_relaxed)
-    };
+    stats total = get_stats(m_pipelines.size());
+    for (std::size_t i = 0; i < m_pipelines.size(); ++i) {
+        const auto s = get_stats(i);
+        total.processed += s.processed;
+        total.matched += s.matched;
+        total.published += s.published;
+        total.match_failures += s.match_failures;
+        total.input_dropped += s.input_dropped;
+        total.publish_tasks_dropped += s.publish_tasks_dropped;
+        total.publish_failures += s.publish_failures;
+        total.queue_depth += s.queue_depth;
+        total.queue_bytes += s.queue_bytes;
+        total.reorder_pending += s.reorder_pending;
+        total.reorder_skipped += s.reorder_skipped;
+        total.reorder_late += s.reorder_late;
+    }
+    return total;
 }
 
 asio::awaitable<bool> worker_pool::wait_for_publications(
@@ -109,131 +418,424 @@ asio::awaitable<bool> worker_pool::wait_for_publications(
     co_return true;
 }
 
+worker_pool::publication_ptr worker_pool::acquire_publication() {
+    publication_ptr record;
+    if (!m_publication_pool.try_dequeue(record)) {
+        record = std::make_unique<publication>();
+    }
+    record->wire.clear();
+    record->output_count = 0;
+    return record;
+}
+
+void worker_pool::recycle_publication(publication_ptr record) {
+    if (!record || record->wire.capacity() > k_max_pooled_wire_bytes) return;
+    m_publication_pool.enqueue(std::move(record));
+}
+
+std::vector<char> worker_pool::acquire_buffer(std::size_t size) {
+    std::vector<char> buffer;
+    if (m_buffer_pool.try_dequeue(buffer) &&
+        buffer.capacity() > std::max(2 * size, k_min_reused_capacity)) {
+        // Released rather than charged to the budget at many times its use.
+        return {};
+    }
+    return buffer;
+}
+
+void worker_pool::recycle_buffer(std::vector<char> buffer) {
+    if (buffer.capacity() == 0 || buffer.capacity() > k_max_pooled_payload_bytes) return;
+    buffer.clear();
+    m_buffer_pool.enqueue(std::move(buffer));
+}
+
 void worker_pool::worker_loop(unsigned int worker_id) {
-    m_log->debug("Worker {} started", worker_id);
+    // Pin before allocating anything, so this worker's buffers are first
+    // touched on its own node.
+    const auto& place = m_placement[worker_id];
+    if (!place.cpus.empty() && !pin_current_thread(place.cpus)) {
+        m_log->warn("Worker {}: failed to set CPU affinity", worker_id);
+    }
+    m_log->debug("Worker {} started (node {})", worker_id, place.node);
 
-    std::vector<char> payload;
-    while (m_running.load(std::memory_order_acquire) ||
-           m_queued_messages.load(std::memory_order_acquire) != 0) {
-        // Block with timeout to allow checking m_running for graceful shutdown
-        bool got = m_queue.wait_dequeue_timed(
-            payload, std::chrono::milliseconds(100));
+    const std::size_t pipeline_count = m_pipelines.size();
+    io_shard* out = output_shard(worker_id);
+    std::vector<input_message> items(m_batch_size);
+    std::vector<std::vector<char>> batch(m_batch_size);
+    std::vector<uint64_t> sequences(m_batch_size);
+    std::vector<publication_ptr> records(m_batch_size);
+    // One scratch per pipeline: cached results are keyed by that pipeline's
+    // schema and snapshot version.
+    std::vector<match_scratch> scratch(pipeline_count);
+    for (auto& s : scratch) s.cache.configure(m_match_cache_entries, m_match_cache_max_bytes);
+    const bool caching = pipeline_count > 0 && scratch.front().cache.enabled();
+    batch_matches results;
 
-        if (!got) continue;
+    // Cache counters already folded into the shared stats.
+    uint64_t reported_hits = 0;
+    uint64_t reported_misses = 0;
+    std::size_t reported_entries = 0;
+    std::size_t reported_bytes = 0;
+    auto report_cache = [&] {
+        uint64_t hits = 0, misses = 0;
+        std::size_t entries = 0, bytes = 0;
+        for (const auto& s : scratch) {
+            hits += s.cache.hits();
+            misses += s.cache.misses();
+            entries += s.cache.size();
+            bytes += s.cache.bytes();
+        }
+        m_cache_hits.fetch_add(hits - reported_hits, std::memory_order_relaxed);
+        m_cache_misses.fetch_add(misses - reported_misses, std::memory_order_relaxed);
+        m_cache_entries.fetch_add(entries - reported_entries, std::memory_order_relaxed);
+        m_cache_bytes.fetch_add(bytes - reported_bytes, std::memory_order_relaxed);
+        reported_hits = hits;
+        reported_misses = misses;
+        reported_entries = entries;
+        reported_bytes = bytes;
+    };
 
-        m_queued_messages.fetch_sub(1, std::memory_order_relaxed);
-        m_queued_bytes.fetch_sub(payload.size(), std::memory_order_relaxed);
+    auto process = [&](std::size_t index, std::size_t count) {
+        auto& p = *m_pipelines[index];
+        std::size_t batch_bytes = 0;
+        for (std::size_t k = 0; k < count; ++k) {
+            std::swap(batch[k], items[k].payload);
+            sequences[k] = items[k].sequence;
+            batch_bytes += batch[k].capacity();
+        }
+        p.budget.fetch_sub((uint64_t{count} << k_budget_message_shift) + batch_bytes,
+                           std::memory_order_acq_rel);
 
-        // Get current snapshot — lock-free atomic load
-        auto snap = m_sub_mgr.snapshot();
+        // Get current snapshot — lock-free atomic load, once per batch. It
+        // carries the schema, so a schema change applies between batches.
+        auto snap = p.sub_mgr.snapshot(place.node);
         if (!snap || !snap->tree) {
-            payload.clear();
-            continue;
+            for (std::size_t k = 0; k < count; ++k) recycle_buffer(std::move(batch[k]));
+            if (p.ordered) {
+                submit_ordered(p, std::span<const uint64_t>(sequences.data(), count),
+                               std::span<publication_ptr>(records.data(), count));
+            }
+            return;
         }
 
-        std::span<const char> payload_span(payload.data(), payload.size());
+        match_batch(*snap, *snap->schema, p.format,
+                    std::span<const std::vector<char>>(batch.data(), count),
+                    scratch[index], results, m_log);
 
-        auto matches = deserialize_and_match(
-            *snap->tree, m_schema, m_format, payload_span, m_log);
+        p.processed.fetch_add(count, std::memory_order_relaxed);
+        if (caching) report_cache();
 
-        m_processed.fetch_add(1, std::memory_order_relaxed);
-
-        if (!matches) {
-            m_match_failures.fetch_add(1, std::memory_order_relaxed);
-            payload.clear();
-            continue;
+        for (std::size_t k = 0; k < count; ++k) {
+            if (results.failed[k]) {
+                p.match_failures.fetch_add(1, std::memory_order_relaxed);
+            } else if (auto matches = results.matches(k); !matches.empty()) {
+                p.matched.fetch_add(1, std::memory_order_relaxed);
+                records[k] = build_publication(
+                    matches, *snap, std::span<const char>(batch[k].data(), batch[k].size()));
+                if (!p.ordered && records[k]) publish(p, std::move(records[k]), out);
+            }
+            recycle_buffer(std::move(batch[k]));
+        }
+        // Ordered: every message reports, matched or not, so later ones are
+        // not held back waiting for it.
+        if (p.ordered) {
+            submit_ordered(p, std::span<const uint64_t>(sequences.data(), count),
+                           std::span<publication_ptr>(records.data(), count));
         }
+    };
 
-        if (matches->empty()) {
-            payload.clear();
-            continue;
+    using ssize_t = moodycamel::LightweightSemaphore::ssize_t;
+    const auto batch_size = static_cast<ssize_t>(m_batch_size);
+
+    // Claim counts from the first other worker whose backlog is worth
+    // splitting, leaving it at least half. Returns the counts taken and
+    // sets `victim`.
+    auto steal = [&](std::size_t& victim) -> std::size_t {
+        for (unsigned int turn = 1; turn < m_thread_count; ++turn) {
+            const auto candidate = (worker_id + turn) % m_thread_count;
+            const auto backlog = m_ready[candidate].availableApprox();
+            if (backlog < k_min_steal_backlog) continue;
+            const auto taken = m_ready[candidate].tryWaitMany(std::min(batch_size, backlog / 2));
+            if (taken <= 0) continue;
+            m_stolen.fetch_add(static_cast<uint64_t>(taken), std::memory_order_relaxed);
+            victim = candidate;
+            return static_cast<std::size_t>(taken);
         }
+        return 0;
+    };
 
-        m_matched.fetch_add(1, std::memory_order_relaxed);
+    // Poll briefly while there is a peer backlog to steal or an ordered
+    // result to expire; otherwise park, so idle workers cost nothing.
+    auto park_timeout = [&]() -> std::int64_t {
+        for (unsigned int turn = 1; turn < m_thread_count; ++turn) {
+            const auto peer = (worker_id + turn) % m_thread_count;
+            if (m_ready[peer].availableApprox() >= k_min_steal_backlog) return k_idle_poll_us;
+        }
+        for (auto& p : m_pipelines) {
+            if (!p->ordered) continue;
+            std::lock_guard<std::mutex> lock(p->ordered->mutex);
+            if (p->ordered->reorder.pending() > 0) return k_idle_poll_us;
+        }
+        return m_park_us;
+    };
 
-        const auto previous_inflight = m_publish_inflight.fetch_add(
-            1, std::memory_order_acq_rel);
-        if (previous_inflight >= m_publish_max_inflight) {
-            m_publish_inflight.fetch_sub(1, std::memory_order_acq_rel);
-            m_publish_tasks_dropped.fetch_add(1, std::memory_order_relaxed);
-            payload.clear();
-            continue;
+    // Block until insert() wakes this worker, for input on its own lanes or
+    // a peer backlog to steal, or the park timeout passes. Returns counts
+    // from its own semaphore; 0 when there are none.
+    auto park = [&]() -> ssize_t {
+        auto& idle = m_idle[worker_id];
+        idle.parked.store(true, std::memory_order_relaxed);
+        m_parked.fetch_add(1, std::memory_order_relaxed);
+        // Pairs with the fence in wake_idle(): input signalled before this
+        // point is seen below, anything later finds this worker parked.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto n = m_ready[worker_id].tryWaitMany(batch_size);
+        if (n == 0 && m_running.load(std::memory_order_relaxed) &&
+            park_timeout() != k_idle_poll_us) {
+            idle.wake.wait(m_park_us);
+        }
+        // Not cleared here means a waker cleared it; its signal at most
+        // cuts the next park short.
+        if (idle.parked.exchange(false, std::memory_order_acq_rel)) {
+            m_parked.fetch_sub(1, std::memory_order_relaxed);
         }
+        return n > 0 ? n : m_ready[worker_id].tryWaitMany(batch_size);
+    };
 
-        // Capture what we need for the publish coroutine
-        auto matched_ids = std::move(*matches);
-        auto payload_copy = std::move(payload);
-        auto snap_copy = std::move(snap);
-        auto conn = m_conn;
-        auto log = m_log;
-        auto& published_counter = m_published;
-        auto& failure_counter = m_publish_failures;
-        auto& inflight_counter = m_publish_inflight;
-        auto backpressure_timeout = m_publish_backpressure_timeout;
-
-        // Post publish work to the ASIO I/O thread
-        asio::co_spawn(m_ioc,
-            [matched_ids = std::move(matched_ids),
-             payload_copy = std::move(payload_copy),
-             snap_copy = std::move(snap_copy),
-             conn = std::move(conn),
-             log,
-             &published_counter,
-             &failure_counter,
-             &inflight_counter,
-             backpressure_timeout]() mutable -> asio::awaitable<void> {
-                std::span<const char> pub_payload(payload_copy.data(), payload_copy.size());
-                try {
-                    std::string wire;
-                    std::size_t output_count = 0;
-                    for (uint64_t sub_id : matched_ids) {
-                        auto subj_it = snap_copy->output_subjects.find(sub_id);
-                        if (subj_it == snap_copy->output_subjects.end()) continue;
-                        wire += "PUB ";
-                        wire += subj_it->second;
-                        wire += " ";
-                        wire += std::to_string(pub_payload.size());
-                        wire += "\r\n";
-                        wire.append(pub_payload.data(), pub_payload.size());
-                        wire += "\r\n";
-                        ++output_count;
+    // Up to one batch of counts from this worker's own semaphore, waiting
+    // as m_wait_strategy says; 0 once the wait times out without any.
+    unsigned int spin_budget = k_min_spins;
+    auto wait_own = [&]() -> ssize_t {
+        auto& ready = m_ready[worker_id];
+        switch (m_wait_strategy) {
+            case wait_strategy::park:
+                break;
+            case wait_strategy::adaptive:
+                // Spinning paid off: allow longer spins. Had to park: shorter.
+                for (unsigned int i = 0; i < spin_budget; ++i) {
+                    if (auto n = ready.tryWaitMany(batch_size); n > 0) {
+                        spin_budget = std::min(spin_budget * 2, k_max_spins);
+                        return n;
+                    }
+                    cpu_relax();
+                }
+                spin_budget = std::max(spin_budget / 2, k_min_spins);
+                break;
+            case wait_strategy::spin:
+            case wait_strategy::yield: {
+                const bool yielding = m_wait_strategy == wait_strategy::yield;
+                const auto deadline = std::chrono::steady_clock::now() +
+                                      std::chrono::microseconds(k_idle_poll_us);
+                for (unsigned int i = 1;; ++i) {
+                    if (auto n = ready.tryWaitMany(batch_size); n > 0) return n;
+                    if (yielding && i > k_min_spins) {
+                        std::this_thread::yield();
+                    } else {
+                        cpu_relax();
                     }
-                    if (!wire.empty()) {
-                        if (conn->is_backpressure_active()) {
-                            auto drain_status = co_await conn->wait_for_drain(
-                                backpressure_timeout);
-                            if (drain_status.failed()) {
-                                failure_counter.fetch_add(1, std::memory_order_relaxed);
-                                log->warn("Output backpressure wait failed: {}",
-                                          drain_status.error());
-                                inflight_counter.fetch_sub(1, std::memory_order_acq_rel);
-                                co_return;
-                            }
-                        }
-                        auto write_status = co_await conn->write_raw(
-                            std::span<const char>(wire.data(), wire.size()));
-                        if (write_status.failed()) {
-                            failure_counter.fetch_add(1, std::memory_order_relaxed);
-                            log->warn("Failed to write matched publications: {}",
-                                      write_status.error());
-                        } else {
-                            published_counter.fetch_add(output_count,
-                                                        std::memory_order_relaxed);
-                        }
+                    if (i % k_min_spins == 0 && std::chrono::steady_clock::now() >= deadline) {
+                        return 0;
                     }
-                } catch (const std::exception& e) {
-                    failure_counter.fetch_add(1, std::memory_order_relaxed);
-                    log->error("Publication task failed: {}", e.what());
                 }
-                inflight_counter.fetch_sub(1, std::memory_order_acq_rel);
-            },
-            asio::detached
-        );
+            }
+        }
+        if (park_timeout() == k_idle_poll_us) return ready.waitMany(batch_size, k_idle_poll_us);
+        return park();
+    };
+
+    // Each round starts at the next pipeline, so under load every pipeline
+    // gets first pick of the workers equally often.
+    std::size_t cursor = worker_id;
+    while (m_running.load(std::memory_order_acquire) ||
+           reserved_messages() != 0) {
+        // Wait on this worker's own lanes first; the timeout bounds how long
+        // an idle worker leaves a backlogged peer alone, and lets it notice
+        // shutdown.
+        std::size_t lane = worker_id;
+        auto owed = static_cast<std::size_t>(std::max<ssize_t>(0, wait_own()));
+        if (owed == 0) owed = steal(lane);
+        if (owed == 0) {
+            for (auto& p : m_pipelines) {
+                if (p->ordered) expire_ordered(*p);
+            }
+            continue;
+        }
 
-        payload.clear();
+        // Every acquired count has a message behind it in `lane` of some
+        // pipeline.
+        while (owed > 0) {
+            bool progress = false;
+            for (std::size_t turn = 0; turn < pipeline_count && owed > 0; ++turn) {
+                const auto index = (cursor + turn) % pipeline_count;
+                const auto count = m_pipelines[index]->lanes[lane].try_dequeue_bulk(items.begin(), owed);
+                if (count == 0) continue;
+                owed -= count;
+                progress = true;
+                process(index, count);
+            }
+            if (!progress) std::this_thread::yield();
+        }
+        cursor = (cursor + 1) % pipeline_count;
     }
 
+    // Release this worker's share of the cache gauges.
+    for (auto& s : scratch) s.cache.configure(0, 0);
+    report_cache();
+
     m_log->debug("Worker {} stopped", worker_id);
 }
 
+worker_pool::publication_ptr worker_pool::build_publication(
+    std::span<const uint64_t> matches, const tree_snapshot& snap,
+    std::span<const char> payload) {
+    // Encode only the matches that still have an output subject; the
+    // I/O thread then just writes the prepared buffer.
+    auto record = acquire_publication();
+    for (uint64_t sub_id : matches) {
+        auto subj_it = snap.output_subjects.find(sub_id);
+        if (subj_it == snap.output_subjects.end()) continue;
+        append_publication(record->wire, subj_it->second, payload);
+        ++record->output_count;
+    }
+
+    if (record->output_count == 0) {
+        recycle_publication(std::move(record));
+        return nullptr;
+    }
+    return record;
+}
+
+bool worker_pool::reserve_publication(pipeline& p) {
+    const auto previous_inflight = m_publish_inflight.fetch_add(
+        1, std::memory_order_acq_rel);
+    if (previous_inflight >= m_publish_max_inflight) {
+        m_publish_inflight.fetch_sub(1, std::memory_order_acq_rel);
+        p.publish_tasks_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void worker_pool::publish(pipeline& p, publication_ptr record, io_shard* out) {
+    if (!reserve_publication(p)) {
+        recycle_publication(std::move(record));
+        return;
+    }
+
+    // Post publish work to this worker's output shard, or to the main I/O
+    // thread without one. The pool outlives every accepted task: shutdown
+    // waits for m_publish_inflight to reach zero.
+    asio::co_spawn(out ? out->context() : m_ioc,
+        [this, &p, record = std::move(record),
+         conn = out ? out->connection() : m_conn]() mutable
+            -> asio::awaitable<void> {
+            co_await write_publication(p, conn, *record);
+            recycle_publication(std::move(record));
+            m_publish_inflight.fetch_sub(1, std::memory_order_acq_rel);
+        },
+        asio::detached
+    );
+}
+
+asio::awaitable<void> worker_pool::write_publication(pipeline& p,
+                                                     nats_asio::iconnection_sptr conn,
+                                                     publication& record) {
+    try {
+        if (conn->is_backpressure_active()) {
+            auto drain_status = co_await conn->wait_for_drain(
+                m_publish_backpressure_timeout);
+            if (drain_status.failed()) {
+                p.publish_failures.fetch_add(1, std::memory_order_relaxed);
+                m_log->warn("Output backpressure wait failed: {}",
+                            drain_status.error());
+                co_return;
+            }
+        }
+        auto write_status = co_await conn->write_raw(
+            std::span<const char>(record.wire.data(), record.wire.size()));
+        if (write_status.failed()) {
+            p.publish_failures.fetch_add(1, std::memory_order_relaxed);
+            m_log->warn("Failed to write matched publications: {}",
+                        write_status.error());
+        } else {
+            p.published.fetch_add(record.output_count, std::memory_order_relaxed);
+        }
+    } catch (const std::exception& e) {
+        p.publish_failures.fetch_add(1, std::memory_order_relaxed);
+        m_log->error("Publication task failed: {}", e.what());
+    }
+}
+
+void worker_pool::submit_ordered(pipeline& p, std::span<const uint64_t> sequences,
+                                 std::span<publication_ptr> records) {
+    auto& o = *p.ordered;
+    const auto now = reorder_buffer<publication_ptr>::clock::now();
+    {
+        // One lock per worker batch.
+        std::lock_guard<std::mutex> lock(o.mutex);
+        for (std::size_t k = 0; k < sequences.size(); ++k) {
+            o.reorder.submit(sequences[k], std::move(records[k]), now,
+                             [&](publication_ptr&& record) {
+                                 release_ordered(p, std::move(record));
+                             });
+        }
+    }
+    wake_ordered_writer(p);
+}
+
+void worker_pool::expire_ordered(pipeline& p) {
+    auto& o = *p.ordered;
+    {
+        std::lock_guard<std::mutex> lock(o.mutex);
+        o.reorder.expire(reorder_buffer<publication_ptr>::clock::now(),
+                         [&](publication_ptr&& record) {
+                             release_ordered(p, std::move(record));
+                         });
+    }
+    wake_ordered_writer(p);
+}
+
+void worker_pool::release_ordered(pipeline& p, publication_ptr record) {
+    if (!record) return;
+    if (!reserve_publication(p)) {
+        recycle_publication(std::move(record));
+        return;
+    }
+    p.ordered->ready.push_back(std::move(record));
+}
+
+void worker_pool::wake_ordered_writer(pipeline& p) {
+    auto& o = *p.ordered;
+    {
+        std::lock_guard<std::mutex> lock(o.mutex);
+        if (o.writer_active || o.ready.empty()) return;
+        o.writer_active = true;
+    }
+    asio::co_spawn(o.out ? o.out->context() : m_ioc,
+                   ordered_writer(p, o.out ? o.out->connection() : m_conn),
+                   asio::detached);
+}
+
+asio::awaitable<void> worker_pool::ordered_writer(pipeline& p,
+                                                  nats_asio::iconnection_sptr conn) {
+    // The only writer of this pipeline until `ready` runs dry, so records
+    // are written in the order they were released.
+    auto& o = *p.ordered;
+    for (;;) {
+        publication_ptr record;
+        {
+            std::lock_guard<std::mutex> lock(o.mutex);
+            if (o.ready.empty()) {
+                o.writer_active = false;
+                co_return;
+            }
+            record = std::move(o.ready.front());
+            o.ready.pop_front();
+        }
+        co_await write_publication(p, conn, *record);
+        recycle_publication(std::move(record));
+        m_publish_inflight.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
 } // namespace sidecar
@@ -2,21 +2,38 @@
 
 #include "config.hpp"
 #include "event_bridge.hpp"
+#include "io_shard.hpp"
+#include "reorder_buffer.hpp"
 #include "subscription_manager.hpp"
 #include <nats_asio/nats_asio.hpp>
 #include <asio/io_context.hpp>
 #include <asio/awaitable.hpp>
-#include <concurrentqueue/moodycamel/blockingconcurrentqueue.h>
+#include <concurrentqueue/moodycamel/concurrentqueue.h>
+#include <concurrentqueue/moodycamel/lightweightsemaphore.h>
 #include <spdlog/spdlog.h>
 #include <atomic>
 #include <cstdint>
+#include <deque>
 #include <memory>
 #include <mutex>
+#include <span>
+#include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 namespace sidecar {
 
+struct worker_pool_test_access;
+
+// Matches input messages on a fixed set of threads. A pool serves one or
+// more pipelines, each with its own input budget, format and subscriptions
+// (whose snapshots carry the schema); workers take turns between pipelines
+// so a busy one cannot starve the others. Every pipeline has one queue
+// (lane) per worker: input is placed on a lane round-robin or by partition
+// key, each worker drains its own lanes, and an idle worker steals from a
+// backlogged one. A pipeline in ordered mode numbers its input at admission
+// and publishes the results in that order through a reorder buffer.
 class worker_pool {
 public:
     struct stats {
@@ -30,68 +47,272 @@ public:
         std::size_t queue_depth = 0;
         std::size_t queue_bytes = 0;
         std::size_t publish_inflight = 0;
+        uint64_t cache_hits = 0;
+        uint64_t cache_misses = 0;
+        std::size_t cache_entries = 0;
+        std::size_t cache_bytes = 0;
+        uint64_t stolen = 0;
+        std::size_t reorder_pending = 0;
+        uint64_t reorder_skipped = 0;
+        uint64_t reorder_late = 0;
     };
 
+    // Pool without pipelines; thread count, batch size, match cache,
+    // publication limits and worker placement come from `cfg`.
+    worker_pool(asio::io_context& ioc, const config& cfg,
+                nats_asio::iconnection_sptr conn,
+                std::shared_ptr<spdlog::logger> log);
+
+    // Pool serving the single pipeline described by `cfg`.
     worker_pool(asio::io_context& ioc, const config& cfg,
-                const attribute_schema& schema,
                 subscription_manager& sub_mgr,
                 nats_asio::iconnection_sptr conn,
                 std::shared_ptr<spdlog::logger> log);
     ~worker_pool();
 
+    // Register a pipeline; its format and input queue limits come from
+    // `cfg`. In NUMA-aware mode its subscription manager gets one snapshot
+    // replica per node. Must be called before start(). Returns the index to
+    // enqueue to.
+    std::size_t add_pipeline(const config& cfg, subscription_manager& sub_mgr);
+
+    // Publish through these connections instead of the main one: worker i
+    // writes through shard i % size on that shard's I/O thread. Must be
+    // called before start().
+    void set_output_shards(std::vector<std::shared_ptr<io_shard>> shards);
+
     // Spawn N worker threads. Must be called once.
     void start();
 
-    // Signal workers to stop, drain the queue, and join threads.
+    // Signal workers to stop, drain the queues, and join threads.
     void stop();
 
+    // Empty buffer for an input payload of `size` bytes. Reuses the storage
+    // of a payload a worker has finished with when one of a fitting size is
+    // available, so steady-state ingest does not allocate.
+    std::vector<char> acquire_buffer(std::size_t size);
+
     // Enqueue a payload for worker processing (move semantics).
     // Returns false when shutdown has begun or a queue limit is reached.
-    bool enqueue(std::vector<char> payload);
+    bool enqueue(std::size_t pipeline, std::vector<char> payload);
+    bool enqueue(std::vector<char> payload) { return enqueue(0, std::move(payload)); }
+
+    // Admit a batch of payloads with one admission check. Payloads are
+    // admitted in order while they fit the pipeline's limits; admitted ones
+    // are moved out, and the rest are left at the back of `payloads` and
+    // counted as dropped. Returns the number admitted.
+    //
+    // Without `keys` the batch goes to one lane, chosen round-robin, in a
+    // single bulk insert. Otherwise `keys` holds one partition key per
+    // payload (reordered along with them) and each payload goes to lane
+    // key % worker count, so equal keys always reach the same worker.
+    std::size_t enqueue_bulk(std::size_t pipeline, std::span<std::vector<char>> payloads,
+                             std::span<uint64_t> keys = {});
 
     // Wait for every accepted publication coroutine to complete.
     asio::awaitable<bool> wait_for_publications(std::chrono::milliseconds timeout);
 
-    // Approximate queue depth.
+    // Approximate queue depth across all pipelines.
     std::size_t queue_depth() const;
 
-    // Atomically read aggregate stats from all workers.
+    // Largest input_queue_max_messages / input_queue_max_bytes a pipeline
+    // can enforce; the admission budget packs both into one 64-bit word.
+    static constexpr std::size_t k_max_queue_messages = (std::size_t{1} << 23) - 1;
+    static constexpr std::size_t k_max_queue_bytes = (std::size_t{1} << 40) - 1;
+
+    // Atomically read aggregate stats from all workers and pipelines.
     stats get_stats() const;
 
+    // Stats of one pipeline; publication and cache gauges are pool-wide.
+    stats get_stats(std::size_t pipeline) const;
+
 private:
+    friend struct worker_pool_test_access;
+
+    // Wire-encoded output for one input message, built on the worker thread
+    // and written by a publication coroutine. Records are recycled through
+    // m_publication_pool so steady-state publishing reuses their buffers.
+    struct publication {
+        std::string wire;
+        std::size_t output_count = 0;
+    };
+
+    using publication_ptr = std::unique_ptr<publication>;
+
+    static constexpr uint64_t k_budget_closed = uint64_t{1} << 63;
+    static constexpr int k_budget_message_shift = 40;
+    static constexpr uint64_t k_budget_bytes_mask = (uint64_t{1} << k_budget_message_shift) - 1;
+
+    // A queued input payload; `sequence` is its admission order within the
+    // pipeline (only used in ordered mode).
+    struct input_message {
+        std::vector<char> payload;
+        uint64_t sequence = 0;
+    };
+
+    using lane_queue = moodycamel::ConcurrentQueue<input_message>;
+
+    // Ordered mode state of one pipeline, guarded by `mutex`. Results pass
+    // through `reorder` into `ready`, which a single writer coroutine drains
+    // on one output connection, so publications reach NATS in input order.
+    struct ordered_output {
+        ordered_output(std::size_t capacity, std::chrono::milliseconds timeout)
+            : reorder(capacity, timeout) {}
+
+        std::mutex mutex;
+        reorder_buffer<publication_ptr> reorder;
+        std::deque<publication_ptr> ready;
+        bool writer_active = false;
+        io_shard* out = nullptr;  // set by start(); null = main connection
+    };
+
+    struct pipeline {
+        pipeline(const config& cfg, subscription_manager& sub_mgr, std::size_t lane_count);
+
+        binary_format format;
+        subscription_manager& sub_mgr;
+        std::size_t max_messages;
+        std::size_t max_bytes;
+
+        // Lane i is drained by worker i (and by thieves when it backs up).
+        std::unique_ptr<lane_queue[]> lanes;
+        std::atomic<std::size_t> next_lane{0};  // round-robin for unkeyed batches
+        std::atomic<uint64_t> next_sequence{0};
+        std::unique_ptr<ordered_output> ordered;  // null unless ordered_output is set
+        // Admission budget: queued messages (bits 40-62), queued bytes
+        // (bits 0-39) and the closed flag (bit 63), reserved together with
+        // one CAS. Closed until start(), and again from stop() on.
+        std::atomic<uint64_t> budget{k_budget_closed};
+
+        // Per-pipeline stats (relaxed atomics)
+        std::atomic<uint64_t> processed{0};
+        std::atomic<uint64_t> matched{0};
+        std::atomic<uint64_t> published{0};
+        std::atomic<uint64_t> match_failures{0};
+        std::atomic<uint64_t> input_dropped{0};
+        std::atomic<uint64_t> publish_tasks_dropped{0};
+        std::atomic<uint64_t> publish_failures{0};
+    };
+
+    static std::size_t budget_messages(uint64_t budget) {
+        return static_cast<std::size_t>((budget & ~k_budget_closed) >> k_budget_message_shift);
+    }
+    static std::size_t budget_bytes(uint64_t budget) {
+        return static_cast<std::size_t>(budget & k_budget_bytes_mask);
+    }
+
+    // Decide which of `payloads` fit `p`'s limits on top of `budget`, in
+    // order. With `compact`, admitted payloads are swapped to the front.
+    // Returns {admitted messages, admitted bytes}.
+    static std::pair<std::size_t, std::size_t> admit(const pipeline& p, uint64_t budget,
+                                                     std::span<std::vector<char>> payloads,
+                                                     std::span<uint64_t> keys, bool compact);
+
+    // Place admitted payloads on their lanes. Returns how many were queued;
+    // the reservation of any that could not be is released.
+    std::size_t dispatch(pipeline& p, std::span<std::vector<char>> payloads,
+                         std::span<const uint64_t> keys);
+    std::size_t insert(pipeline& p, std::size_t lane, std::span<std::vector<char>> payloads,
+                       uint64_t first_sequence);
+
+    // After input was signalled on `lane`: wake the lane's owner if it is
+    // parked, and a parked peer too once the lane holds a backlog worth
+    // stealing.
+    void wake_idle(std::size_t lane);
+    // Wake `worker` if it is parked; returns whether it was.
+    bool wake(std::size_t worker);
+
+    // Messages reserved in any pipeline and not yet processed.
+    std::size_t reserved_messages() const;
+
     void worker_loop(unsigned int worker_id);
 
+    // Shard worker `worker_id` publishes through; nullptr for the main
+    // connection.
+    io_shard* output_shard(unsigned int worker_id) const;
+
+    // Encode the publications of one matched message; null when none of the
+    // matches still has an output subject.
+    publication_ptr build_publication(std::span<const uint64_t> matches,
+                                      const tree_snapshot& snap,
+                                      std::span<const char> payload);
+
+    // Count `record` against publish_max_inflight and spawn its write on
+    // `out`'s I/O thread (or the main one); dropped when over the limit.
+    void publish(pipeline& p, publication_ptr record, io_shard* out);
+    bool reserve_publication(pipeline& p);
+    asio::awaitable<void> write_publication(pipeline& p, nats_asio::iconnection_sptr conn,
+                                            publication& record);
+
+    // Ordered mode: hand the results (null = nothing to publish) of the
+    // messages numbered `sequences` to the pipeline's reorder buffer, and
+    // queue whatever is now in order for the writer.
+    void submit_ordered(pipeline& p, std::span<const uint64_t> sequences,
+                        std::span<publication_ptr> records);
+    // Give up on sequences that have held later results past the timeout.
+    void expire_ordered(pipeline& p);
+    // Called with p.ordered->mutex held.
+    void release_ordered(pipeline& p, publication_ptr record);
+    void wake_ordered_writer(pipeline& p);
+    asio::awaitable<void> ordered_writer(pipeline& p, nats_asio::iconnection_sptr conn);
+    publication_ptr acquire_publication();
+    void recycle_publication(publication_ptr record);
+    void recycle_buffer(std::vector<char> buffer);
+
     asio::io_context& m_ioc;
-    binary_format m_format;
-    const attribute_schema& m_schema;
-    subscription_manager& m_sub_mgr;
     nats_asio::iconnection_sptr m_conn;
     std::shared_ptr<spdlog::logger> m_log;
 
     unsigned int m_thread_count;
+    std::size_t m_batch_size;
+    std::size_t m_match_cache_entries;
+    std::size_t m_match_cache_max_bytes;
+    wait_strategy m_wait_strategy;
     std::atomic<bool> m_running{false};
-    std::atomic<bool> m_accepting{false};
 
-    std::size_t m_queue_max_messages;
-    std::size_t m_queue_max_bytes;
+    // Where worker i runs: the CPUs it is pinned to (empty = anywhere) and
+    // the NUMA node whose snapshot replica it reads.
+    struct placement {
+        std::vector<int> cpus;
+        std::size_t node = 0;
+    };
+    std::vector<placement> m_placement;
+    std::vector<std::vector<int>> m_numa_nodes;  // empty unless NUMA-aware on 2+ nodes
+
     std::size_t m_publish_max_inflight;
     std::chrono::milliseconds m_publish_backpressure_timeout;
 
-    moodycamel::BlockingConcurrentQueue<std::vector<char>> m_queue;
+    std::vector<std::unique_ptr<pipeline>> m_pipelines;
+    std::vector<std::shared_ptr<io_shard>> m_output_shards;
+    // One per worker, counting the messages in that worker's lanes of all
+    // pipelines. Counts are acquired before dequeuing (by the owner, or by a
+    // thief from the victim's semaphore), so a count always has a message
+    // behind it.
+    std::unique_ptr<moodycamel::LightweightSemaphore[]> m_ready;
+    // One per worker. A worker with nothing of its own and nothing to steal
+    // sets `parked` and blocks on `wake` rather than on its m_ready, so
+    // insert() can wake it for a peer's backlog as well as for its own
+    // input. Whoever clears `parked` decrements m_parked.
+    struct idle_worker {
+        std::atomic<bool> parked{false};
+        moodycamel::LightweightSemaphore wake;
+    };
+    std::unique_ptr<idle_worker[]> m_idle;
+    std::atomic<unsigned int> m_parked{0};
+    // How long a parked worker waits for a wake before looking around
+    // again; k_idle_park_us unless a test raises it.
+    std::int64_t m_park_us;
+    moodycamel::ConcurrentQueue<publication_ptr> m_publication_pool;
+    moodycamel::ConcurrentQueue<std::vector<char>> m_buffer_pool;
     std::vector<std::thread> m_threads;
-    std::mutex m_enqueue_mutex;
-    std::atomic<std::size_t> m_queued_messages{0};
-    std::atomic<std::size_t> m_queued_bytes{0};
     std::atomic<std::size_t> m_publish_inflight{0};
+    std::atomic<uint64_t> m_stolen{0};
 
-    // Aggregate stats (relaxed atomics)
-    std::atomic<uint64_t> m_processed{0};
-    std::atomic<uint64_t> m_matched{0};
-    std::atomic<uint64_t> m_published{0};
-    std::atomic<uint64_t> m_match_failures{0};
-    std::atomic<uint64_t> m_input_dropped{0};
-    std::atomic<uint64_t> m_publish_tasks_dropped{0};
-    std::atomic<uint64_t> m_publish_failures{0};
+    // Pool-wide cache gauges (relaxed atomics)
+    std::atomic<uint64_t> m_cache_hits{0};
+    std::atomic<uint64_t> m_cache_misses{0};
+    std::atomic<std::size_t> m_cache_entries{0};
+    std::atomic<std::size_t> m_cache_bytes{0};
 };
 
 } // namespace sidecar
@@ -1,8 +1,11 @@
 #include "event_bridge.hpp"
 #include "config.hpp"
+#include "subscription_manager.hpp"
 #include <gtest/gtest.h>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/null_sink.h>
+#include <algorithm>
+#include <vector>
 
 // These tests verify the attribute_schema lookup and lease_manager key parsing.
 // Full event_bridge tests require a-tree + zerialize and will be integration tests.
@@ -43,6 +46,109 @@ TEST(attribute_schema, lookup_unknown_returns_nullopt) {
     EXPECT_FALSE(r.has_value());
 }
 
+TEST(attribute_schema, assigns_dense_slots_in_declaration_order) {
+    std::vector<sidecar::attribute_def> defs = {
+        {"temperature", sidecar::attribute_type::float_val},
+        {"location",    sidecar::attribute_type::string},
+        {"temperature", sidecar::attribute_type::integer},
+    };
+
+    sidecar::attribute_schema schema(defs);
+
+    ASSERT_EQ(schema.size(), 2u);
+    auto t = schema.find("temperature");
+    ASSERT_TRUE(t.has_value());
+    EXPECT_EQ(t->index, 0u);
+    EXPECT_EQ(t->type, sidecar::attribute_type::integer);
+    EXPECT_EQ(schema.find("location")->index, 1u);
+}
+
+TEST(decoded_event, reset_clears_values_and_keeps_storage) {
+    sidecar::decoded_event event;
+    event.reset(3);
+    event.set_string(0, "warehouse-7");
+    event.begin_string_list(1);
+    event.push_string(1, "a");
+    event.push_string(1, "bb");
+    event.begin_integer_list(2);
+    event.push_integer(2, 4);
+
+    EXPECT_EQ(event.string(0), "warehouse-7");
+    ASSERT_EQ(event.string_list_size(1), 2u);
+    EXPECT_EQ(event.string_list_at(1, 1), "bb");
+    ASSERT_EQ(event.integer_list(2).size(), 1u);
+    EXPECT_EQ(event.integer_list(2)[0], 4);
+
+    event.reset(3);
+    for (std::size_t i = 0; i < event.size(); ++i) {
+        EXPECT_EQ(event.status(i), sidecar::decoded_event::state::absent);
+    }
+
+    event.set_undefined(0);
+    event.set_float(1, 21.5);
+    EXPECT_EQ(event.status(0), sidecar::decoded_event::state::undefined);
+    EXPECT_TRUE(event.has_value(1));
+    EXPECT_DOUBLE_EQ(event.real(1), 21.5);
+}
+
+TEST(match_batch, reports_undecodable_payloads_per_event) {
+    std::vector<sidecar::attribute_def> defs = {
+        {"value", sidecar::attribute_type::integer},
+    };
+    sidecar::attribute_schema schema(defs);
+    auto builder = atree::Tree::builder();
+    builder.with_integer("value");
+    sidecar::tree_snapshot snap;
+    snap.tree = std::make_shared<atree::Tree>(std::move(builder).build());
+
+    // 0xc1 is reserved/invalid in MessagePack.
+    std::vector<std::vector<char>> payloads(3, std::vector<char>{static_cast<char>(0xc1)});
+    sidecar::match_scratch scratch;
+    sidecar::batch_matches results;
+    sidecar::match_batch(snap, schema, sidecar::binary_format::msgpack,
+                         payloads, scratch, results, make_log());
+
+    ASSERT_EQ(results.size(), 3u);
+    ASSERT_EQ(results.offsets.size(), 4u);
+    for (std::size_t k = 0; k < results.size(); ++k) {
+        EXPECT_TRUE(results.failed[k]);
+        EXPECT_TRUE(results.matches(k).empty());
+    }
+}
+
+TEST(match_batch, reports_matches_per_event) {
+    sidecar::subscription_manager subscriptions(
+        {{"value", sidecar::attribute_type::integer}}, "output", make_log());
+    const auto equal = subscriptions.subscribe("value = 5", "client");
+    const auto high = subscriptions.subscribe("value >= 10", "client");
+    const auto low = subscriptions.subscribe("value < 3", "client");
+    const auto wide = subscriptions.subscribe("value < 8", "client");
+
+    // MessagePack {"value": n} for small n.
+    auto value = [](char n) {
+        return std::vector<char>{static_cast<char>(0x81), static_cast<char>(0xa5),
+                                 'v', 'a', 'l', 'u', 'e', n};
+    };
+    std::vector<std::vector<char>> payloads = {
+        value(5), value(20), value(8), {static_cast<char>(0xc1)}, value(1), value(9)};
+    sidecar::match_scratch scratch;
+    sidecar::batch_matches results;
+    sidecar::match_batch(*subscriptions.snapshot(), *subscriptions.schema(),
+                         sidecar::binary_format::msgpack, payloads, scratch, results, make_log());
+
+    const std::vector<std::vector<uint64_t>> expected = {
+        {equal, wide}, {high}, {}, {}, {low, wide}, {}};
+    ASSERT_EQ(results.size(), expected.size());
+    for (std::size_t k = 0; k < results.size(); ++k) {
+        EXPECT_EQ(results.failed[k] != 0, k == 3) << "event " << k;
+        std::vector<uint64_t> ids(results.matches(k).begin(), results.matches(k).end());
+        std::sort(ids.begin(), ids.end());
+        auto want = expected[k];
+        std::sort(want.begin(), want.end());
+        EXPECT_EQ(ids, want) << "event " << k;
+    }
+}
+
 TEST(config_parsing, parse_format) {
     EXPECT_EQ(sidecar::parse_format("msgpack"),     sidecar::binary_format::msgpack);
     EXPECT_EQ(sidecar::parse_format("cbor"),        sidecar::binary_format::cbor);
@@ -63,6 +169,19 @@ TEST(config_parsing, parse_attribute_type) {
     EXPECT_FALSE(sidecar::parse_attribute_type("invalid").has_value());
 }
 
+TEST(config_parsing, parse_cpu_list) {
+    EXPECT_EQ(sidecar::parse_cpu_list("0-3,8"), (std::vector<int>{0, 1, 2, 3, 8}));
+    EXPECT_EQ(sidecar::parse_cpu_list("5"), (std::vector<int>{5}));
+    EXPECT_EQ(sidecar::parse_cpu_list(""), std::vector<int>{});
+    EXPECT_FALSE(sidecar::parse_cpu_list("3-1").has_value());
+    EXPECT_FALSE(sidecar::parse_cpu_list("1,,2").has_value());
+    EXPECT_FALSE(sidecar::parse_cpu_list("a-b").has_value());
+    EXPECT_FALSE(sidecar::parse_cpu_list("-1").has_value());
+    EXPECT_EQ(sidecar::parse_cpu_list("1023")->size(), 1u);
+    EXPECT_FALSE(sidecar::parse_cpu_list("1024").has_value());
+    EXPECT_FALSE(sidecar::parse_cpu_list("0-2147483647").has_value());
+}
+
 // Lease key parsing tests
 #include "lease_manager.hpp"
 
@@ -0,0 +1,132 @@
+#include "equality_index.hpp"
+#include "expression.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<sidecar::attribute_def> sample_attributes() {
+    return {
+        {"temperature", sidecar::attribute_type::float_val},
+        {"location",    sidecar::attribute_type::string},
+        {"severity",    sidecar::attribute_type::integer},
+        {"active",      sidecar::attribute_type::boolean},
+        {"tags",        sidecar::attribute_type::string_list},
+    };
+}
+
+} // namespace
+
+TEST(expression, parses_and_flattens_boolean_operators) {
+    auto node = sidecar::parse_expression(
+        "temperature > 30.0 AND (location = \"w7\" and severity >= 2) OR not active");
+    ASSERT_TRUE(node.has_value());
+    ASSERT_EQ(node->type, sidecar::expression_node::kind::disjunction);
+    ASSERT_EQ(node->children.size(), 2u);
+
+    const auto& conj = node->children[0];
+    ASSERT_EQ(conj.type, sidecar::expression_node::kind::conjunction);
+    ASSERT_EQ(conj.children.size(), 3u);
+    EXPECT_EQ(conj.children[0].attribute, "temperature");
+    EXPECT_EQ(conj.children[0].op, sidecar::predicate_op::gt);
+    EXPECT_EQ(std::get<double>(conj.children[0].values[0]), 30.0);
+    EXPECT_EQ(std::get<std::string>(conj.children[1].values[0]), "w7");
+    EXPECT_EQ(std::get<int64_t>(conj.children[2].values[0]), 2);
+
+    const auto& neg = node->children[1];
+    ASSERT_EQ(neg.type, sidecar::expression_node::kind::negation);
+    EXPECT_EQ(neg.children[0].op, sidecar::predicate_op::truthy);
+}
+
+TEST(expression, parses_list_and_null_predicates) {
+    auto node = sidecar::parse_expression(
+        "tags one of ['a', \"b\"] and severity not in [1, -2] and location is not null");
+    ASSERT_TRUE(node.has_value());
+    ASSERT_EQ(node->children.size(), 3u);
+    EXPECT_EQ(node->children[0].op, sidecar::predicate_op::one_of);
+    EXPECT_EQ(node->children[0].values.size(), 2u);
+    EXPECT_EQ(node->children[1].op, sidecar::predicate_op::not_in);
+    EXPECT_EQ(std::get<int64_t>(node->children[1].values[1]), -2);
+    EXPECT_EQ(node->children[2].op, sidecar::predicate_op::is_not_null);
+}
+
+TEST(expression, rejects_unmodelled_syntax) {
+    EXPECT_FALSE(sidecar::parse_expression("this is not a valid expression !!!").has_value());
+    EXPECT_FALSE(sidecar::parse_expression("location = ").has_value());
+    EXPECT_FALSE(sidecar::parse_expression("(severity = 1").has_value());
+    EXPECT_FALSE(sidecar::parse_expression("location = \"unterminated").has_value());
+}
+
+TEST(equality_index, detects_pure_equality_conjunctions) {
+    sidecar::attribute_schema schema(sample_attributes());
+
+    auto eq = sidecar::parse_expression("location = \"w7\" AND severity = 5 AND active");
+    ASSERT_TRUE(eq.has_value());
+    auto terms = sidecar::equality_terms(*eq, schema);
+    ASSERT_TRUE(terms.has_value());
+    EXPECT_EQ(terms->size(), 3u);
+
+    for (const char* text : {"temperature = 1.5", "severity > 5", "location = 5",
+                             "severity = 1 AND severity = 2", "location = \"a\" OR active",
+                             "unknown = 1"}) {
+        auto node = sidecar::parse_expression(text);
+        ASSERT_TRUE(node.has_value()) << text;
+        EXPECT_FALSE(sidecar::equality_terms(*node, schema).has_value()) << text;
+    }
+}
+
+TEST(equality_index, probe_returns_subscriptions_with_matching_tuple) {
+    sidecar::attribute_schema schema(sample_attributes());
+    sidecar::equality_index index;
+    auto add = [&](uint64_t id, const char* text) {
+        auto node = sidecar::parse_expression(text);
+        ASSERT_TRUE(node.has_value());
+        auto terms = sidecar::equality_terms(*node, schema);
+        ASSERT_TRUE(terms.has_value());
+        index.add(id, *terms);
+    };
+    add(1, "location = \"w7\" AND severity = 5");
+    add(2, "severity = 5 and location = \"w7\"");
+    add(3, "location = \"w8\"");
+    add(4, "location = \"w7\"");
+
+    sidecar::decoded_event event;
+    event.reset(schema.size());
+    event.set_string(schema.find("location")->index, "w7");
+    event.set_integer(schema.find("severity")->index, 5);
+
+    std::string key;
+    std::vector<uint64_t> out;
+    index.probe(event, schema, key, out);
+    std::sort(out.begin(), out.end());
+    EXPECT_EQ(out, (std::vector<uint64_t>{1, 2, 4}));
+
+    event.set_undefined(schema.find("severity")->index);
+    out.clear();
+    index.probe(event, schema, key, out);
+    EXPECT_EQ(out, (std::vector<uint64_t>{4}));
+}
+
+TEST(expression, canonical_form_ignores_order_spacing_and_case) {
+    sidecar::attribute_schema schema(sample_attributes());
+    auto canonical = [&](const char* text) {
+        auto node = sidecar::parse_expression(text);
+        EXPECT_TRUE(node.has_value()) << text;
+        if (!node) return std::string();
+        sidecar::canonicalize(*node, schema);
+        return sidecar::format_expression(*node);
+    };
+
+    const auto base = canonical("temperature > 1 AND location = \"x\"");
+    EXPECT_EQ(base, "location = \"x\" and temperature > 1.0");
+    EXPECT_EQ(canonical("location = 'x'   and temperature > 1.0"), base);
+    EXPECT_EQ(canonical("(location = \"x\") AND temperature > 1 AND location = \"x\""), base);
+    EXPECT_EQ(canonical("not not (temperature > 1.0 and location = \"x\")"), base);
+
+    EXPECT_EQ(canonical("severity in [3, 1, 3] OR active OR active"),
+              "active or severity in [1, 3]");
+    EXPECT_EQ(canonical("a or (b and c) or (c and b)"), "a or (b and c)");
+    EXPECT_NE(canonical("severity > 1"), canonical("severity >= 1"));
+
+    // The canonical text parses back to itself.
+    EXPECT_EQ(canonical(base.c_str()), base);
+}
@@ -0,0 +1,72 @@
+#include "linear_matcher.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<sidecar::attribute_def> sample_attributes() {
+    return {
+        {"temperature", sidecar::attribute_type::float_val},
+        {"location",    sidecar::attribute_type::string},
+        {"severity",    sidecar::attribute_type::integer},
+        {"active",      sidecar::attribute_type::boolean},
+        {"tags",        sidecar::attribute_type::string_list},
+    };
+}
+
+bool compile(sidecar::linear_matcher& matcher, uint64_t id, const char* text,
+             const sidecar::attribute_schema& schema) {
+    auto node = sidecar::parse_expression(text);
+    return node && matcher.add(id, *node, schema);
+}
+
+} // namespace
+
+TEST(linear_matcher, evaluates_compiled_expressions) {
+    sidecar::attribute_schema schema(sample_attributes());
+    sidecar::linear_matcher matcher;
+    ASSERT_TRUE(compile(matcher, 1, "temperature > 30.0 AND location = \"w7\"", schema));
+    ASSERT_TRUE(compile(matcher, 2, "severity in [4, 5] OR active", schema));
+    ASSERT_TRUE(compile(matcher, 3, "tags all of [\"a\", \"b\"]", schema));
+    ASSERT_TRUE(compile(matcher, 4, "temperature <= 10", schema));
+
+    sidecar::decoded_event event;
+    event.reset(schema.size());
+    event.set_float(schema.find("temperature")->index, 35.0);
+    event.set_string(schema.find("location")->index, "w7");
+    event.set_boolean(schema.find("active")->index, false);
+    const auto tags = schema.find("tags")->index;
+    event.begin_string_list(tags);
+    event.push_string(tags, "b");
+    event.push_string(tags, "a");
+
+    std::vector<uint64_t> out;
+    matcher.match(event, out);
+    EXPECT_EQ(out, (std::vector<uint64_t>{1, 3}));
+
+    // Missing attributes never satisfy a predicate.
+    event.reset(schema.size());
+    event.set_integer(schema.find("severity")->index, 5);
+    out.clear();
+    matcher.match(event, out);
+    EXPECT_EQ(out, (std::vector<uint64_t>{2}));
+}
+
+TEST(linear_matcher, rejects_expressions_outside_the_safe_subset) {
+    sidecar::attribute_schema schema(sample_attributes());
+    sidecar::linear_matcher matcher;
+    ASSERT_TRUE(compile(matcher, 1, "location = \"w7\"", schema));
+
+    for (const char* text : {"not active", "location <> \"w7\"", "tags none of [\"a\"]",
+                             "location is null", "severity = 2.5", "unknown = 1",
+                             "temperature > 1.0 AND NOT active"}) {
+        EXPECT_FALSE(compile(matcher, 2, text, schema)) << text;
+    }
+    EXPECT_EQ(matcher.size(), 1u);
+
+    sidecar::decoded_event event;
+    event.reset(schema.size());
+    event.set_string(schema.find("location")->index, "w7");
+    std::vector<uint64_t> out;
+    matcher.match(event, out);
+    EXPECT_EQ(out, (std::vector<uint64_t>{1}));
+}
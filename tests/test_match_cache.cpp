@@ -0,0 +1,107 @@
+#include "match_cache.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<uint64_t> ids_of(const std::vector<uint64_t>* ids) {
+    return ids ? *ids : std::vector<uint64_t>{};
+}
+
+} // namespace
+
+TEST(match_cache, evicts_least_recently_used_entry) {
+    sidecar::match_cache cache;
+    cache.configure(2, 1 << 20);
+    cache.sync(1);
+
+    const std::vector<uint64_t> a{1, 2};
+    const std::vector<uint64_t> b{3};
+    cache.insert("a", a);
+    cache.insert("b", b);
+    ASSERT_NE(cache.find("a"), nullptr);  // "b" is now least recently used
+
+    cache.insert("c", std::vector<uint64_t>{});
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_EQ(cache.find("b"), nullptr);
+    EXPECT_EQ(ids_of(cache.find("a")), a);
+    ASSERT_NE(cache.find("c"), nullptr);
+    EXPECT_TRUE(cache.find("c")->empty());
+
+    EXPECT_EQ(cache.hits(), 4u);
+    EXPECT_EQ(cache.misses(), 1u);
+}
+
+TEST(match_cache, respects_byte_limit_and_snapshot_version) {
+    sidecar::match_cache cache;
+    cache.configure(100, 300);
+    cache.sync(7);
+
+    const std::vector<uint64_t> ids(8, 42);
+    cache.insert("first", ids);
+    cache.insert("second", ids);
+    EXPECT_EQ(cache.size(), 1u);
+    EXPECT_LE(cache.bytes(), 300u);
+    EXPECT_NE(cache.find("second"), nullptr);
+
+    cache.insert("huge", std::vector<uint64_t>(100, 1));  // larger than the whole budget
+    EXPECT_EQ(cache.find("huge"), nullptr);
+
+    cache.sync(7);
+    EXPECT_EQ(cache.size(), 1u);
+    cache.sync(8);
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_LE(cache.bytes(), 300u);  // the emptied node keeps its buffers
+    EXPECT_EQ(cache.find("second"), nullptr);
+    cache.configure(0, 0);
+    EXPECT_EQ(cache.bytes(), 0u);
+}
+
+TEST(match_cache, bytes_count_buffers_held_for_reuse) {
+    sidecar::match_cache cache;
+    cache.configure(1, 1 << 20);
+    cache.sync(1);
+
+    const std::vector<uint64_t> many(1000, 7);
+    cache.insert("many", many);
+    EXPECT_GE(cache.bytes(), many.size() * sizeof(uint64_t));
+
+    // Evicted or not, the node's buffers are still held.
+    cache.sync(2);
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_GE(cache.bytes(), many.size() * sizeof(uint64_t));
+
+    // A small entry reusing the node does not keep the large buffers.
+    cache.insert("few", std::vector<uint64_t>{1});
+    EXPECT_EQ(cache.size(), 1u);
+    EXPECT_LT(cache.bytes(), 1024u);
+    EXPECT_EQ(ids_of(cache.find("few")), std::vector<uint64_t>{1});
+}
+
+TEST(match_cache, event_key_distinguishes_missing_and_null_values) {
+    sidecar::attribute_schema schema({
+        {"location", sidecar::attribute_type::string},
+        {"severity", sidecar::attribute_type::integer},
+    });
+
+    auto key_of = [&](const sidecar::decoded_event& event) {
+        std::string key;
+        sidecar::append_event_key(key, event, schema);
+        return key;
+    };
+
+    sidecar::decoded_event absent;
+    absent.reset(schema.size());
+    sidecar::decoded_event null_value;
+    null_value.reset(schema.size());
+    null_value.set_undefined(1);
+    sidecar::decoded_event zero;
+    zero.reset(schema.size());
+    zero.set_integer(1, 0);
+    sidecar::decoded_event zero_again;
+    zero_again.reset(schema.size());
+    zero_again.set_integer(1, 0);
+
+    EXPECT_NE(key_of(absent), key_of(null_value));
+    EXPECT_NE(key_of(null_value), key_of(zero));
+    EXPECT_EQ(key_of(zero), key_of(zero_again));
+}
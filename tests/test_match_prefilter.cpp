@@ -0,0 +1,74 @@
+#include "match_prefilter.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<sidecar::attribute_def> sample_attributes() {
+    return {
+        {"temperature", sidecar::attribute_type::float_val},
+        {"location",    sidecar::attribute_type::string},
+        {"severity",    sidecar::attribute_type::integer},
+        {"active",      sidecar::attribute_type::boolean},
+    };
+}
+
+sidecar::match_prefilter make_prefilter(const sidecar::attribute_schema& schema,
+                                        std::initializer_list<const char*> expressions) {
+    sidecar::match_prefilter prefilter;
+    for (const char* text : expressions) {
+        auto node = sidecar::parse_expression(text);
+        prefilter.add(node ? &*node : nullptr, schema);
+    }
+    prefilter.seal();
+    return prefilter;
+}
+
+} // namespace
+
+TEST(match_prefilter, rejects_events_outside_every_anchor) {
+    sidecar::attribute_schema schema(sample_attributes());
+    auto prefilter = make_prefilter(schema, {
+        "temperature > 30.0 AND location = \"w7\"",
+        "severity in [4, 5] OR temperature < -10",
+    });
+    ASSERT_TRUE(prefilter.enabled());
+
+    const auto temperature = schema.find("temperature")->index;
+    const auto location = schema.find("location")->index;
+    const auto severity = schema.find("severity")->index;
+    std::string key;
+    sidecar::decoded_event event;
+
+    event.reset(schema.size());
+    event.set_string(location, "w8");
+    event.set_integer(severity, 1);
+    event.set_float(temperature, 20.0);
+    EXPECT_FALSE(prefilter.may_match(event, schema, key));
+
+    event.set_string(location, "w7");
+    EXPECT_TRUE(prefilter.may_match(event, schema, key));
+
+    event.reset(schema.size());
+    event.set_integer(severity, 5);
+    EXPECT_TRUE(prefilter.may_match(event, schema, key));
+
+    event.reset(schema.size());
+    event.set_float(temperature, -20.0);
+    EXPECT_TRUE(prefilter.may_match(event, schema, key));
+}
+
+TEST(match_prefilter, disabled_by_unbounded_expressions) {
+    sidecar::attribute_schema schema(sample_attributes());
+    std::string key;
+    sidecar::decoded_event event;
+    event.reset(schema.size());
+
+    for (const char* text : {"not active", "location <> \"w7\"", "location = \"a\" OR severity <> 1"}) {
+        auto prefilter = make_prefilter(schema, {"location = \"w7\"", text});
+        EXPECT_FALSE(prefilter.enabled()) << text;
+        EXPECT_TRUE(prefilter.may_match(event, schema, key)) << text;
+    }
+
+    auto unparsed = make_prefilter(schema, {"location = \"w7\"", "some future syntax !!!"});
+    EXPECT_FALSE(unparsed.enabled());
+}
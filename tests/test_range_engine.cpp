@@ -0,0 +1,90 @@
+#include "range_engine.hpp"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace {
+
+std::vector<sidecar::attribute_def> sample_attributes() {
+    return {
+        {"temperature", sidecar::attribute_type::float_val},
+        {"pressure",    sidecar::attribute_type::float_val},
+        {"location",    sidecar::attribute_type::string},
+    };
+}
+
+bool add(sidecar::range_engine& engine, uint64_t id, const char* text,
+         const sidecar::attribute_schema& schema) {
+    auto node = sidecar::parse_expression(text);
+    return node && engine.add(id, *node, schema);
+}
+
+} // namespace
+
+TEST(range_engine, accepts_only_float_range_conjunctions) {
+    sidecar::attribute_schema schema(sample_attributes());
+    sidecar::range_engine engine;
+    EXPECT_TRUE(add(engine, 1, "temperature > 30.0", schema));
+    EXPECT_TRUE(add(engine, 2, "temperature >= 10 AND temperature < 20 AND pressure <= 2.5", schema));
+    EXPECT_FALSE(add(engine, 3, "temperature > 30.0 OR pressure > 1.0", schema));
+    EXPECT_FALSE(add(engine, 4, "temperature > 30.0 AND location = \"w7\"", schema));
+    EXPECT_FALSE(add(engine, 5, "temperature <> 30.0", schema));
+    EXPECT_FALSE(add(engine, 6, "not temperature > 30.0", schema));
+    EXPECT_EQ(engine.size(), 2u);
+}
+
+TEST(range_engine, evaluates_micro_batch_with_exact_bounds) {
+    sidecar::attribute_schema schema(sample_attributes());
+    sidecar::range_engine engine;
+    ASSERT_TRUE(add(engine, 1, "temperature > 30.0", schema));
+    ASSERT_TRUE(add(engine, 2, "temperature >= 10 AND temperature < 20 AND pressure <= 2.5", schema));
+
+    const auto temperature = schema.find("temperature")->index;
+    const auto pressure = schema.find("pressure")->index;
+    std::vector<sidecar::decoded_event> events(5);
+    for (auto& e : events) e.reset(schema.size());
+    events[0].set_float(temperature, 30.0);   // not > 30
+    events[1].set_float(temperature, 30.5);   // 1
+    events[2].set_float(temperature, 10.0);   // 2
+    events[2].set_float(pressure, 2.5);
+    events[3].set_float(temperature, 15.0);   // pressure missing
+    events[4].set_float(temperature, 20.0);   // < 20 fails
+    events[4].set_float(pressure, 1.0);
+
+    std::vector<const sidecar::decoded_event*> ptrs;
+    for (const auto& e : events) ptrs.push_back(&e);
+    ptrs.push_back(nullptr);
+
+    sidecar::range_batch batch;
+    engine.evaluate(ptrs, batch);
+
+    std::vector<std::vector<uint64_t>> matches(ptrs.size());
+    for (std::size_t k = 0; k < ptrs.size(); ++k) engine.append_matches(batch, k, matches[k]);
+    EXPECT_TRUE(matches[0].empty());
+    EXPECT_EQ(matches[1], (std::vector<uint64_t>{1}));
+    EXPECT_EQ(matches[2], (std::vector<uint64_t>{2}));
+    EXPECT_TRUE(matches[3].empty());
+    EXPECT_TRUE(matches[4].empty());
+    EXPECT_TRUE(matches[5].empty());
+}
+
+TEST(range_engine, dispatched_kernel_matches_scalar_comparison) {
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> dist(-100.0, 100.0);
+
+    alignas(64) double column[sidecar::range_engine::k_max_events];
+    for (auto& v : column) v = dist(rng);
+    column[3] = std::numeric_limits<double>::quiet_NaN();
+    column[7] = -5.0;
+    column[8] = 5.0;
+
+    for (std::size_t n : {1u, 5u, 17u, 64u}) {
+        uint64_t expected = 0;
+        for (std::size_t k = 0; k < n; ++k) {
+            if (column[k] >= -5.0 && column[k] <= 5.0) expected |= uint64_t{1} << k;
+        }
+        EXPECT_EQ(sidecar::range_mask(column, n, -5.0, 5.0), expected)
+            << "n=" << n << " kernel=" << sidecar::range_kernel_name();
+    }
+}
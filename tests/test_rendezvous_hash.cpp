@@ -0,0 +1,40 @@
+#include "rendezvous_hash.hpp"
+#include <gtest/gtest.h>
+#include <map>
+#include <vector>
+
+TEST(rendezvous_hash, owner_is_independent_of_member_order) {
+    const std::vector<std::string> a{"alpha", "beta", "gamma"};
+    const std::vector<std::string> b{"gamma", "alpha", "beta"};
+    for (uint64_t id = 1; id <= 200; ++id) {
+        EXPECT_EQ(*sidecar::rendezvous_owner(a, id), *sidecar::rendezvous_owner(b, id));
+    }
+    EXPECT_EQ(sidecar::rendezvous_owner(std::vector<std::string>{}, 1), nullptr);
+}
+
+TEST(rendezvous_hash, spreads_ids_evenly) {
+    const std::vector<std::string> members{"a", "b", "c", "d"};
+    std::map<std::string, int> counts;
+    for (uint64_t id = 1; id <= 4000; ++id) ++counts[*sidecar::rendezvous_owner(members, id)];
+    ASSERT_EQ(counts.size(), 4u);
+    for (const auto& [member, n] : counts) {
+        EXPECT_GT(n, 800) << member;
+        EXPECT_LT(n, 1200) << member;
+    }
+}
+
+TEST(rendezvous_hash, join_moves_only_ids_won_by_the_new_member) {
+    const std::vector<std::string> before{"a", "b", "c"};
+    const std::vector<std::string> after{"a", "b", "c", "d"};
+    std::size_t moved = 0;
+    for (uint64_t id = 1; id <= 3000; ++id) {
+        const auto& old_owner = *sidecar::rendezvous_owner(before, id);
+        const auto& new_owner = *sidecar::rendezvous_owner(after, id);
+        if (old_owner != new_owner) {
+            EXPECT_EQ(new_owner, "d");
+            ++moved;
+        }
+    }
+    EXPECT_GT(moved, 500u);
+    EXPECT_LT(moved, 1000u);
+}
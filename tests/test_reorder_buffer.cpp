@@ -0,0 +1,78 @@
+#include "reorder_buffer.hpp"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <vector>
+
+namespace {
+
+using buffer = sidecar::reorder_buffer<int>;
+using namespace std::chrono_literals;
+
+} // namespace
+
+TEST(reorder_buffer, releases_in_sequence_order) {
+    buffer b(8, 100ms);
+    std::vector<int> out;
+    auto release = [&](int&& v) { out.push_back(v); };
+    const auto now = buffer::clock::now();
+
+    b.submit(2, 20, now, release);
+    b.submit(1, 10, now, release);
+    EXPECT_TRUE(out.empty());
+    EXPECT_EQ(b.pending(), 2u);
+
+    b.submit(0, 0, now, release);
+    EXPECT_EQ(out, (std::vector<int>{0, 10, 20}));
+    EXPECT_EQ(b.pending(), 0u);
+    EXPECT_EQ(b.next(), 3u);
+}
+
+TEST(reorder_buffer, gives_up_on_a_gap_after_the_timeout) {
+    buffer b(8, 100ms);
+    std::vector<int> out;
+    auto release = [&](int&& v) { out.push_back(v); };
+    const auto start = buffer::clock::now();
+
+    b.submit(1, 10, start, release);
+    b.expire(start + 50ms, release);
+    EXPECT_TRUE(out.empty());
+
+    b.expire(start + 100ms, release);
+    EXPECT_EQ(out, (std::vector<int>{10}));
+    EXPECT_EQ(b.skipped(), 1u);
+
+    // The missing result is still published when it finally arrives.
+    b.submit(0, 0, start + 150ms, release);
+    EXPECT_EQ(out, (std::vector<int>{10, 0}));
+    EXPECT_EQ(b.late(), 1u);
+}
+
+TEST(reorder_buffer, capacity_bounds_what_is_held) {
+    buffer b(4, 1h);
+    std::vector<int> out;
+    auto release = [&](int&& v) { out.push_back(v); };
+    const auto now = buffer::clock::now();
+
+    for (uint64_t seq = 1; seq <= 3; ++seq) b.submit(seq, static_cast<int>(seq), now, release);
+    EXPECT_TRUE(out.empty());
+
+    // Sequence 4 needs a fifth slot: sequence 0 is given up.
+    b.submit(4, 4, now, release);
+    EXPECT_EQ(out, (std::vector<int>{1, 2, 3, 4}));
+    EXPECT_EQ(b.skipped(), 1u);
+    EXPECT_EQ(b.pending(), 0u);
+}
+
+TEST(reorder_buffer, flush_releases_everything_held) {
+    buffer b(8, 1h);
+    std::vector<int> out;
+    auto release = [&](int&& v) { out.push_back(v); };
+    const auto now = buffer::clock::now();
+
+    b.submit(3, 30, now, release);
+    b.submit(1, 10, now, release);
+    b.flush(release);
+    EXPECT_EQ(out, (std::vector<int>{10, 30}));
+    EXPECT_EQ(b.skipped(), 2u);
+    EXPECT_EQ(b.next(), 4u);
+}
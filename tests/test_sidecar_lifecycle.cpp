@@ -5,6 +5,10 @@
 #include <asio/io_context.hpp>
 #include <asio/steady_timer.hpp>
 #include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 #include <spdlog/sinks/null_sink.h>
 
 namespace {
@@ -39,6 +43,22 @@ struct sidecar_engine_test_access {
     static bool shutting_down(const sidecar::sidecar_engine& engine) {
         return engine.m_shutting_down.load(std::memory_order_relaxed);
     }
+
+    // Leave `payload` batched on a new input connection, as a read would
+    // before its flush runs.
+    static void batch_input(sidecar::sidecar_engine& engine, std::vector<char> payload) {
+        engine.add_input_batch(engine.m_ioc).payloads.push_back(std::move(payload));
+    }
+
+    // Deliver `payload` as a read on `shard`'s input subscription would.
+    static void receive(sidecar::sidecar_engine& engine, sidecar::io_shard& shard,
+                        const std::vector<char>& payload) {
+        engine.on_data(engine.add_input_batch(shard.context()), engine.m_cfg.input_subject, payload);
+    }
+
+    static std::optional<std::string> input_queue_group(const sidecar::sidecar_engine& engine) {
+        return engine.input_queue_group();
+    }
 };
 
 } // namespace sidecar
@@ -62,3 +82,84 @@ TEST(sidecar_engine, stop_workers_cancels_stats_loop) {
     EXPECT_TRUE(ioc.stopped());
     EXPECT_TRUE(sidecar::sidecar_engine_test_access::shutting_down(engine));
 }
+
+TEST(sidecar_engine, shared_pool_takes_every_pipelines_pending_input) {
+    asio::io_context ioc(1);
+    auto first_cfg = sample_config();
+    auto second_cfg = sample_config();
+    second_cfg.name = "second";
+    auto pool = std::make_shared<sidecar::worker_pool>(ioc, first_cfg, nullptr, make_log());
+    sidecar::sidecar_engine first(ioc, first_cfg, make_log(), pool);
+    sidecar::sidecar_engine second(ioc, second_cfg, make_log(), pool);
+    pool->start();
+
+    // 0xc1 is invalid MessagePack: processed without any publication.
+    sidecar::sidecar_engine_test_access::batch_input(first, {static_cast<char>(0xc1)});
+    sidecar::sidecar_engine_test_access::batch_input(second, {static_cast<char>(0xc1)});
+    for (auto* engine : {&first, &second}) engine->flush_pending_input();
+    for (auto* engine : {&first, &second}) engine->stop_workers();
+
+    auto stats = pool->get_stats();
+    EXPECT_EQ(stats.processed, 2u);
+    EXPECT_EQ(stats.input_dropped, 0u);
+}
+
+TEST(sidecar_engine, ingest_shard_input_reaches_the_pool) {
+    asio::io_context ioc(1);
+    auto cfg = sample_config();
+    auto pool = std::make_shared<sidecar::worker_pool>(ioc, cfg, nullptr, make_log());
+    sidecar::sidecar_engine engine(ioc, cfg, make_log(), pool);
+    std::vector<std::shared_ptr<sidecar::io_shard>> shards;
+    for (std::size_t i = 0; i < 2; ++i) {
+        shards.push_back(std::make_shared<sidecar::io_shard>("Ingest", i, make_log()));
+    }
+    engine.set_ingest_shards(shards);
+    pool->start();
+
+    // Each read is flushed on its own shard's thread, not the main one.
+    for (auto& shard : shards) {
+        sidecar::sidecar_engine_test_access::receive(engine, *shard, {static_cast<char>(0xc1)});
+    }
+    EXPECT_EQ(ioc.poll(), 0u);
+    for (auto& shard : shards) EXPECT_EQ(shard->context().poll(), 1u);
+    engine.stop_workers();
+
+    auto stats = pool->get_stats();
+    EXPECT_EQ(stats.processed, 2u);
+    EXPECT_EQ(stats.input_dropped, 0u);
+}
+
+TEST(sidecar_engine, ingest_shards_share_a_private_queue_group) {
+    using access = sidecar::sidecar_engine_test_access;
+    asio::io_context ioc(1);
+    auto shards = [](std::size_t n) {
+        std::vector<std::shared_ptr<sidecar::io_shard>> out;
+        for (std::size_t i = 0; i < n; ++i) {
+            out.push_back(std::make_shared<sidecar::io_shard>("Ingest", i, make_log()));
+        }
+        return out;
+    };
+
+    // One connection, sharded or not, reads the whole stream.
+    sidecar::sidecar_engine first(ioc, sample_config(), make_log());
+    EXPECT_FALSE(access::input_queue_group(first));
+    first.set_ingest_shards(shards(1));
+    EXPECT_FALSE(access::input_queue_group(first));
+
+    // Several shards split it through a group no other instance joins.
+    first.set_ingest_shards(shards(2));
+    sidecar::sidecar_engine second(ioc, sample_config(), make_log());
+    second.set_ingest_shards(shards(2));
+    const auto first_group = access::input_queue_group(first);
+    const auto second_group = access::input_queue_group(second);
+    ASSERT_TRUE(first_group && second_group);
+    EXPECT_EQ(first_group->rfind("_sidecar_ingest.", 0), 0u);
+    EXPECT_NE(*first_group, *second_group);
+
+    // A configured group is used as is.
+    auto cfg = sample_config();
+    cfg.input_queue_group = "filters";
+    sidecar::sidecar_engine grouped(ioc, cfg, make_log());
+    grouped.set_ingest_shards(shards(2));
+    EXPECT_EQ(access::input_queue_group(grouped), std::optional<std::string>("filters"));
+}
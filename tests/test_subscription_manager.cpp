@@ -1,7 +1,10 @@
 #include "subscription_manager.hpp"
+#include "event_bridge.hpp"
 #include <gtest/gtest.h>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/null_sink.h>
+#include <algorithm>
+#include <cstdio>
 
 namespace {
 
@@ -187,3 +190,359 @@ TEST(subscription_manager, rejects_conflicting_restored_records) {
     EXPECT_FALSE(mgr.restore(7, "severity = 5", "client-2"));
     EXPECT_EQ(mgr.active_count(), 1u);
 }
+
+TEST(subscription_manager, restores_equivalent_spellings_under_their_own_ids) {
+    sidecar::subscription_manager mgr(sample_attributes(), "test.output", make_log());
+
+    // Leases written before equivalent spellings were deduplicated.
+    ASSERT_TRUE(mgr.restore(1, "severity = 5 AND location = \"w7\"", "client-1"));
+    ASSERT_TRUE(mgr.restore(2, "location = \"w7\" AND severity = 5", "client-2"));
+    ASSERT_TRUE(mgr.restore(2, "location = \"w7\" AND severity = 5", "client-3"));
+    EXPECT_EQ(mgr.active_count(), 2u);
+    EXPECT_EQ(mgr.snapshot()->output_subjects.at(2), "test.output.2");
+
+    // Both still match; new subscribers share the first one.
+    auto snap = mgr.snapshot();
+    const auto& schema = *snap->schema;
+    sidecar::decoded_event event;
+    event.reset(schema.size());
+    event.set_integer(schema.find("severity")->index, 5);
+    event.set_string(schema.find("location")->index, "w7");
+    sidecar::match_scratch scratch;
+    std::vector<uint64_t> matches;
+    ASSERT_TRUE(sidecar::search_event(*snap, schema, event, scratch, matches, make_log()));
+    std::sort(matches.begin(), matches.end());
+    EXPECT_EQ(matches, (std::vector<uint64_t>{1, 2}));
+    EXPECT_EQ(mgr.subscribe("location = \"w7\" AND severity = 5", "client-4"), 1u);
+
+    // When the shared one goes, the duplicate takes its place.
+    EXPECT_TRUE(mgr.remove_subscription(1));
+    EXPECT_EQ(mgr.find_by_expression("severity = 5 AND location = \"w7\""), 2u);
+    EXPECT_TRUE(mgr.remove_subscription(2));
+    EXPECT_FALSE(mgr.find_by_expression("severity = 5 AND location = \"w7\"").has_value());
+}
+
+TEST(subscription_manager, equality_conjunctions_bypass_the_tree) {
+    sidecar::subscription_manager mgr(sample_attributes(), "test.output", make_log());
+
+    uint64_t eq_id = mgr.subscribe("location = \"w7\" AND severity = 5", "client-1");
+    uint64_t tree_id = mgr.subscribe("severity > 2", "client-1");
+
+    auto snap = mgr.snapshot();
+    EXPECT_EQ(snap->active_count, 2u);
+    EXPECT_EQ(snap->equality.size(), 1u);
+    EXPECT_EQ(snap->tree_size, 1u);
+    EXPECT_EQ(snap->output_subjects.count(eq_id), 1u);
+    EXPECT_EQ(snap->output_subjects.count(tree_id), 1u);
+}
+
+TEST(subscription_manager, partition_attribute_splits_and_reuses_trees) {
+    sidecar::subscription_manager mgr(sample_attributes(), "test.output", make_log(), "location");
+
+    mgr.subscribe("location = \"w7\" AND temperature > 30.0", "client-1");
+    mgr.subscribe("location = \"w8\" AND temperature > 40.0", "client-1");
+    mgr.subscribe("severity > 4", "client-1");
+
+    auto before = mgr.snapshot();
+    EXPECT_EQ(before->partitions.size(), 2u);
+    EXPECT_EQ(before->tree_size, 1u);
+    ASSERT_TRUE(before->partition_slot.has_value());
+
+    uint64_t id = mgr.subscribe("severity > 2 AND location = \"w7\"", "client-2");
+    auto after = mgr.snapshot();
+    ASSERT_EQ(after->partitions.size(), 2u);
+
+    std::string w7, w8;
+    sidecar::append_literal_key(w7, std::string("w7"));
+    sidecar::append_literal_key(w8, std::string("w8"));
+    EXPECT_EQ(after->partitions.at(w7).size, 2u);
+    EXPECT_NE(after->partitions.at(w7).tree, before->partitions.at(w7).tree);
+    EXPECT_EQ(after->partitions.at(w8).tree, before->partitions.at(w8).tree);
+    EXPECT_EQ(after->tree, before->tree);
+
+    mgr.remove_subscription(id);
+    EXPECT_EQ(mgr.snapshot()->partitions.at(w7).size, 1u);
+}
+
+TEST(subscription_manager, partition_attribute_must_be_string_or_integer) {
+    EXPECT_THROW(sidecar::subscription_manager(sample_attributes(), "test.output",
+                                               make_log(), "temperature"),
+                 std::runtime_error);
+    EXPECT_THROW(sidecar::subscription_manager(sample_attributes(), "test.output",
+                                               make_log(), "missing"),
+                 std::runtime_error);
+}
+
+TEST(subscription_manager, small_residual_sets_use_linear_matcher) {
+    sidecar::subscription_manager mgr(sample_attributes(), "test.output", make_log(), "", 2);
+
+    mgr.subscribe("severity > 3", "client-1");
+    EXPECT_EQ(mgr.snapshot()->linear.size(), 1u);
+
+    mgr.subscribe("severity < 0", "client-1");
+    EXPECT_TRUE(mgr.snapshot()->linear.empty());
+    EXPECT_EQ(mgr.snapshot()->tree_size, 2u);
+}
+
+TEST(subscription_manager, negated_expressions_keep_the_tree) {
+    sidecar::subscription_manager mgr(sample_attributes(), "test.output", make_log());
+
+    mgr.subscribe("severity > 3", "client-1");
+    mgr.subscribe("not active", "client-1");
+    EXPECT_TRUE(mgr.snapshot()->linear.empty());
+}
+
+TEST(subscription_manager, float_range_conjunctions_use_range_engine) {
+    sidecar::subscription_manager mgr(sample_attributes(), "test.output", make_log());
+
+    mgr.subscribe("temperature > 30.0 AND temperature <= 40.0", "client-1");
+    mgr.subscribe("temperature > 30.0 AND active", "client-1");
+
+    auto snap = mgr.snapshot();
+    EXPECT_EQ(snap->ranges->size(), 1u);
+    EXPECT_EQ(snap->tree_size, 1u);
+    EXPECT_EQ(snap->active_count, 2u);
+
+    // The engine is shared until a range expression comes or goes.
+    mgr.subscribe("severity = 3", "client-1");
+    EXPECT_EQ(mgr.snapshot()->ranges, snap->ranges);
+    mgr.subscribe("temperature < 5.0", "client-1");
+    EXPECT_NE(mgr.snapshot()->ranges, snap->ranges);
+    EXPECT_EQ(mgr.snapshot()->ranges->size(), 2u);
+}
+
+TEST(subscription_manager, equivalent_expressions_share_subscription) {
+    sidecar::subscription_manager mgr(sample_attributes(), "test.output", make_log());
+
+    uint64_t id1 = mgr.subscribe("severity > 1 AND location = \"x\"", "client-1");
+    uint64_t id2 = mgr.subscribe("location = 'x'  and severity > 1", "client-2");
+    EXPECT_EQ(id1, id2);
+    EXPECT_EQ(mgr.active_count(), 1u);
+    EXPECT_EQ(mgr.find_by_expression("location = \"x\" AND severity > 1"), id1);
+
+    EXPECT_FALSE(mgr.remove_lease(id1, "client-1"));
+    EXPECT_TRUE(mgr.remove_lease(id1, "client-2"));
+    EXPECT_FALSE(mgr.find_by_expression("severity > 1 AND location = \"x\"").has_value());
+}
+
+TEST(subscription_manager, schema_violations_rejected_without_publishing) {
+    sidecar::subscription_manager mgr(sample_attributes(), "test.output", make_log());
+    mgr.subscribe("severity > 1", "client-1");
+    const auto version = mgr.snapshot()->version;
+
+    for (const char* text : {"unknown_attr = 1", "location > 5", "severity = \"high\"",
+                             "temperature", "location one of [\"a\"]"}) {
+        EXPECT_THROW(mgr.subscribe(text, "client-1"), sidecar::expression_error) << text;
+    }
+    EXPECT_THROW(mgr.subscribe("this is not a valid expression !!!", "client-1"), atree::Error);
+
+    EXPECT_EQ(mgr.snapshot()->version, version);
+    EXPECT_EQ(mgr.active_count(), 1u);
+}
+
+TEST(subscription_manager, saved_state_round_trips) {
+    const std::string path = ::testing::TempDir() + "sidecar_state_round_trip.json";
+    std::remove(path.c_str());
+
+    sidecar::subscription_manager mgr(sample_attributes(), "test.output", make_log());
+    EXPECT_EQ(mgr.load_state(path), 0u);
+    const auto a = mgr.subscribe("severity > 2", "client-1");
+    mgr.subscribe("severity > 2", "client-2");
+    const auto b = mgr.subscribe("location = \"w7\"", "client-1");
+    const auto gone = mgr.subscribe("severity < 0", "client-1");
+    mgr.remove_lease(gone, "client-1");
+    ASSERT_TRUE(mgr.save_state(path));
+
+    sidecar::subscription_manager loaded(sample_attributes(), "test.output", make_log());
+    EXPECT_EQ(loaded.load_state(path), 2u);
+    EXPECT_EQ(loaded.snapshot()->active_count, 2u);
+    EXPECT_EQ(loaded.snapshot()->output_subjects.at(b), "test.output." + std::to_string(b));
+    EXPECT_EQ(loaded.get_subscription(a)->lease_holders.size(), 2u);
+    EXPECT_EQ(loaded.leases().size(), 3u);
+    EXPECT_EQ(loaded.find_by_expression("location = \"w7\""), b);
+    EXPECT_GT(loaded.subscribe("active", "client-3"), gone);
+
+    std::remove(path.c_str());
+}
+
+TEST(subscription_manager, encoded_state_restores_into_peer) {
+    sidecar::subscription_manager mgr(sample_attributes(), "test.output", make_log());
+    const auto id = mgr.subscribe("severity > 2 AND location = \"w7\"", "client-1");
+
+    sidecar::subscription_manager peer(sample_attributes(), "test.output", make_log());
+    peer.subscribe("severity = 9", "client-2");
+    const auto before = peer.change_count();
+    EXPECT_EQ(peer.restore_state(mgr.encode_state()), 0u);  // ID already taken
+    EXPECT_GT(peer.change_count(), before);
+
+    sidecar::subscription_manager fresh(sample_attributes(), "test.output", make_log());
+    EXPECT_EQ(fresh.restore_state(mgr.encode_state()), 1u);
+    EXPECT_EQ(fresh.find_by_expression("location = \"w7\" AND severity > 2"), id);
+    EXPECT_THROW(fresh.restore_state("{\"version\": 2}"), std::runtime_error);
+    EXPECT_THROW(fresh.restore_state("not json"), std::exception);
+}
+
+TEST(subscription_manager, shards_index_only_owned_subscriptions) {
+    sidecar::subscription_manager a(sample_attributes(), "test.output", make_log());
+    sidecar::subscription_manager b(sample_attributes(), "test.output", make_log());
+    a.set_shard_members("a", {});
+    b.set_shard_members("b", {});
+
+    for (int i = 0; i < 40; ++i) {
+        const auto expr = "severity = " + std::to_string(i);
+        a.subscribe(expr, "client");
+        b.subscribe(expr, "client");
+    }
+    EXPECT_TRUE(a.snapshot()->output_subjects.empty());  // no members known yet
+
+    EXPECT_TRUE(a.set_shard_members("a", {"b", "a"}));
+    EXPECT_FALSE(a.set_shard_members("a", {"a", "b"}));
+    EXPECT_TRUE(b.set_shard_members("b", {"a", "b"}));
+    const auto owned_a = a.snapshot()->output_subjects.size();
+    const auto owned_b = b.snapshot()->output_subjects.size();
+    EXPECT_EQ(owned_a + owned_b, 40u);
+    EXPECT_GT(owned_a, 0u);
+    EXPECT_GT(owned_b, 0u);
+    EXPECT_EQ(a.active_count(), 40u);
+    for (const auto& [id, subject] : a.snapshot()->output_subjects) {
+        EXPECT_FALSE(b.snapshot()->output_subjects.count(id));
+    }
+
+    // b leaves: a takes over every subscription.
+    a.set_shard_members("a", {"a"});
+    EXPECT_EQ(a.snapshot()->output_subjects.size(), 40u);
+    EXPECT_EQ(a.snapshot()->equality.size(), 40u);
+}
+
+TEST(subscription_manager, shard_owner_follows_the_expression_not_its_id) {
+    sidecar::subscription_manager a(sample_attributes(), "test.output", make_log());
+    sidecar::subscription_manager b(sample_attributes(), "test.output", make_log());
+    a.set_shard_members("a", {"a", "b"});
+    b.set_shard_members("b", {"a", "b"});
+
+    // b's counter has moved on, so every expression gets another ID there.
+    b.restore(100, "temperature > 99.0", "old-client");
+    b.remove_lease(100, "old-client");
+    for (int i = 0; i < 40; ++i) {
+        const auto expr = "severity = " + std::to_string(i);
+        const auto id_a = a.subscribe(expr, "client");
+        const auto id_b = b.subscribe(expr, "client");
+        ASSERT_NE(id_a, id_b);
+        // Exactly one of them matches it.
+        EXPECT_NE(a.snapshot()->output_subjects.count(id_a),
+                  b.snapshot()->output_subjects.count(id_b)) << expr;
+    }
+}
+
+TEST(subscription_manager, attributes_added_and_retired_at_runtime) {
+    sidecar::subscription_manager mgr(sample_attributes(), "test.output", make_log());
+    EXPECT_THROW(mgr.subscribe("humidity > 50.0", "client-1"), std::exception);
+
+    auto before = mgr.snapshot();
+    EXPECT_TRUE(mgr.add_attribute({"humidity", sidecar::attribute_type::float_val}));
+    EXPECT_FALSE(mgr.add_attribute({"humidity", sidecar::attribute_type::float_val}));
+    EXPECT_THROW(mgr.add_attribute({"humidity", sidecar::attribute_type::string}),
+                 std::invalid_argument);
+
+    // The new schema ships with the next snapshot; older ones keep theirs.
+    auto after = mgr.snapshot();
+    EXPECT_GT(after->version, before->version);
+    EXPECT_FALSE(before->schema->find("humidity"));
+    ASSERT_TRUE(after->schema->find("humidity"));
+    uint64_t id = mgr.subscribe("humidity > 50.0 AND location = \"w7\"", "client-1");
+
+    // A referenced attribute is refused in new expressions but stays put
+    // until its last subscription goes.
+    EXPECT_FALSE(mgr.deprecate_attribute("location"));
+    EXPECT_THROW(mgr.subscribe("location = \"w8\"", "client-2"), std::exception);
+    // Sharing the existing expression counts as new for another client;
+    // its holder may still refresh.
+    EXPECT_THROW(mgr.subscribe("humidity > 50.0 AND location = \"w7\"", "client-2"),
+                 std::exception);
+    EXPECT_EQ(mgr.subscribe("humidity > 50.0 AND location = \"w7\"", "client-1"), id);
+    EXPECT_EQ(mgr.get_subscription(id)->lease_holders.size(), 1u);
+    EXPECT_TRUE(mgr.snapshot()->schema->find("location"));
+    EXPECT_EQ(mgr.deprecated_attributes(), std::vector<std::string>{"location"});
+
+    EXPECT_TRUE(mgr.remove_lease(id, "client-1"));
+    EXPECT_FALSE(mgr.snapshot()->schema->find("location"));
+    EXPECT_TRUE(mgr.deprecated_attributes().empty());
+    EXPECT_TRUE(mgr.deprecate_attribute("active"));
+    EXPECT_THROW(mgr.deprecate_attribute("active"), std::invalid_argument);
+
+    // Slots were compacted; routed expressions use the new indices.
+    mgr.subscribe("severity = 5", "client-3");
+    auto snap = mgr.snapshot();
+    EXPECT_EQ(snap->schema->size(), 3u);
+    EXPECT_EQ(snap->equality.size(), 1u);
+}
+
+TEST(subscription_manager, partition_trees_follow_runtime_schema_changes) {
+    sidecar::subscription_manager mgr(sample_attributes(), "test.output", make_log(), "location");
+    uint64_t id = mgr.subscribe("location = \"w7\" AND temperature > 30.0", "client-1");
+    ASSERT_TRUE(mgr.add_attribute({"humidity", sidecar::attribute_type::float_val}));
+
+    // Events are built from the new schema, so the partition tree must be too.
+    auto snap = mgr.snapshot();
+    const auto& schema = *snap->schema;
+    sidecar::decoded_event event;
+    event.reset(schema.size());
+    event.set_string(schema.find("location")->index, "w7");
+    event.set_float(schema.find("temperature")->index, 35.0);
+    event.set_float(schema.find("humidity")->index, 60.0);
+
+    sidecar::match_scratch scratch;
+    std::vector<uint64_t> matches;
+    ASSERT_TRUE(sidecar::search_event(*snap, schema, event, scratch, matches, make_log()));
+    EXPECT_EQ(matches, std::vector<uint64_t>{id});
+}
+
+TEST(subscription_manager, runtime_attributes_travel_with_state) {
+    sidecar::subscription_manager source(sample_attributes(), "test.output", make_log());
+    source.add_attribute({"humidity", sidecar::attribute_type::float_val});
+    uint64_t id = source.subscribe("humidity > 50.0", "client-1");
+
+    sidecar::subscription_manager peer(sample_attributes(), "test.output", make_log());
+    EXPECT_EQ(peer.restore_state(source.encode_state()), 1u);
+    EXPECT_TRUE(peer.snapshot()->schema->find("humidity"));
+    EXPECT_EQ(peer.find_by_expression("humidity > 50.0"), id);
+}
+
+TEST(subscription_manager, deprecated_and_retired_attributes_travel_with_state) {
+    sidecar::subscription_manager source(sample_attributes(), "test.output", make_log());
+    uint64_t id = source.subscribe("location = \"w7\"", "client-1");
+    const auto changes = source.change_count();
+    EXPECT_FALSE(source.deprecate_attribute("location"));
+    EXPECT_TRUE(source.deprecate_attribute("active"));
+    EXPECT_GT(source.change_count(), changes);  // schema changes are saved too
+
+    sidecar::subscription_manager peer(sample_attributes(), "test.output", make_log());
+    EXPECT_EQ(peer.restore_state(source.encode_state()), 1u);
+    EXPECT_EQ(peer.find_by_expression("location = \"w7\""), id);
+    EXPECT_EQ(peer.deprecated_attributes(), std::vector<std::string>{"location"});
+    EXPECT_THROW(peer.subscribe("location = \"w8\"", "client-2"), std::exception);
+    EXPECT_FALSE(peer.snapshot()->schema->find("active"));
+    EXPECT_THROW(peer.subscribe("active", "client-2"), std::exception);
+
+    // Restored again, the retirement still holds.
+    sidecar::subscription_manager restarted(sample_attributes(), "test.output", make_log());
+    EXPECT_EQ(restarted.restore_state(peer.encode_state()), 1u);
+    EXPECT_FALSE(restarted.snapshot()->schema->find("active"));
+    EXPECT_EQ(restarted.deprecated_attributes(), std::vector<std::string>{"location"});
+}
+
+TEST(subscription_manager, node_replicas_track_the_primary_snapshot) {
+    sidecar::subscription_manager mgr(sample_attributes(), "test.output", make_log());
+    mgr.subscribe("severity = 1", "client");
+    mgr.set_replica_nodes({{0}, {0}});
+    mgr.subscribe("temperature > 30.0", "client");
+
+    auto primary = mgr.snapshot();
+    auto replica = mgr.snapshot(1);
+    ASSERT_TRUE(replica && replica->tree);
+    EXPECT_NE(primary, replica);
+    EXPECT_EQ(replica->version, primary->version);
+    EXPECT_EQ(replica->output_subjects.size(), 2u);
+    EXPECT_EQ(mgr.snapshot(0), primary);
+    EXPECT_EQ(mgr.snapshot(7), primary);  // unknown node falls back to the primary
+}
@@ -1,7 +1,14 @@
 #include "worker_pool.hpp"
+#include "io_shard.hpp"
 #include <asio/io_context.hpp>
 #include <gtest/gtest.h>
 #include <spdlog/sinks/null_sink.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
 
 namespace {
 
@@ -22,15 +29,102 @@ sidecar::config worker_config() {
     return cfg;
 }
 
+// MessagePack map {"value": n}.
+std::vector<char> value_payload(uint16_t n) {
+    std::vector<char> out = {static_cast<char>(0x81), static_cast<char>(0xa5),
+                             'v', 'a', 'l', 'u', 'e'};
+    if (n < 128) {
+        out.push_back(static_cast<char>(n));
+    } else {
+        out.push_back(static_cast<char>(0xcd));
+        out.push_back(static_cast<char>(n >> 8));
+        out.push_back(static_cast<char>(n & 0xff));
+    }
+    return out;
+}
+
+// Payload carried by a single-message publication's wire encoding.
+std::string published_payload(const std::string& wire) {
+    const auto start = wire.find("\r\n") + 2;
+    return wire.substr(start, wire.size() - start - 2);
+}
+
 } // namespace
 
+namespace sidecar {
+
+struct worker_pool_test_access {
+    // Admit input as start() would, but without any worker to drain it.
+    static void open_budgets(worker_pool& pool) {
+        for (auto& p : pool.m_pipelines) p->budget.fetch_and(~worker_pool::k_budget_closed);
+    }
+
+    // Counts waiting on worker `id`'s own semaphore.
+    static int64_t backlog(worker_pool& pool, unsigned int id) {
+        return pool.m_ready[id].availableApprox();
+    }
+
+    // Park timeout far beyond any test deadline, so only a wake ends a park.
+    static void park_until_woken(worker_pool& pool) {
+        pool.m_park_us = std::int64_t{3600} * 1000 * 1000;
+    }
+
+    // Whether worker `id` is parked waiting to be woken.
+    static bool parked(worker_pool& pool, unsigned int id) {
+        return pool.m_idle[id].parked.load();
+    }
+
+    // Start worker `id` by itself; stop() joins it with the rest.
+    static void start_worker(worker_pool& pool, unsigned int id) {
+        open_budgets(pool);
+        pool.m_running.store(true);
+        pool.m_threads.emplace_back(&worker_pool::worker_loop, &pool, id);
+    }
+
+    // Wire encodings released by pipeline `index`'s reorder buffer and not
+    // yet taken by its writer, in write order. The writer only runs on the
+    // I/O context, so with the context idle this is everything released.
+    static std::vector<std::string> released(worker_pool& pool, std::size_t index) {
+        auto& o = *pool.m_pipelines[index]->ordered;
+        std::lock_guard<std::mutex> lock(o.mutex);
+        std::vector<std::string> wires;
+        for (const auto& record : o.ready) wires.push_back(record->wire);
+        return wires;
+    }
+
+    // Report a result for `sequence` as a worker would: `payload` matched
+    // subscription `id`.
+    static void submit(worker_pool& pool, std::size_t index, uint64_t sequence,
+                       uint64_t id, const std::vector<char>& payload) {
+        auto& p = *pool.m_pipelines[index];
+        auto snap = p.sub_mgr.snapshot();
+        const uint64_t matches[] = {id};
+        worker_pool::publication_ptr records[] = {pool.build_publication(matches, *snap, payload)};
+        const uint64_t sequences[] = {sequence};
+        pool.submit_ordered(p, sequences, records);
+    }
+
+    static void expire(worker_pool& pool, std::size_t index) {
+        pool.expire_ordered(*pool.m_pipelines[index]);
+    }
+
+    static io_shard* output_shard(const worker_pool& pool, unsigned int worker_id) {
+        return pool.output_shard(worker_id);
+    }
+
+    static io_shard* ordered_output(const worker_pool& pool, std::size_t index) {
+        return pool.m_pipelines[index]->ordered->out;
+    }
+};
+
+} // namespace sidecar
+
 TEST(worker_pool, rejects_payload_larger_than_byte_limit) {
     asio::io_context ioc(1);
     auto cfg = worker_config();
     cfg.input_queue_max_bytes = 8;
-    sidecar::attribute_schema schema(cfg.attributes);
     sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
-    sidecar::worker_pool pool(ioc, cfg, schema, subscriptions, nullptr, worker_log());
+    sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
 
     pool.start();
     EXPECT_FALSE(pool.enqueue(std::vector<char>(9, 'x')));
@@ -44,9 +138,8 @@ TEST(worker_pool, rejects_payload_larger_than_byte_limit) {
 TEST(worker_pool, stop_drains_every_accepted_input) {
     asio::io_context ioc(1);
     auto cfg = worker_config();
-    sidecar::attribute_schema schema(cfg.attributes);
     sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
-    sidecar::worker_pool pool(ioc, cfg, schema, subscriptions, nullptr, worker_log());
+    sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
 
     pool.start();
     std::size_t accepted = 0;
@@ -62,3 +155,399 @@ TEST(worker_pool, stop_drains_every_accepted_input) {
     EXPECT_EQ(stats.queue_depth, 0u);
     EXPECT_EQ(stats.queue_bytes, 0u);
 }
+
+TEST(worker_pool, pipelines_share_workers_with_separate_limits) {
+    asio::io_context ioc(1);
+    auto cfg = worker_config();
+    auto small = worker_config();
+    small.input_queue_max_bytes = 8;
+    sidecar::subscription_manager first(cfg.attributes, cfg.output_prefix, worker_log());
+    sidecar::subscription_manager second(small.attributes, small.output_prefix, worker_log());
+    sidecar::worker_pool pool(ioc, cfg, nullptr, worker_log());
+    const auto a = pool.add_pipeline(cfg, first);
+    const auto b = pool.add_pipeline(small, second);
+
+    pool.start();
+    EXPECT_THROW(pool.add_pipeline(cfg, first), std::logic_error);
+    std::size_t accepted_a = 0;
+    std::size_t accepted_b = 0;
+    for (std::size_t i = 0; i < 50; ++i) {
+        if (pool.enqueue(a, std::vector<char>{static_cast<char>(0xc1)})) ++accepted_a;
+        if (pool.enqueue(b, std::vector<char>{static_cast<char>(0xc1)})) ++accepted_b;
+    }
+    // Only the second pipeline's byte limit applies to it.
+    EXPECT_FALSE(pool.enqueue(b, std::vector<char>(9, 'x')));
+    EXPECT_TRUE(pool.enqueue(a, std::vector<char>{static_cast<char>(0xc1)}));
+    ++accepted_a;
+    pool.stop();
+
+    auto stats_a = pool.get_stats(a);
+    auto stats_b = pool.get_stats(b);
+    EXPECT_EQ(stats_a.processed, accepted_a);
+    EXPECT_EQ(stats_a.input_dropped, 0u);
+    EXPECT_EQ(stats_b.processed, accepted_b);
+    EXPECT_EQ(stats_b.input_dropped, 50u - accepted_b + 1);
+    EXPECT_EQ(pool.get_stats().processed, accepted_a + accepted_b);
+    EXPECT_EQ(pool.get_stats().queue_depth, 0u);
+}
+
+TEST(worker_pool, processed_payload_buffers_are_reused) {
+    asio::io_context ioc(1);
+    auto cfg = worker_config();
+    sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
+    sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
+
+    EXPECT_EQ(pool.acquire_buffer(16).capacity(), 0u);
+    pool.start();
+    std::vector<char> payload(16, static_cast<char>(0xc1));
+    ASSERT_TRUE(pool.enqueue(std::move(payload)));
+    pool.stop();
+
+    auto buffer = pool.acquire_buffer(16);
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_GE(buffer.capacity(), 16u);
+}
+
+TEST(worker_pool, byte_limit_charges_buffer_capacity) {
+    asio::io_context ioc(1);
+    auto cfg = worker_config();
+    cfg.input_queue_max_bytes = 8192;
+    sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
+    sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
+
+    // One byte of payload in a 16 KiB buffer does not fit an 8 KiB budget.
+    std::vector<char> oversized;
+    oversized.reserve(16 * 1024);
+    oversized.push_back(static_cast<char>(0xc1));
+    pool.start();
+    EXPECT_FALSE(pool.enqueue(std::move(oversized)));
+
+    // A recycled 6 KiB buffer is not handed out for a 1-byte payload.
+    std::vector<char> large(6 * 1024, static_cast<char>(0xc1));
+    ASSERT_TRUE(pool.enqueue(std::move(large)));
+    pool.stop();
+    EXPECT_EQ(pool.acquire_buffer(1).capacity(), 0u);
+    EXPECT_EQ(pool.get_stats().input_dropped, 1u);
+}
+
+TEST(worker_pool, bulk_enqueue_after_stop_drops_everything) {
+    asio::io_context ioc(1);
+    auto cfg = worker_config();
+    sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
+    sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
+
+    pool.start();
+    pool.stop();
+    std::vector<std::vector<char>> rejected(2, std::vector<char>(1, 'x'));
+    EXPECT_EQ(pool.enqueue_bulk(0, rejected), 0u);
+    EXPECT_EQ(pool.get_stats().input_dropped, 2u);
+}
+
+TEST(worker_pool, bulk_enqueue_skips_payloads_over_budget) {
+    asio::io_context ioc(1);
+    auto cfg = worker_config();
+    cfg.worker_threads = 1;
+    cfg.input_queue_max_messages = 3;
+    cfg.input_queue_max_bytes = 10;
+    sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
+    sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
+
+    // Sizes 4, 8, 4, 2, 1: the 8-byte payload does not fit after the first,
+    // and the message limit stops the last one.
+    std::vector<std::vector<char>> payloads;
+    for (std::size_t size : {4, 8, 4, 2, 1}) {
+        payloads.emplace_back(size, static_cast<char>(0xc1));
+    }
+    pool.start();
+    EXPECT_EQ(pool.enqueue_bulk(0, payloads), 3u);
+    pool.stop();
+
+    // The rejected payloads are kept at the back, in order.
+    EXPECT_EQ(payloads[3].size(), 8u);
+    EXPECT_EQ(payloads[4].size(), 1u);
+    auto stats = pool.get_stats();
+    EXPECT_EQ(stats.input_dropped, 2u);
+    EXPECT_EQ(stats.processed, 3u);
+}
+
+TEST(worker_pool, concurrent_producers_fill_the_budget_exactly) {
+    asio::io_context ioc(1);
+    auto cfg = worker_config();
+    cfg.input_queue_max_messages = 64;
+    sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
+    sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
+
+    // Closed until start().
+    EXPECT_FALSE(pool.enqueue(std::vector<char>{static_cast<char>(0xc1)}));
+    // With no worker draining, racing producers must stop at the limit.
+    sidecar::worker_pool_test_access::open_budgets(pool);
+
+    constexpr std::size_t k_producers = 4;
+    constexpr std::size_t k_batches = 200;
+    std::atomic<std::size_t> accepted{0};
+    std::vector<std::thread> producers;
+    for (std::size_t t = 0; t < k_producers; ++t) {
+        producers.emplace_back([&] {
+            for (std::size_t i = 0; i < k_batches; ++i) {
+                std::vector<std::vector<char>> batch(4, std::vector<char>{static_cast<char>(0xc1)});
+                accepted += pool.enqueue_bulk(0, batch);
+            }
+        });
+    }
+    for (auto& t : producers) t.join();
+
+    auto stats = pool.get_stats();
+    EXPECT_EQ(accepted.load(), 64u);
+    EXPECT_EQ(stats.queue_depth, 64u);
+    EXPECT_EQ(stats.queue_bytes, 64u);
+    EXPECT_EQ(stats.input_dropped, k_producers * k_batches * 4 + 1 - 64);
+
+    pool.start();
+    pool.stop();
+    stats = pool.get_stats();
+    EXPECT_EQ(stats.processed, 64u);
+    EXPECT_EQ(stats.queue_depth, 0u);
+    EXPECT_EQ(stats.queue_bytes, 0u);
+}
+
+TEST(worker_pool, bulk_enqueue_reorders_keys_with_payloads) {
+    asio::io_context ioc(1);
+    auto cfg = worker_config();
+    cfg.input_queue_max_bytes = 6;
+    sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
+    sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
+
+    // Sizes 4, 8, 2: the 8-byte payload is rejected and moves to the back
+    // together with its key.
+    std::vector<std::vector<char>> payloads;
+    for (std::size_t size : {4, 8, 2}) {
+        payloads.emplace_back(size, static_cast<char>(0xc1));
+    }
+    std::vector<uint64_t> keys = {10, 20, 30};
+    pool.start();
+    EXPECT_EQ(pool.enqueue_bulk(0, payloads, keys), 2u);
+    pool.stop();
+
+    EXPECT_EQ(payloads[2].size(), 8u);
+    EXPECT_EQ(keys[2], 20u);
+    auto stats = pool.get_stats();
+    EXPECT_EQ(stats.processed, 2u);
+    EXPECT_EQ(stats.input_dropped, 1u);
+}
+
+TEST(worker_pool, idle_worker_steals_from_a_backlogged_lane) {
+    asio::io_context ioc(1);
+    auto cfg = worker_config();
+    sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
+    sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
+    using access = sidecar::worker_pool_test_access;
+
+    // Key 1 pins every message to worker 1's lane.
+    access::open_budgets(pool);
+    std::vector<std::vector<char>> payloads(100, std::vector<char>{static_cast<char>(0xc1)});
+    std::vector<uint64_t> keys(payloads.size(), 1);
+    ASSERT_EQ(pool.enqueue_bulk(0, payloads, keys), 100u);
+    EXPECT_EQ(access::backlog(pool, 0), 0);
+    EXPECT_EQ(access::backlog(pool, 1), 100);
+
+    // Worker 0 alone can only steal, and leaves the last message to the
+    // lane's owner.
+    access::start_worker(pool, 0);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (pool.get_stats().processed < 99 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto stats = pool.get_stats();
+    EXPECT_EQ(stats.processed, 99u);
+    EXPECT_EQ(stats.stolen, 99u);
+    EXPECT_EQ(access::backlog(pool, 1), 1);
+
+    access::start_worker(pool, 1);
+    pool.stop();
+    stats = pool.get_stats();
+    EXPECT_EQ(stats.processed, 100u);
+    EXPECT_EQ(stats.stolen, 99u);
+    EXPECT_EQ(stats.queue_depth, 0u);
+}
+
+TEST(worker_pool, parked_worker_wakes_to_steal_a_new_backlog) {
+    asio::io_context ioc(1);
+    auto cfg = worker_config();
+    sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
+    sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
+    using access = sidecar::worker_pool_test_access;
+
+    // Worker 0 finds nothing to do or steal and parks, with no timeout to
+    // end the park before the test's deadline.
+    access::park_until_woken(pool);
+    access::start_worker(pool, 0);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!access::parked(pool, 0) && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_TRUE(access::parked(pool, 0));
+
+    // Only the wake from a backlog on worker 1's lane can get it stealing.
+    std::vector<std::vector<char>> payloads(100, std::vector<char>{static_cast<char>(0xc1)});
+    std::vector<uint64_t> keys(payloads.size(), 1);
+    ASSERT_EQ(pool.enqueue_bulk(0, payloads, keys), 100u);
+    deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (pool.get_stats().stolen == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_GT(pool.get_stats().stolen, 0u);
+
+    access::start_worker(pool, 1);
+    pool.stop();
+    EXPECT_EQ(pool.get_stats().processed, 100u);
+}
+
+TEST(worker_pool, ordered_pipeline_publishes_in_input_order) {
+    asio::io_context ioc(1);
+    auto cfg = worker_config();
+    cfg.worker_threads = 4;
+    cfg.worker_batch_size = 4;
+    cfg.ordered_output = true;
+    cfg.input_queue_max_bytes = 1 << 20;
+    cfg.publish_max_inflight = 1024;
+    sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
+    const auto id = subscriptions.subscribe("value >= 0", "client");
+    sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
+
+    // Small batches round-robin over four lanes, so workers match
+    // neighbouring messages concurrently and finish them out of order. The
+    // I/O context never runs, so every released publication stays queued
+    // for the writer.
+    constexpr uint16_t k_messages = 400;
+    pool.start();
+    for (uint16_t n = 0; n < k_messages; n += 2) {
+        std::vector<std::vector<char>> payloads = {value_payload(n), value_payload(n + 1)};
+        ASSERT_EQ(pool.enqueue_bulk(0, payloads), 2u);
+    }
+    // Results only reach the writer queue once every earlier one has.
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (pool.get_stats().processed < k_messages && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(pool.get_stats().processed, uint64_t{k_messages});
+    auto released = sidecar::worker_pool_test_access::released(pool, 0);
+    pool.stop();
+
+    ASSERT_EQ(released.size(), k_messages);
+    for (uint16_t n = 0; n < k_messages; ++n) {
+        const auto expected = value_payload(n);
+        EXPECT_EQ(published_payload(released[n]), std::string(expected.begin(), expected.end()))
+            << "position " << n;
+        EXPECT_EQ(released[n].rfind("PUB output." + std::to_string(id) + " ", 0), 0u);
+    }
+    auto stats = pool.get_stats();
+    EXPECT_EQ(stats.reorder_pending, 0u);
+    EXPECT_EQ(stats.reorder_skipped, 0u);
+    EXPECT_EQ(stats.reorder_late, 0u);
+}
+
+TEST(worker_pool, ordered_pipeline_gives_up_on_a_missing_result) {
+    asio::io_context ioc(1);
+    auto cfg = worker_config();
+    cfg.ordered_output = true;
+    cfg.reorder_timeout_ms = 1;
+    sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
+    const auto id = subscriptions.subscribe("value >= 0", "client");
+    sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
+    using access = sidecar::worker_pool_test_access;
+
+    // Result 1 waits for result 0 until the timeout, then goes out alone.
+    access::submit(pool, 0, 1, id, value_payload(1));
+    access::expire(pool, 0);
+    EXPECT_TRUE(access::released(pool, 0).empty());
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    access::expire(pool, 0);
+    ASSERT_EQ(access::released(pool, 0).size(), 1u);
+    EXPECT_EQ(pool.get_stats().reorder_skipped, 1u);
+
+    // Result 0 turns up after all: published late rather than lost.
+    access::submit(pool, 0, 0, id, value_payload(0));
+    auto released = access::released(pool, 0);
+    ASSERT_EQ(released.size(), 2u);
+    const auto late = value_payload(0);
+    EXPECT_EQ(published_payload(released[1]), std::string(late.begin(), late.end()));
+    EXPECT_EQ(pool.get_stats().reorder_late, 1u);
+}
+
+TEST(worker_pool, wait_strategies_decide_whether_idle_workers_park) {
+    struct mode {
+        sidecar::wait_strategy strategy;
+        bool latency_mode;
+        bool parks; // blocks once idle rather than polling
+    };
+    for (auto m : {mode{sidecar::wait_strategy::park, false, true},
+                   mode{sidecar::wait_strategy::adaptive, false, true},
+                   mode{sidecar::wait_strategy::spin, false, false},
+                   mode{sidecar::wait_strategy::yield, false, false},
+                   mode{sidecar::wait_strategy::park, true, false}}) {
+        asio::io_context ioc(1);
+        auto cfg = worker_config();
+        cfg.worker_threads = 1;
+        cfg.worker_wait_strategy = m.strategy;
+        cfg.latency_mode = m.latency_mode;
+        sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
+        sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
+        using access = sidecar::worker_pool_test_access;
+        const auto label = std::to_string(static_cast<int>(m.strategy)) +
+                           (m.latency_mode ? " latency_mode" : "");
+
+        // Parking strategies block soon after the worker goes idle; polling
+        // ones never do.
+        pool.start();
+        bool parked = false;
+        const auto idle_until = std::chrono::steady_clock::now() +
+                                std::chrono::milliseconds(m.parks ? 5000 : 50);
+        while (!parked && std::chrono::steady_clock::now() < idle_until) {
+            parked = access::parked(pool, 0);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        EXPECT_EQ(parked, m.parks) << label;
+
+        // Whatever the strategy, an idle worker still picks up new input.
+        for (std::size_t i = 0; i < 10; ++i) {
+            EXPECT_TRUE(pool.enqueue(std::vector<char>{static_cast<char>(0xc1)})) << label;
+        }
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (pool.get_stats().processed < 10 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        EXPECT_EQ(pool.get_stats().processed, 10u) << label;
+        pool.stop();
+    }
+}
+
+TEST(worker_pool, output_shards_are_shared_round_robin) {
+    asio::io_context ioc(1);
+    auto cfg = worker_config();
+    cfg.worker_threads = 4;
+    sidecar::subscription_manager subscriptions(cfg.attributes, cfg.output_prefix, worker_log());
+    sidecar::worker_pool pool(ioc, cfg, subscriptions, nullptr, worker_log());
+    using access = sidecar::worker_pool_test_access;
+    EXPECT_EQ(access::output_shard(pool, 0), nullptr);
+
+    auto ordered_cfg = cfg;
+    ordered_cfg.ordered_output = true;
+    sidecar::subscription_manager ordered_subscriptions(
+        ordered_cfg.attributes, ordered_cfg.output_prefix, worker_log());
+    const auto ordered = pool.add_pipeline(ordered_cfg, ordered_subscriptions);
+
+    std::vector<std::shared_ptr<sidecar::io_shard>> shards;
+    for (std::size_t i = 0; i < 3; ++i) {
+        shards.push_back(std::make_shared<sidecar::io_shard>("Output", i, worker_log()));
+    }
+    pool.set_output_shards(shards);
+    // Worker i writes through shard i % 3; an ordered pipeline through the
+    // one shard its index selects.
+    for (unsigned int w = 0; w < 4; ++w) {
+        EXPECT_EQ(access::output_shard(pool, w), shards[w % 3].get()) << "worker " << w;
+    }
+    pool.start();
+    EXPECT_EQ(access::ordered_output(pool, ordered), shards[ordered % 3].get());
+    EXPECT_THROW(pool.set_output_shards({}), std::logic_error);
+    pool.stop();
+}